@@ -0,0 +1,158 @@
+#!/bin/sh
+# Run the benchmark programs and compare their timings with a baseline.
+#
+# Usage: benchmarks/run.sh [options] [-- interpreter flags...]
+#   -i PATH    interpreter to time (default ./interpreter)
+#   -w N       untimed warmup runs per benchmark (default 2)
+#   -n N       timed runs per benchmark (default 10)
+#   -o FILE    where to write the results (default benchmarks/results.tsv)
+#   -b FILE    baseline to compare with (default benchmarks/baseline.tsv)
+#   -t PCT     allowed slowdown of the median before failing (default 10)
+#   -s         save the results as the new baseline instead of comparing
+#   -f NAME    only run benchmarks whose name contains NAME
+#
+# Every benchmark is a .prog file in this directory, run with stdin and
+# stdout redirected so that nothing waits on the terminal. A program whose
+# first lines contain "// bench-input: matrix ROWS COLS" reads a matrix of
+# that size, generated once with a fixed seed, from stdin.
+#
+# Results are tab-separated: benchmark, runs, median, p95, min and max in
+# milliseconds. With a baseline, the median of each benchmark is compared
+# with the stored one and the script exits with status 1 if any is slower
+# by more than the tolerance.
+
+dir=$(cd "$(dirname "$0")" && pwd)
+interp=./interpreter
+warmup=2
+runs=10
+results=$dir/results.tsv
+baseline=$dir/baseline.tsv
+tolerance=10
+save=0
+filter=
+
+while getopts i:w:n:o:b:t:sf: opt; do
+    case $opt in
+        i) interp=$OPTARG ;;
+        w) warmup=$OPTARG ;;
+        n) runs=$OPTARG ;;
+        o) results=$OPTARG ;;
+        b) baseline=$OPTARG ;;
+        t) tolerance=$OPTARG ;;
+        s) save=1 ;;
+        f) filter=$OPTARG ;;
+        *) sed -n '2,13s/^# \{0,1\}//p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$interp" ]; then
+    echo "Error: interpreter '$interp' not found; run make first" >&2
+    exit 2
+fi
+case $(date +%N) in
+    *N*) echo "Error: date does not support nanoseconds (%N)" >&2; exit 2 ;;
+esac
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/yapl-bench.XXXXXX") || exit 2
+trap 'rm -rf "$work"' EXIT INT TERM
+
+now_ns() {
+    date +%s%N
+}
+
+# The input file for a benchmark, generated on first use
+bench_input() {
+    spec=$(sed -n 's|^// bench-input: *||p' "$1" | head -n 1)
+    case $spec in
+        "")
+            echo /dev/null ;;
+        matrix\ *)
+            set -- $spec
+            file=$work/matrix_$2x$3.txt
+            if [ ! -f "$file" ]; then
+                awk -v rows="$2" -v cols="$3" 'BEGIN {
+                    srand(42)
+                    for (i = 0; i < rows; i++) {
+                        line = ""
+                        for (j = 0; j < cols; j++) line = line (j ? " " : "") sprintf("%.4f", rand() * 2 - 1)
+                        print line
+                    }
+                }' > "$file"
+            fi
+            echo "$file" ;;
+        *)
+            echo "Error: $1: unknown bench-input '$spec'" >&2
+            return 1 ;;
+    esac
+}
+
+printf 'benchmark\truns\tmedian_ms\tp95_ms\tmin_ms\tmax_ms\n' > "$work/results.tsv"
+failed=0
+for prog in "$dir"/*.prog; do
+    name=$(basename "$prog" .prog)
+    case $name in *"$filter"*) ;; *) continue ;; esac
+    input=$(bench_input "$prog") || { failed=1; continue; }
+
+    i=0
+    while [ $i -lt "$warmup" ]; do
+        "$interp" "$@" "$prog" < "$input" > /dev/null 2>&1
+        i=$((i + 1))
+    done
+
+    : > "$work/times"
+    i=0
+    while [ $i -lt "$runs" ]; do
+        start=$(now_ns)
+        if ! "$interp" "$@" "$prog" < "$input" > /dev/null 2> "$work/stderr"; then
+            echo "Error: $name failed:" >&2
+            cat "$work/stderr" >&2
+            failed=1
+            continue 2
+        fi
+        end=$(now_ns)
+        echo $(((end - start) / 1000)) >> "$work/times"
+        i=$((i + 1))
+    done
+
+    # Median and nearest-rank p95 of the sorted run times (microseconds)
+    sort -n "$work/times" | awk -v name="$name" '
+        { t[NR] = $1 }
+        END {
+            median = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+            rank = int(NR * 0.95); if (rank < NR * 0.95) rank++
+            printf "%s\t%d\t%.3f\t%.3f\t%.3f\t%.3f\n", name, NR,
+                   median / 1000, t[rank] / 1000, t[1] / 1000, t[NR] / 1000
+        }' >> "$work/results.tsv"
+done
+
+cp "$work/results.tsv" "$results"
+if [ $save = 1 ]; then
+    cp "$work/results.tsv" "$baseline"
+    column -t -s "$(printf '\t')" "$baseline" 2>/dev/null || cat "$baseline"
+    echo "Saved baseline to $baseline"
+    exit $failed
+fi
+
+if [ ! -f "$baseline" ]; then
+    column -t -s "$(printf '\t')" "$results" 2>/dev/null || cat "$results"
+    echo "No baseline at $baseline; save one with -s (make bench-baseline)"
+    exit $failed
+fi
+
+awk -F '\t' -v tolerance="$tolerance" '
+    FNR == 1 { next }
+    NR == FNR { base[$1] = $3; next }
+    {
+        if (!($1 in base)) {
+            printf "%-14s %10.3f ms  (not in baseline)\n", $1, $3
+            next
+        }
+        change = base[$1] > 0 ? ($3 - base[$1]) / base[$1] * 100 : 0
+        status = change > tolerance ? "REGRESSION" : change < -tolerance ? "faster" : "ok"
+        if (status == "REGRESSION") regressed = 1
+        printf "%-14s %10.3f ms  baseline %10.3f ms  %+7.1f%%  %s\n", $1, $3, base[$1], change, status
+    }
+    END { exit regressed }' "$baseline" "$results" || failed=1
+
+exit $failed
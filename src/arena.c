@@ -0,0 +1,74 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Every allocation is aligned for any scalar type */
+#define ARENA_ALIGN 16
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t used;
+    size_t size;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+void arena_init(Arena *arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->chunk_size = chunk_size;
+}
+
+static ArenaChunk* arena_new_chunk(size_t size) {
+    ArenaChunk *chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    chunk->used = 0;
+    chunk->size = size;
+    return chunk;
+}
+
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        if (size > arena->chunk_size / 4) {
+            /* Big blocks get a chunk of their own behind the current one,
+             * so the space left in the current chunk is not wasted */
+            chunk = arena_new_chunk(size);
+            if (arena->head) {
+                chunk->next = arena->head->next;
+                arena->head->next = chunk;
+            } else {
+                chunk->next = NULL;
+                arena->head = chunk;
+            }
+        } else {
+            chunk = arena_new_chunk(arena->chunk_size);
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char* arena_strndup(Arena *arena, const char *str, size_t len) {
+    char *copy = (char*)arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
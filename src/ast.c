@@ -1,13 +1,30 @@
 #include "ast.h"
+#include "arena.h"
 #include <stdio.h>
 
+/* Owns every node, list array and string literal of the current parse,
+ * unless a host keeping several trees has switched to one of its own.
+ * Each thread parses into its own arenas. */
+static _Thread_local Arena default_arena = { NULL, AST_ARENA_CHUNK };
+static _Thread_local Arena *ast_arena = NULL;   /* NULL for default_arena */
+
+static Arena* current_arena(void) {
+    return ast_arena ? ast_arena : &default_arena;
+}
+
+Arena* ast_use_arena(Arena *arena) {
+    Arena *previous = current_arena();
+    ast_arena = arena == &default_arena ? NULL : arena;
+    return previous;
+}
+
+char* ast_strndup(const char *str, size_t len) {
+    return arena_strndup(current_arena(), str, len);
+}
+
 /* Helper function to create a base node */
 static ASTNode* create_node(NodeType type, int line) {
-    ASTNode *node = (ASTNode*)malloc(sizeof(ASTNode));
-    if (!node) {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        exit(1);
-    }
+    ASTNode *node = (ASTNode*)arena_alloc(current_arena(), sizeof(ASTNode));
     node->type = type;
     node->line_number = line;
     node->data_type.base_type = TYPE_UNKNOWN;
@@ -16,6 +33,13 @@ static ASTNode* create_node(NodeType type, int line) {
     return node;
 }
 
+static VarRef unresolved_ref(void) {
+    VarRef ref;
+    ref.slot = -1;
+    ref.global_slot = -1;
+    return ref;
+}
+
 /* Literals */
 ASTNode* create_int_literal(int value, int line) {
     ASTNode *node = create_node(NODE_INT_LITERAL, line);
@@ -33,7 +57,7 @@ ASTNode* create_float_literal(double value, int line) {
 
 ASTNode* create_string_literal(char *value, int line) {
     ASTNode *node = create_node(NODE_STRING_LITERAL, line);
-    node->data.string_literal.value = strdup(value);
+    node->data.string_literal.value = value;
     node->data_type.base_type = TYPE_STRING;
     return node;
 }
@@ -46,9 +70,10 @@ ASTNode* create_bool_literal(int value, int line) {
 }
 
 /* Identifiers */
-ASTNode* create_identifier(char *name, int line) {
+ASTNode* create_identifier(Atom name, int line) {
     ASTNode *node = create_node(NODE_IDENTIFIER, line);
-    node->data.identifier.name = strdup(name);
+    node->data.identifier.name = name;
+    node->data.identifier.ref = unresolved_ref();
     return node;
 }
 
@@ -57,6 +82,7 @@ ASTNode* create_binary_op(NodeType type, ASTNode *left, ASTNode *right, int line
     ASTNode *node = create_node(type, line);
     node->data.binary_op.left = left;
     node->data.binary_op.right = right;
+    node->data.binary_op.regex = NULL;
     return node;
 }
 
@@ -77,39 +103,47 @@ ASTNode* create_range(NodeType type, ASTNode *start, ASTNode *end, ASTNode *step
 }
 
 /* Declarations */
-ASTNode* create_var_decl(TypeInfo type, char *name, ASTNode *initializer, int line) {
+ASTNode* create_var_decl(TypeInfo type, Atom name, ASTNode *initializer, int line) {
     ASTNode *node = create_node(NODE_VAR_DECL, line);
     node->data.var_decl.type = type;
-    node->data.var_decl.name = strdup(name);
+    node->data.var_decl.name = name;
     node->data.var_decl.initializer = initializer;
+    node->data.var_decl.ref = unresolved_ref();
     node->data_type = type;
     return node;
 }
 
-ASTNode* create_array_decl(TypeInfo type, char *name, ASTNode *size, ASTNode *initializer, int line) {
+ASTNode* create_array_decl(TypeInfo type, Atom name, ASTNode *size, ASTNode *initializer, int line) {
     ASTNode *node = create_node(NODE_ARRAY_DECL, line);
     node->data.array_decl.type = type;
-    node->data.array_decl.name = strdup(name);
+    node->data.array_decl.name = name;
     node->data.array_decl.size = size;
     node->data.array_decl.initializer = initializer;
     node->data_type = type;
     return node;
 }
 
-ASTNode* create_func_decl(TypeInfo return_type, char *name, ASTNode *params, ASTNode *body, int line) {
+ASTNode* create_func_decl(TypeInfo return_type, Atom name, ASTNode *params, ASTNode *body, int line) {
     ASTNode *node = create_node(NODE_FUNC_DECL, line);
     node->data.func_decl.return_type = return_type;
-    node->data.func_decl.name = strdup(name);
+    node->data.func_decl.name = name;
     node->data.func_decl.params = params;
     node->data.func_decl.body = body;
+    node->data.func_decl.slot = -1;
+    node->data.func_decl.num_slots = 0;
+    node->data.func_decl.fixed = 0;
+    node->data.func_decl.jit = NULL;
+    node->data.func_decl.memo = NULL;
+    node->data.func_decl.profile = NULL;
     node->data_type = return_type;
     return node;
 }
 
-ASTNode* create_param(TypeInfo type, char *name, int line) {
+ASTNode* create_param(TypeInfo type, Atom name, int line) {
     ASTNode *node = create_node(NODE_PARAM, line);
     node->data.param.type = type;
-    node->data.param.name = strdup(name);
+    node->data.param.name = name;
+    node->data.param.ref = unresolved_ref();
     node->data_type = type;
     return node;
 }
@@ -139,11 +173,12 @@ ASTNode* create_for_stmt(ASTNode *init, ASTNode *condition, ASTNode *increment,
     return node;
 }
 
-ASTNode* create_for_range(char *iterator, ASTNode *range, ASTNode *body, int line) {
+ASTNode* create_for_range(Atom iterator, ASTNode *range, ASTNode *body, int line) {
     ASTNode *node = create_node(NODE_FOR_RANGE, line);
-    node->data.for_range.iterator = strdup(iterator);
+    node->data.for_range.iterator = iterator;
     node->data.for_range.range = range;
     node->data.for_range.body = body;
+    node->data.for_range.ref = unresolved_ref();
     return node;
 }
 
@@ -172,6 +207,7 @@ ASTNode* create_func_call(ASTNode *func, ASTNode *args, int line) {
     ASTNode *node = create_node(NODE_FUNC_CALL, line);
     node->data.func_call.func = func;
     node->data.func_call.args = args;
+    node->data.func_call.builtin = NULL;
     return node;
 }
 
@@ -196,12 +232,12 @@ void list_append(ASTNode *list, ASTNode *item) {
     
     if (list->data.list.count >= list->data.list.capacity) {
         int new_capacity = list->data.list.capacity == 0 ? 8 : list->data.list.capacity * 2;
-        list->data.list.items = (ASTNode**)realloc(list->data.list.items, 
-                                                     new_capacity * sizeof(ASTNode*));
-        if (!list->data.list.items) {
-            fprintf(stderr, "Error: Memory allocation failed\n");
-            exit(1);
+        ASTNode **items = (ASTNode**)arena_alloc(current_arena(), new_capacity * sizeof(ASTNode*));
+        if (list->data.list.count > 0) {
+            memcpy(items, list->data.list.items, list->data.list.count * sizeof(ASTNode*));
         }
+        /* The old array stays in the arena until the tree is freed */
+        list->data.list.items = items;
         list->data.list.capacity = new_capacity;
     }
     
@@ -225,111 +261,100 @@ TypeInfo create_array_type(DataType base_type, int size) {
     return type;
 }
 
-/* Free AST recursively */
-void free_ast(ASTNode *node) {
+/* Free every tree built so far in one go */
+void free_ast(void) {
+    arena_free(current_arena());
+}
+
+/* Call visit() on every direct child of node, in source order */
+void ast_visit_children(ASTNode *node, void (*visit)(ASTNode *child, void *ctx), void *ctx) {
     if (!node) return;
     
     switch (node->type) {
-        case NODE_STRING_LITERAL:
-            free(node->data.string_literal.value);
-            break;
-            
-        case NODE_IDENTIFIER:
-            free(node->data.identifier.name);
-            break;
-            
         case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
         case NODE_MATRIX_MUL: case NODE_EQ: case NODE_NE: case NODE_LT: case NODE_GT:
         case NODE_LE: case NODE_GE: case NODE_PATTERN_MATCH: case NODE_AND: case NODE_OR:
         case NODE_ASSIGN: case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
         case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
-            free_ast(node->data.binary_op.left);
-            free_ast(node->data.binary_op.right);
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE:
+        case NODE_INT_EQ: case NODE_INT_NE:
+            visit(node->data.binary_op.left, ctx);
+            visit(node->data.binary_op.right, ctx);
             break;
             
         case NODE_UNARY_MINUS: case NODE_PRE_INC: case NODE_PRE_DEC:
-        case NODE_POST_INC: case NODE_POST_DEC: case NODE_NOT:
-            free_ast(node->data.unary_op.operand);
+        case NODE_POST_INC: case NODE_POST_DEC: case NODE_NOT: case NODE_EXPR_STMT:
+            if (node->data.unary_op.operand) visit(node->data.unary_op.operand, ctx);
             break;
             
         case NODE_RANGE_INCL: case NODE_RANGE_EXCL: case NODE_RANGE_STEP:
-            free_ast(node->data.range.start);
-            free_ast(node->data.range.end);
-            free_ast(node->data.range.step);
+            visit(node->data.range.start, ctx);
+            visit(node->data.range.end, ctx);
+            if (node->data.range.step) visit(node->data.range.step, ctx);
             break;
             
         case NODE_VAR_DECL:
-            free(node->data.var_decl.name);
-            free_ast(node->data.var_decl.initializer);
+            if (node->data.var_decl.initializer) visit(node->data.var_decl.initializer, ctx);
             break;
             
         case NODE_ARRAY_DECL:
-            free(node->data.array_decl.name);
-            free_ast(node->data.array_decl.size);
-            free_ast(node->data.array_decl.initializer);
+            if (node->data.array_decl.size) visit(node->data.array_decl.size, ctx);
+            if (node->data.array_decl.initializer) visit(node->data.array_decl.initializer, ctx);
             break;
             
         case NODE_FUNC_DECL:
-            free(node->data.func_decl.name);
-            free_ast(node->data.func_decl.params);
-            free_ast(node->data.func_decl.body);
-            break;
-            
-        case NODE_PARAM:
-            free(node->data.param.name);
+            if (node->data.func_decl.params) visit(node->data.func_decl.params, ctx);
+            visit(node->data.func_decl.body, ctx);
             break;
             
         case NODE_IF: case NODE_IF_ELSE:
-            free_ast(node->data.if_stmt.condition);
-            free_ast(node->data.if_stmt.then_stmt);
-            free_ast(node->data.if_stmt.else_stmt);
+            visit(node->data.if_stmt.condition, ctx);
+            visit(node->data.if_stmt.then_stmt, ctx);
+            if (node->data.if_stmt.else_stmt) visit(node->data.if_stmt.else_stmt, ctx);
             break;
             
         case NODE_WHILE:
-            free_ast(node->data.while_stmt.condition);
-            free_ast(node->data.while_stmt.body);
+            visit(node->data.while_stmt.condition, ctx);
+            visit(node->data.while_stmt.body, ctx);
             break;
             
         case NODE_FOR:
-            free_ast(node->data.for_stmt.init);
-            free_ast(node->data.for_stmt.condition);
-            free_ast(node->data.for_stmt.increment);
-            free_ast(node->data.for_stmt.body);
+            if (node->data.for_stmt.init) visit(node->data.for_stmt.init, ctx);
+            if (node->data.for_stmt.condition) visit(node->data.for_stmt.condition, ctx);
+            if (node->data.for_stmt.increment) visit(node->data.for_stmt.increment, ctx);
+            visit(node->data.for_stmt.body, ctx);
             break;
             
         case NODE_FOR_RANGE:
-            free(node->data.for_range.iterator);
-            free_ast(node->data.for_range.range);
-            free_ast(node->data.for_range.body);
+            visit(node->data.for_range.range, ctx);
+            visit(node->data.for_range.body, ctx);
             break;
             
         case NODE_RETURN:
-            free_ast(node->data.return_stmt.value);
+            if (node->data.return_stmt.value) visit(node->data.return_stmt.value, ctx);
             break;
             
         case NODE_FUNC_CALL:
-            free_ast(node->data.func_call.func);
-            free_ast(node->data.func_call.args);
+            visit(node->data.func_call.func, ctx);
+            if (node->data.func_call.args) visit(node->data.func_call.args, ctx);
             break;
             
         case NODE_ARRAY_INDEX:
-            free_ast(node->data.array_index.array);
-            free_ast(node->data.array_index.index);
+            visit(node->data.array_index.array, ctx);
+            visit(node->data.array_index.index, ctx);
             break;
             
         case NODE_STMT_LIST: case NODE_DECL_LIST: case NODE_PARAM_LIST:
-        case NODE_ARG_LIST: case NODE_INIT_LIST:
+        case NODE_ARG_LIST: case NODE_INIT_LIST: case NODE_ARRAY_LITERAL:
             for (int i = 0; i < node->data.list.count; i++) {
-                free_ast(node->data.list.items[i]);
+                visit(node->data.list.items[i], ctx);
             }
-            free(node->data.list.items);
             break;
             
         default:
             break;
     }
-    
-    free(node);
 }
 
 /* Print AST for debugging */
@@ -550,6 +575,9 @@ void print_ast(ASTNode *node, int indent) {
         case NODE_MINUS_ASSIGN:
         case NODE_MUL_ASSIGN:
         case NODE_DIV_ASSIGN:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE:
+        case NODE_INT_EQ: case NODE_INT_NE:
             printf("\n");
             print_indent(indent + 1);
             printf("left:\n");
@@ -597,6 +625,16 @@ const char* node_type_to_string(NodeType type) {
         case NODE_LE: return "LE";
         case NODE_GE: return "GE";
         case NODE_PATTERN_MATCH: return "PATTERN_MATCH";
+        case NODE_INT_ADD: return "INT_ADD";
+        case NODE_INT_SUB: return "INT_SUB";
+        case NODE_INT_MUL: return "INT_MUL";
+        case NODE_INT_MOD: return "INT_MOD";
+        case NODE_INT_LT: return "INT_LT";
+        case NODE_INT_GT: return "INT_GT";
+        case NODE_INT_LE: return "INT_LE";
+        case NODE_INT_GE: return "INT_GE";
+        case NODE_INT_EQ: return "INT_EQ";
+        case NODE_INT_NE: return "INT_NE";
         case NODE_AND: return "AND";
         case NODE_OR: return "OR";
         case NODE_NOT: return "NOT";
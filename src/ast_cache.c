@@ -0,0 +1,598 @@
+#include "ast_cache.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AST_CACHE_MAGIC "YAPLAST\0"
+#define AST_CACHE_EXTENSION ".yaplc"
+#define NODE_TYPE_COUNT (NODE_INIT_LIST + 1)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t node_types;    /* NODE_TYPE_COUNT of the writer */
+    uint64_t source_hash;
+    uint64_t source_len;
+    int32_t opt_level;
+    uint32_t reserved;      /* Zero */
+    uint64_t body_len;      /* Bytes of encoded tree after the header */
+    uint64_t body_hash;     /* Catches damage the source hash cannot */
+    uint64_t build_id;      /* Interpreter build that wrote it, see build_id() */
+} AstCacheHeader;
+
+/* 64-bit FNV-1a */
+static uint64_t hash_bytes(const char *data, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* Identity of the running interpreter. Any rebuild may change what the
+ * optimizer or resolver leave in the tree, so a cache is only trusted by
+ * the executable that wrote it: its size, modification time and inode
+ * change whenever it is relinked. Without /proc the compile time of this
+ * file stands in. */
+static uint64_t build_id(void) {
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        uint64_t id[4] = { (uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec,
+                           (uint64_t)st.st_mtim.tv_nsec, (uint64_t)st.st_ino };
+        return hash_bytes((const char*)id, sizeof(id));
+    }
+    const char *stamp = __DATE__ " " __TIME__;
+    return hash_bytes(stamp, strlen(stamp));
+}
+
+char* ast_cache_path(const char *source_path) {
+    size_t len = strlen(source_path);
+    size_t ext = sizeof(".prog") - 1;
+    if (len > ext && strcmp(source_path + len - ext, ".prog") == 0) len -= ext;
+    char *path = (char*)malloc(len + sizeof(AST_CACHE_EXTENSION));
+    if (!path) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(path, source_path, len);
+    memcpy(path + len, AST_CACHE_EXTENSION, sizeof(AST_CACHE_EXTENSION));
+    return path;
+}
+
+static int is_binary(NodeType type) {
+    switch (type) {
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
+        case NODE_MATRIX_MUL: case NODE_EQ: case NODE_NE: case NODE_LT: case NODE_GT:
+        case NODE_LE: case NODE_GE: case NODE_PATTERN_MATCH: case NODE_AND: case NODE_OR:
+        case NODE_ASSIGN: case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE:
+        case NODE_INT_EQ: case NODE_INT_NE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_unary(NodeType type) {
+    switch (type) {
+        case NODE_UNARY_MINUS: case NODE_PRE_INC: case NODE_PRE_DEC:
+        case NODE_POST_INC: case NODE_POST_DEC: case NODE_NOT: case NODE_EXPR_STMT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_list(NodeType type) {
+    switch (type) {
+        case NODE_STMT_LIST: case NODE_DECL_LIST: case NODE_PARAM_LIST:
+        case NODE_ARG_LIST: case NODE_INIT_LIST: case NODE_ARRAY_LITERAL:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* ---------- Writing ---------- */
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t capacity;
+    Atom *atoms;            /* Open-addressed set of names written so far */
+    int *atom_ids;
+    int atom_capacity;
+    int atom_count;
+    int error;
+} Writer;
+
+static void put_bytes(Writer *w, const void *bytes, size_t n) {
+    if (w->len + n > w->capacity) {
+        size_t capacity = w->capacity ? w->capacity : 4096;
+        while (capacity < w->len + n) capacity *= 2;
+        unsigned char *data = (unsigned char*)realloc(w->data, capacity);
+        if (!data) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        w->data = data;
+        w->capacity = capacity;
+    }
+    memcpy(w->data + w->len, bytes, n);
+    w->len += n;
+}
+
+static void put_uint(Writer *w, uint64_t v) {
+    unsigned char buf[10];
+    int n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    put_bytes(w, buf, n);
+}
+
+/* Zigzag, so small negative numbers stay short */
+static void put_int(Writer *w, int64_t v) {
+    put_uint(w, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_string(Writer *w, const char *s) {
+    size_t len = strlen(s);
+    put_uint(w, len);
+    put_bytes(w, s, len);
+}
+
+/* Base type, with bit 3 set for arrays, which add their size */
+static void put_type(Writer *w, TypeInfo type) {
+    put_uint(w, (uint64_t)type.base_type | (type.is_array ? 8 : 0));
+    if (type.is_array) put_int(w, type.array_size);
+}
+
+/* A name is its index among the names written so far; a new one is
+ * followed by its text */
+static void put_atom(Writer *w, Atom atom) {
+    if (!atom) {
+        w->error = 1;
+        return;
+    }
+    if (2 * (w->atom_count + 1) > w->atom_capacity) {
+        int capacity = w->atom_capacity ? w->atom_capacity * 2 : 64;
+        Atom *atoms = (Atom*)calloc(capacity, sizeof(Atom));
+        int *ids = (int*)malloc(capacity * sizeof(int));
+        if (!atoms || !ids) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        for (int i = 0; i < w->atom_capacity; i++) {
+            if (!w->atoms[i]) continue;
+            size_t j = ((uintptr_t)w->atoms[i] >> 4) & (capacity - 1);
+            while (atoms[j]) j = (j + 1) & (capacity - 1);
+            atoms[j] = w->atoms[i];
+            ids[j] = w->atom_ids[i];
+        }
+        free(w->atoms);
+        free(w->atom_ids);
+        w->atoms = atoms;
+        w->atom_ids = ids;
+        w->atom_capacity = capacity;
+    }
+    size_t j = ((uintptr_t)atom >> 4) & (w->atom_capacity - 1);
+    while (w->atoms[j] && w->atoms[j] != atom) j = (j + 1) & (w->atom_capacity - 1);
+    if (w->atoms[j]) {
+        put_uint(w, w->atom_ids[j]);
+        return;
+    }
+    w->atoms[j] = atom;
+    w->atom_ids[j] = w->atom_count;
+    put_uint(w, w->atom_count++);
+    put_string(w, atom);
+}
+
+/* A node is its type plus one (0 for NULL), its line and data type, then
+ * its fields and children in order */
+static void put_node(Writer *w, ASTNode *node) {
+    if (!node) {
+        put_uint(w, 0);
+        return;
+    }
+    NodeType type = node->type;
+    put_uint(w, (uint64_t)type + 1);
+    put_uint(w, (uint64_t)(node->line_number > 0 ? node->line_number : 0));
+    put_type(w, node->data_type);
+
+    if (is_binary(type)) {
+        put_node(w, node->data.binary_op.left);
+        put_node(w, node->data.binary_op.right);
+        return;
+    }
+    if (is_unary(type)) {
+        put_node(w, node->data.unary_op.operand);
+        return;
+    }
+    if (is_list(type)) {
+        put_uint(w, node->data.list.count);
+        for (int i = 0; i < node->data.list.count; i++) put_node(w, node->data.list.items[i]);
+        return;
+    }
+    switch (type) {
+        case NODE_INT_LITERAL:
+            put_int(w, node->data.int_literal.value);
+            break;
+        case NODE_FLOAT_LITERAL:
+            put_bytes(w, &node->data.float_literal.value, sizeof(double));
+            break;
+        case NODE_STRING_LITERAL:
+            put_string(w, node->data.string_literal.value);
+            break;
+        case NODE_BOOL_LITERAL:
+            put_uint(w, node->data.bool_literal.value != 0);
+            break;
+        case NODE_IDENTIFIER:
+            put_atom(w, node->data.identifier.name);
+            break;
+        case NODE_RANGE_INCL: case NODE_RANGE_EXCL: case NODE_RANGE_STEP:
+            put_node(w, node->data.range.start);
+            put_node(w, node->data.range.end);
+            put_node(w, node->data.range.step);
+            break;
+        case NODE_VAR_DECL:
+            put_type(w, node->data.var_decl.type);
+            put_atom(w, node->data.var_decl.name);
+            put_node(w, node->data.var_decl.initializer);
+            break;
+        case NODE_ARRAY_DECL:
+            put_type(w, node->data.array_decl.type);
+            put_atom(w, node->data.array_decl.name);
+            put_node(w, node->data.array_decl.size);
+            put_node(w, node->data.array_decl.initializer);
+            break;
+        case NODE_FUNC_DECL:
+            put_type(w, node->data.func_decl.return_type);
+            put_atom(w, node->data.func_decl.name);
+            put_node(w, node->data.func_decl.params);
+            put_node(w, node->data.func_decl.body);
+            break;
+        case NODE_PARAM:
+            put_type(w, node->data.param.type);
+            put_atom(w, node->data.param.name);
+            break;
+        case NODE_IF: case NODE_IF_ELSE:
+            put_node(w, node->data.if_stmt.condition);
+            put_node(w, node->data.if_stmt.then_stmt);
+            put_node(w, node->data.if_stmt.else_stmt);
+            break;
+        case NODE_WHILE:
+            put_node(w, node->data.while_stmt.condition);
+            put_node(w, node->data.while_stmt.body);
+            break;
+        case NODE_FOR:
+            put_node(w, node->data.for_stmt.init);
+            put_node(w, node->data.for_stmt.condition);
+            put_node(w, node->data.for_stmt.increment);
+            put_node(w, node->data.for_stmt.body);
+            break;
+        case NODE_FOR_RANGE:
+            put_atom(w, node->data.for_range.iterator);
+            put_node(w, node->data.for_range.range);
+            put_node(w, node->data.for_range.body);
+            break;
+        case NODE_RETURN:
+            put_node(w, node->data.return_stmt.value);
+            break;
+        case NODE_BREAK: case NODE_CONTINUE:
+            break;
+        case NODE_FUNC_CALL:
+            put_node(w, node->data.func_call.func);
+            put_node(w, node->data.func_call.args);
+            break;
+        case NODE_ARRAY_INDEX:
+            put_node(w, node->data.array_index.array);
+            put_node(w, node->data.array_index.index);
+            break;
+        default:
+            /* Not produced by the parser; leave such a program uncached */
+            w->error = 1;
+            break;
+    }
+}
+
+void ast_cache_save(const char *cache_path, ASTNode *root, const char *source, size_t len, int opt_level) {
+    Writer w;
+    memset(&w, 0, sizeof(w));
+    put_node(&w, root);
+    free(w.atoms);
+    free(w.atom_ids);
+    if (w.error) {
+        free(w.data);
+        return;
+    }
+
+    AstCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_CACHE_MAGIC, sizeof(header.magic));
+    header.version = AST_CACHE_VERSION;
+    header.node_types = NODE_TYPE_COUNT;
+    header.source_hash = hash_bytes(source, len);
+    header.source_len = len;
+    header.opt_level = opt_level;
+    header.body_len = w.len;
+    header.body_hash = hash_bytes((const char*)w.data, w.len);
+    header.build_id = build_id();
+
+    /* Written aside and renamed, so a concurrent run never sees half a file */
+    size_t path_len = strlen(cache_path);
+    char *tmp = (char*)malloc(path_len + 32);
+    if (!tmp) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    snprintf(tmp, path_len + 32, "%s.%ld.tmp", cache_path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (f) {
+        int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                 fwrite(w.data, 1, w.len, f) == w.len;
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmp, cache_path) != 0) unlink(tmp);
+    }
+    free(tmp);
+    free(w.data);
+}
+
+/* ---------- Reading ---------- */
+
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    Atom *atoms;            /* Names in order of first appearance */
+    int atom_count;
+    int atom_capacity;
+    int error;
+} Reader;
+
+static uint64_t get_uint(Reader *r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (r->p >= r->end) break;
+        unsigned char b = *r->p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->error = 1;
+    return 0;
+}
+
+static int64_t get_int(Reader *r) {
+    uint64_t v = get_uint(r);
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static const char* get_bytes(Reader *r, size_t *len) {
+    *len = get_uint(r);
+    if (r->error || *len > (size_t)(r->end - r->p)) {
+        r->error = 1;
+        return NULL;
+    }
+    const char *bytes = (const char*)r->p;
+    r->p += *len;
+    return bytes;
+}
+
+static TypeInfo get_type(Reader *r) {
+    TypeInfo type;
+    uint64_t bits = get_uint(r);
+    if ((bits & 7) > TYPE_UNKNOWN || bits > 15) r->error = 1;
+    type.base_type = r->error ? TYPE_UNKNOWN : (DataType)(bits & 7);
+    type.is_array = (bits & 8) != 0;
+    type.array_size = type.is_array ? (int)get_int(r) : 0;
+    return type;
+}
+
+static Atom get_atom(Reader *r) {
+    uint64_t id = get_uint(r);
+    if (r->error) return NULL;
+    if (id < (uint64_t)r->atom_count) return r->atoms[id];
+    if (id != (uint64_t)r->atom_count) {
+        r->error = 1;
+        return NULL;
+    }
+    size_t len;
+    const char *name = get_bytes(r, &len);
+    if (!name) return NULL;
+    if (r->atom_count == r->atom_capacity) {
+        r->atom_capacity = r->atom_capacity ? r->atom_capacity * 2 : 64;
+        r->atoms = (Atom*)realloc(r->atoms, r->atom_capacity * sizeof(Atom));
+        if (!r->atoms) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    return r->atoms[r->atom_count++] = atom_intern_n(name, len);
+}
+
+static ASTNode* get_node(Reader *r) {
+    uint64_t tag = get_uint(r);
+    if (r->error || tag == 0) return NULL;
+    if (tag > NODE_TYPE_COUNT) {
+        r->error = 1;
+        return NULL;
+    }
+    NodeType type = (NodeType)(tag - 1);
+    int line = (int)get_uint(r);
+    TypeInfo data_type = get_type(r);
+    ASTNode *node = NULL;
+
+    if (is_binary(type)) {
+        ASTNode *left = get_node(r);
+        ASTNode *right = get_node(r);
+        node = create_binary_op(type, left, right, line);
+    } else if (is_unary(type)) {
+        node = create_unary_op(type, get_node(r), line);
+    } else if (is_list(type)) {
+        node = create_list(type, line);
+        uint64_t count = get_uint(r);
+        for (uint64_t i = 0; i < count && !r->error; i++) {
+            ASTNode *item = get_node(r);
+            if (!item) r->error = 1;
+            list_append(node, item);
+        }
+    } else {
+        switch (type) {
+            case NODE_INT_LITERAL:
+                node = create_int_literal((int)get_int(r), line);
+                break;
+            case NODE_FLOAT_LITERAL: {
+                double value = 0;
+                if ((size_t)(r->end - r->p) < sizeof(double)) {
+                    r->error = 1;
+                } else {
+                    memcpy(&value, r->p, sizeof(double));
+                    r->p += sizeof(double);
+                }
+                node = create_float_literal(value, line);
+                break;
+            }
+            case NODE_STRING_LITERAL: {
+                size_t len;
+                const char *text = get_bytes(r, &len);
+                node = create_string_literal(text ? ast_strndup(text, len) : NULL, line);
+                break;
+            }
+            case NODE_BOOL_LITERAL:
+                node = create_bool_literal(get_uint(r) != 0, line);
+                break;
+            case NODE_IDENTIFIER:
+                node = create_identifier(get_atom(r), line);
+                break;
+            case NODE_RANGE_INCL: case NODE_RANGE_EXCL: case NODE_RANGE_STEP: {
+                ASTNode *start = get_node(r);
+                ASTNode *end = get_node(r);
+                ASTNode *step = get_node(r);
+                node = create_range(type, start, end, step, line);
+                break;
+            }
+            case NODE_VAR_DECL: {
+                TypeInfo var_type = get_type(r);
+                Atom name = get_atom(r);
+                node = create_var_decl(var_type, name, get_node(r), line);
+                break;
+            }
+            case NODE_ARRAY_DECL: {
+                TypeInfo array_type = get_type(r);
+                Atom name = get_atom(r);
+                ASTNode *size = get_node(r);
+                node = create_array_decl(array_type, name, size, get_node(r), line);
+                break;
+            }
+            case NODE_FUNC_DECL: {
+                TypeInfo return_type = get_type(r);
+                Atom name = get_atom(r);
+                ASTNode *params = get_node(r);
+                node = create_func_decl(return_type, name, params, get_node(r), line);
+                break;
+            }
+            case NODE_PARAM: {
+                TypeInfo param_type = get_type(r);
+                node = create_param(param_type, get_atom(r), line);
+                break;
+            }
+            case NODE_IF: case NODE_IF_ELSE: {
+                ASTNode *condition = get_node(r);
+                ASTNode *then_stmt = get_node(r);
+                node = create_if_stmt(condition, then_stmt, get_node(r), line);
+                node->type = type;
+                break;
+            }
+            case NODE_WHILE: {
+                ASTNode *condition = get_node(r);
+                node = create_while_stmt(condition, get_node(r), line);
+                break;
+            }
+            case NODE_FOR: {
+                ASTNode *init = get_node(r);
+                ASTNode *condition = get_node(r);
+                ASTNode *increment = get_node(r);
+                node = create_for_stmt(init, condition, increment, get_node(r), line);
+                break;
+            }
+            case NODE_FOR_RANGE: {
+                Atom iterator = get_atom(r);
+                ASTNode *range = get_node(r);
+                node = create_for_range(iterator, range, get_node(r), line);
+                break;
+            }
+            case NODE_RETURN:
+                node = create_return_stmt(get_node(r), line);
+                break;
+            case NODE_BREAK:
+                node = create_break_stmt(line);
+                break;
+            case NODE_CONTINUE:
+                node = create_continue_stmt(line);
+                break;
+            case NODE_FUNC_CALL: {
+                ASTNode *func = get_node(r);
+                node = create_func_call(func, get_node(r), line);
+                break;
+            }
+            case NODE_ARRAY_INDEX: {
+                ASTNode *array = get_node(r);
+                node = create_array_index(array, get_node(r), line);
+                break;
+            }
+            default:
+                r->error = 1;
+                return NULL;
+        }
+    }
+    node->data_type = data_type;
+    return node;
+}
+
+ASTNode* ast_cache_load(const char *cache_path, const char *source, size_t len, int opt_level) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    AstCacheHeader header;
+    struct stat st;
+    unsigned char *body = NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(header) ||
+        read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, AST_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != AST_CACHE_VERSION || header.node_types != NODE_TYPE_COUNT ||
+        header.opt_level != opt_level || header.build_id != build_id() ||
+        header.source_len != len ||
+        header.body_len != (uint64_t)st.st_size - sizeof(header) ||
+        header.source_hash != hash_bytes(source, len) ||
+        !(body = (unsigned char*)malloc(header.body_len + 1)) ||
+        read(fd, body, header.body_len) != (ssize_t)header.body_len ||
+        header.body_hash != hash_bytes((const char*)body, header.body_len)) {
+        free(body);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    Reader r;
+    memset(&r, 0, sizeof(r));
+    r.p = body;
+    r.end = body + header.body_len;
+    ASTNode *root = get_node(&r);
+    if (r.p != r.end) r.error = 1;
+    free(r.atoms);
+    free(body);
+    if (r.error || !root) {
+        /* Drop what was built; the caller parses into a fresh arena */
+        free_ast();
+        return NULL;
+    }
+    return root;
+}
@@ -0,0 +1,115 @@
+#include "atom.h"
+#include "arena.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Open-addressing hash set of interned strings */
+typedef struct {
+    char **slots;
+    size_t capacity;   /* Always a power of two */
+    size_t count;
+} AtomTable;
+
+static AtomTable table;
+
+/* Storage for the names themselves */
+static Arena names = { NULL, 16 * 1024 };
+
+/* Atoms are shared by every thread; interning happens while parsing,
+ * never while a program runs, so one lock is enough */
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+Atom atom_main;
+Atom atom_print;
+Atom atom_printm;
+Atom atom_read;
+
+/* FNV-1a */
+static uint32_t hash_name(const char *str, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)str[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void *atom_alloc(size_t size) {
+    void *p = calloc(1, size);
+    if (!p) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void table_grow(void) {
+    size_t old_capacity = table.capacity;
+    char **old_slots = table.slots;
+
+    table.capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+    table.slots = (char**)atom_alloc(table.capacity * sizeof(char*));
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        char *name = old_slots[i];
+        if (!name) continue;
+        size_t j = hash_name(name, strlen(name)) & (table.capacity - 1);
+        while (table.slots[j]) j = (j + 1) & (table.capacity - 1);
+        table.slots[j] = name;
+    }
+    free(old_slots);
+}
+
+static Atom intern_locked(const char *str, size_t len);
+
+static void table_init(void) {
+    table_grow();
+    atom_main = intern_locked("main", 4);
+    atom_print = intern_locked("print", 5);
+    atom_printm = intern_locked("printm", 6);
+    atom_read = intern_locked("read", 4);
+}
+
+static Atom intern_locked(const char *str, size_t len) {
+    if (!table.slots) table_init();
+
+    uint32_t h = hash_name(str, len);
+    size_t mask = table.capacity - 1;
+    size_t i = h & mask;
+    while (table.slots[i]) {
+        char *name = table.slots[i];
+        if (strncmp(name, str, len) == 0 && name[len] == '\0') return name;
+        i = (i + 1) & mask;
+    }
+
+    char *name = arena_strndup(&names, str, len);
+    table.slots[i] = name;
+    table.count++;
+
+    /* Keep the load factor under 3/4 */
+    if (table.count * 4 >= table.capacity * 3) table_grow();
+    return name;
+}
+
+Atom atom_intern_n(const char *str, size_t len) {
+    pthread_mutex_lock(&table_lock);
+    Atom atom = intern_locked(str, len);
+    pthread_mutex_unlock(&table_lock);
+    return atom;
+}
+
+Atom atom_intern(const char *str) {
+    return atom_intern_n(str, strlen(str));
+}
+
+void atom_table_free(void) {
+    arena_free(&names);
+    free(table.slots);
+    table.slots = NULL;
+    table.capacity = 0;
+    table.count = 0;
+    atom_main = atom_print = atom_printm = atom_read = NULL;
+}
@@ -0,0 +1,257 @@
+#include "builtins.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct {
+    Builtin **entries;      /* Individually allocated, so pointers stay valid */
+    int count;
+    int capacity;
+    void **libraries;       /* Loaded extensions */
+    int library_count;
+} registry = { NULL, 0, 0, NULL, 0 };
+
+/* Guards registration and lookup, which happen while loading extensions
+ * and resolving programs. Calls go through builtin_at() unlocked, so load
+ * extensions before threads start running programs. */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *type_names[] = { "void", "int", "float", "bool", "matrix" };
+
+static Builtin* add_builtin(const char *name, BuiltinKind kind, int arity, YaplType ret) {
+    if (registry.count >= registry.capacity) {
+        registry.capacity = registry.capacity == 0 ? 16 : registry.capacity * 2;
+        registry.entries = (Builtin**)realloc(registry.entries, registry.capacity * sizeof(Builtin*));
+        if (!registry.entries) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    Builtin *builtin = (Builtin*)calloc(1, sizeof(Builtin));
+    if (!builtin) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    builtin->name = atom_intern(name);
+    builtin->kind = kind;
+    builtin->arity = arity;
+    builtin->ret = ret;
+    builtin->index = registry.count;
+    registry.entries[registry.count++] = builtin;
+    return builtin;
+}
+
+static void register_core(void) {
+    if (registry.count > 0) return;
+    add_builtin("print", BUILTIN_PRINT, -1, YAPL_VOID);
+    add_builtin("printm", BUILTIN_PRINTM, -1, YAPL_VOID);
+    add_builtin("read", BUILTIN_READ, -1, YAPL_VOID);
+    add_builtin("readall", BUILTIN_READALL, -1, YAPL_VOID);
+    add_builtin("readm", BUILTIN_READM, -1, YAPL_MATRIX);
+    add_builtin("loadm", BUILTIN_LOADM, 1, YAPL_MATRIX);
+    add_builtin("savem", BUILTIN_SAVEM, 2, YAPL_VOID);
+}
+
+static const Builtin* lookup_locked(Atom name) {
+    register_core();
+    for (int i = 0; i < registry.count; i++) {
+        if (registry.entries[i]->name == name) return registry.entries[i];
+    }
+    return NULL;
+}
+
+const Builtin* builtin_lookup(Atom name) {
+    pthread_mutex_lock(&registry_lock);
+    const Builtin *builtin = lookup_locked(name);
+    pthread_mutex_unlock(&registry_lock);
+    return builtin;
+}
+
+void builtins_warn_shadowed(ASTNode *root) {
+    if (!root || root->type != NODE_DECL_LIST) return;
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL || !builtin_lookup(decl->data.func_decl.name)) continue;
+        fprintf(stderr, "Warning: function '%s' at line %d has the name of a builtin; calls of '%s' reach the builtin\n",
+                decl->data.func_decl.name, decl->line_number, decl->data.func_decl.name);
+    }
+}
+
+const Builtin* builtin_at(int index) {
+    return registry.entries[index];
+}
+
+/* read() yields whatever the input line holds */
+DataType builtin_result_type(const Builtin *builtin) {
+    if (builtin->kind == BUILTIN_READ) return TYPE_UNKNOWN;
+    if (builtin->kind == BUILTIN_READALL) return TYPE_STRING;
+    switch (builtin->ret) {
+        case YAPL_INT:    return TYPE_INT;
+        case YAPL_FLOAT:  return TYPE_FLOAT;
+        case YAPL_BOOL:   return TYPE_BOOL;
+        case YAPL_MATRIX: return TYPE_MATRIX;
+        default:          return TYPE_VOID;
+    }
+}
+
+/* ---------- Host side of the extension ABI ---------- */
+
+static int host_define(const char *name, YaplNativeFn fn, int arity, const YaplType *params, YaplType ret) {
+    if (!name || !fn || arity < 0 || arity > YAPL_NATIVE_MAX_ARGS || ret < YAPL_VOID || ret > YAPL_MATRIX) {
+        return -1;
+    }
+    for (int i = 0; i < arity; i++) {
+        if (params[i] < YAPL_INT || params[i] > YAPL_MATRIX) return -1;
+    }
+    if (lookup_locked(atom_intern(name))) return -1;
+
+    Builtin *builtin = add_builtin(name, BUILTIN_NATIVE, arity, ret);
+    if (arity > 0) memcpy(builtin->params, params, arity * sizeof(YaplType));
+    builtin->fn = fn;
+    return 0;
+}
+
+static YaplMatrix matrix_view(Matrix *mat) {
+    YaplMatrix view;
+    view.rows = mat->rows;
+    view.cols = mat->cols;
+    view.stride = mat->stride;
+    view.data = mat->data;
+    view.handle = mat;
+    return view;
+}
+
+static YaplMatrix host_new_matrix(int rows, int cols) {
+    if (rows < 0 || cols < 0) {
+        fprintf(stderr, "Runtime error: Invalid matrix size %d x %d\n", rows, cols);
+        runtime_abort();
+    }
+    return matrix_view(create_matrix(rows, cols));
+}
+
+static void host_fail(const char *message) {
+    fprintf(stderr, "Runtime error: %s\n", message);
+    runtime_abort();
+}
+
+static const YaplHost host = {
+    YAPL_NATIVE_ABI_VERSION,
+    host_define,
+    host_new_matrix,
+    host_fail
+};
+
+static int load_locked(const char *path) {
+    register_core();
+
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "Error: Cannot load extension: %s\n", dlerror());
+        return -1;
+    }
+    YaplExtensionInit init = (YaplExtensionInit)dlsym(library, YAPL_EXTENSION_INIT);
+    if (!init) {
+        fprintf(stderr, "Error: %s does not export %s\n", path, YAPL_EXTENSION_INIT);
+        dlclose(library);
+        return -1;
+    }
+    if (init(&host) != 0) {
+        fprintf(stderr, "Error: Extension %s failed to initialize\n", path);
+        dlclose(library);
+        return -1;
+    }
+
+    registry.libraries = (void**)realloc(registry.libraries, (registry.library_count + 1) * sizeof(void*));
+    if (!registry.libraries) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    registry.libraries[registry.library_count++] = library;
+    return 0;
+}
+
+int builtins_load(const char *path) {
+    pthread_mutex_lock(&registry_lock);
+    int result = load_locked(path);
+    pthread_mutex_unlock(&registry_lock);
+    return result;
+}
+
+/* ---------- Calls ---------- */
+
+void builtin_check_arity(const Builtin *builtin, int nargs) {
+    if (builtin->arity >= 0 && nargs != builtin->arity) {
+        fprintf(stderr, "Runtime error: %s() expects %d argument%s, got %d\n",
+                builtin->name, builtin->arity, builtin->arity == 1 ? "" : "s", nargs);
+        runtime_abort();
+    }
+}
+
+Value builtin_call_native(const Builtin *builtin, Value *args, int nargs) {
+    builtin_check_arity(builtin, nargs);
+
+    YaplValue in[YAPL_NATIVE_MAX_ARGS];
+    for (int i = 0; i < nargs; i++) {
+        YaplType want = builtin->params[i];
+        Value *arg = &args[i];
+        in[i].type = want;
+        if (want == YAPL_INT && arg->type == VAL_INT) {
+            in[i].as.i = arg->data.int_val;
+        } else if (want == YAPL_FLOAT && (arg->type == VAL_FLOAT || arg->type == VAL_INT)) {
+            in[i].as.f = arg->type == VAL_INT ? arg->data.int_val : arg->data.float_val;
+        } else if (want == YAPL_BOOL && arg->type == VAL_BOOL) {
+            in[i].as.b = arg->data.bool_val;
+        } else if (want == YAPL_MATRIX && arg->type == VAL_MATRIX) {
+            in[i].as.m = matrix_view(arg->data.matrix_val);
+        } else {
+            fprintf(stderr, "Runtime error: %s() argument %d must be %s\n",
+                    builtin->name, i + 1, type_names[want]);
+            runtime_abort();
+        }
+    }
+
+    YaplValue out = builtin->fn(&host, in, nargs);
+    if (out.type != builtin->ret) {
+        fprintf(stderr, "Runtime error: %s() returned %s instead of %s\n", builtin->name,
+                out.type >= YAPL_VOID && out.type <= YAPL_MATRIX ? type_names[out.type] : "an invalid value",
+                type_names[builtin->ret]);
+        runtime_abort();
+    }
+
+    switch (out.type) {
+        case YAPL_INT:   return create_int_value(out.as.i);
+        case YAPL_FLOAT: return create_float_value(out.as.f);
+        case YAPL_BOOL:  return create_bool_value(out.as.b);
+        case YAPL_MATRIX: {
+            Value result;
+            result.type = VAL_MATRIX;
+            result.data.matrix_val = (Matrix*)out.as.m.handle;
+            /* A returned argument gains a reference; a new matrix is handed over */
+            for (int i = 0; i < nargs; i++) {
+                if (in[i].type == YAPL_MATRIX && in[i].as.m.handle == out.as.m.handle) {
+                    retain_matrix(result.data.matrix_val);
+                    break;
+                }
+            }
+            return result;
+        }
+        default:
+            return create_void_value();
+    }
+}
+
+void builtins_free(void) {
+    for (int i = 0; i < registry.count; i++) {
+        free(registry.entries[i]);
+    }
+    for (int i = 0; i < registry.library_count; i++) {
+        dlclose(registry.libraries[i]);
+    }
+    free(registry.entries);
+    free(registry.libraries);
+    registry.entries = NULL;
+    registry.libraries = NULL;
+    registry.count = registry.capacity = registry.library_count = 0;
+}
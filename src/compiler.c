@@ -0,0 +1,930 @@
+#include "bytecode.h"
+#include "resolver.h"
+#include "builtins.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Function names, indexed like program->functions */
+typedef struct {
+    Atom *names;
+    ASTNode **decls;
+    int count;
+    int capacity;
+} NameList;
+
+typedef struct {
+    BytecodeProgram *program;
+    BytecodeFunction *fn;
+    NameList *funcs;      /* Index into program->functions */
+    int *min_args;        /* Fewest arguments a call passes, per function */
+    int is_script;
+    int free_reg;
+    unsigned char *assigned;  /* Local registers set on every path to here */
+    int *assigned_log;        /* Registers in the order they were marked */
+    int assigned_count;
+    int assigned_capacity;
+    const char *error;
+    int error_line;
+} Compiler;
+
+static int compile_expr(Compiler *c, ASTNode *node, int dst);
+static void compile_stmt(Compiler *c, ASTNode *node);
+
+/* Name lists */
+static int name_index(NameList *list, Atom name) {
+    for (int i = 0; i < list->count; i++) {
+        if (list->names[i] == name) return i;
+    }
+    return -1;
+}
+
+static int name_push(NameList *list, Atom name, ASTNode *decl) {
+    if (list->count >= list->capacity) {
+        list->capacity = list->capacity == 0 ? 16 : list->capacity * 2;
+        list->names = (Atom*)realloc(list->names, list->capacity * sizeof(Atom));
+        list->decls = (ASTNode**)realloc(list->decls, list->capacity * sizeof(ASTNode*));
+    }
+    list->names[list->count] = name;
+    list->decls[list->count] = decl;
+    return list->count++;
+}
+
+static void free_name_list(NameList *list) {
+    free(list->names);
+    free(list->decls);
+}
+
+/* Code emission */
+static void compile_error(Compiler *c, ASTNode *node, const char *what) {
+    if (!c->error) {
+        c->error = what;
+        c->error_line = node ? node->line_number : 0;
+    }
+}
+
+static int emit(Compiler *c, OpCode op, int x, int a, int b, int cc) {
+    BytecodeFunction *fn = c->fn;
+    if (fn->code_count >= fn->code_capacity) {
+        fn->code_capacity = fn->code_capacity == 0 ? 64 : fn->code_capacity * 2;
+        fn->code = (Instr*)realloc(fn->code, fn->code_capacity * sizeof(Instr));
+        if (!fn->code) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    Instr *ins = &fn->code[fn->code_count];
+    ins->op = (uint8_t)op;
+    ins->x = (uint8_t)x;
+    ins->a = (uint16_t)a;
+    ins->b = (uint16_t)b;
+    ins->c = (uint16_t)cc;
+    return fn->code_count++;
+}
+
+static int emit_jump(Compiler *c, OpCode op, int a) {
+    return emit(c, op, 0, a, 0, 0);
+}
+
+static void patch_jump(Compiler *c, int at, int target) {
+    c->fn->code[at].b = (uint16_t)((uint32_t)target >> 16);
+    c->fn->code[at].c = (uint16_t)(target & 0xffff);
+}
+
+static int here(Compiler *c) {
+    return c->fn->code_count;
+}
+
+static int add_constant(Compiler *c, Value val) {
+    BytecodeFunction *fn = c->fn;
+
+    /* Reuse an identical scalar or string constant */
+    for (int i = 0; i < fn->const_count; i++) {
+        Value *k = &fn->constants[i];
+        if (k->type != val.type) continue;
+        if ((val.type == VAL_INT && k->data.int_val == val.data.int_val) ||
+            (val.type == VAL_BOOL && k->data.bool_val == val.data.bool_val) ||
+            (val.type == VAL_FLOAT && k->data.float_val == val.data.float_val) ||
+            (val.type == VAL_STRING && strcmp(k->data.string_val, val.data.string_val) == 0)) {
+            free_value(&val);
+            return i;
+        }
+    }
+
+    if (fn->const_count >= MAX_CONSTS) {
+        compile_error(c, NULL, "too many constants");
+        free_value(&val);
+        return 0;
+    }
+    if (fn->const_count >= fn->const_capacity) {
+        fn->const_capacity = fn->const_capacity == 0 ? 16 : fn->const_capacity * 2;
+        fn->constants = (Value*)realloc(fn->constants, fn->const_capacity * sizeof(Value));
+    }
+    fn->constants[fn->const_count] = val;
+    return fn->const_count++;
+}
+
+static int add_pattern(Compiler *c, const char *pattern) {
+    BytecodeFunction *fn = c->fn;
+    CompiledRegex *re = regex_pin(pattern);
+
+    for (int i = 0; i < fn->pattern_count; i++) {
+        if (fn->patterns[i] == re) return i;
+    }
+    if (fn->pattern_count > UINT16_MAX) {
+        compile_error(c, NULL, "too many patterns");
+        return 0;
+    }
+    if (fn->pattern_count >= fn->pattern_capacity) {
+        fn->pattern_capacity = fn->pattern_capacity == 0 ? 4 : fn->pattern_capacity * 2;
+        fn->patterns = (CompiledRegex**)realloc(fn->patterns,
+                                                fn->pattern_capacity * sizeof(CompiledRegex*));
+    }
+    fn->patterns[fn->pattern_count] = re;
+    return fn->pattern_count++;
+}
+
+static int alloc_reg(Compiler *c) {
+    int reg = c->free_reg++;
+    if (c->free_reg > c->fn->num_regs) {
+        c->fn->num_regs = c->free_reg;
+    }
+    if (reg >= MAX_REGS) {
+        compile_error(c, NULL, "too many registers");
+        return 0;
+    }
+    return reg;
+}
+
+/* Put the result of an instruction sequence into dst if one was requested */
+static int move_to(Compiler *c, int reg, int dst) {
+    if (dst >= 0 && dst != reg) {
+        emit(c, OP_MOVE, 0, dst, reg, 0);
+        return dst;
+    }
+    return reg;
+}
+
+static Value literal_value(ASTNode *node) {
+    switch (node->type) {
+        case NODE_INT_LITERAL: return create_int_value(node->data.int_literal.value);
+        case NODE_FLOAT_LITERAL: return create_float_value(node->data.float_literal.value);
+        case NODE_BOOL_LITERAL: return create_bool_value(node->data.bool_literal.value);
+        default: return create_string_value(node->data.string_literal.value);
+    }
+}
+
+static int is_literal(ASTNode *node) {
+    return node->type == NODE_INT_LITERAL || node->type == NODE_FLOAT_LITERAL ||
+           node->type == NODE_BOOL_LITERAL || node->type == NODE_STRING_LITERAL;
+}
+
+/* Definite assignment: a local register is marked once every path to the
+ * current instruction has set it, so reading it needs no check. Marks made
+ * in code that may not run (a branch, a loop body, the right operand of
+ * && and ||) are forgotten when that code ends. */
+static void begin_function(Compiler *c, BytecodeFunction *fn, int num_vars) {
+    c->fn = fn;
+    fn->var_names = (Atom*)calloc(num_vars > 0 ? num_vars : 1, sizeof(Atom));
+    c->assigned = (unsigned char*)realloc(c->assigned, num_vars > 0 ? num_vars : 1);
+    memset(c->assigned, 0, num_vars);
+    c->assigned_count = 0;
+}
+
+static void mark_assigned(Compiler *c, int reg) {
+    if (c->assigned[reg]) return;
+    if (c->assigned_count >= c->assigned_capacity) {
+        c->assigned_capacity = c->assigned_capacity == 0 ? 64 : c->assigned_capacity * 2;
+        c->assigned_log = (int*)realloc(c->assigned_log, c->assigned_capacity * sizeof(int));
+    }
+    c->assigned[reg] = 1;
+    c->assigned_log[c->assigned_count++] = reg;
+}
+
+/* Drop the marks made since assigned_count was mark */
+static void forget_assigned(Compiler *c, int mark) {
+    while (c->assigned_count > mark) {
+        c->assigned[c->assigned_log[--c->assigned_count]] = 0;
+    }
+}
+
+/* Registers of a variable in the function being compiled. Frame slots
+ * are registers of the function's window; global slots are registers of
+ * the script window, which is the current window for the script itself. */
+typedef struct {
+    int local;   /* Register in the current window, or -1 */
+    int global;  /* Script register to fall back to, or -1 */
+} VarRegs;
+
+static VarRegs var_regs(Compiler *c, VarRef ref) {
+    VarRegs regs;
+    if (c->is_script) {
+        regs.local = ref.global_slot;
+        regs.global = -1;
+    } else {
+        regs.local = ref.slot;
+        regs.global = ref.global_slot;
+    }
+    return regs;
+}
+
+/* Register an assignment writes to */
+static VarRegs target_regs(Compiler *c, ASTNode *node, VarRef ref) {
+    VarRegs regs = var_regs(c, ref);
+    if (regs.local < 0) {
+        compile_error(c, node, "assignment to a global from a function");
+        regs.local = 0;
+    }
+    return regs;
+}
+
+/* Remember which variable the registers hold, for the VM's errors */
+static void name_regs(Compiler *c, Atom name, VarRegs ref) {
+    if (ref.local >= 0) c->fn->var_names[ref.local] = name;
+    if (ref.global >= 0) c->program->script.var_names[ref.global] = name;
+}
+
+/* A local that shadows a global starts out unset and reads fall through
+ * to the global (as get_symbol does); reading any other unset local is an
+ * error. Make the local hold the current value before it is updated in
+ * place. */
+static void materialize_local(Compiler *c, Atom name, VarRegs ref) {
+    if (c->assigned[ref.local]) return;
+    name_regs(c, name, ref);
+    if (ref.global >= 0) {
+        emit(c, OP_LOADLG, 0, ref.local, ref.local, ref.global);
+    } else {
+        emit(c, OP_CHECKDEF, 0, ref.local, 0, 0);
+    }
+    mark_assigned(c, ref.local);
+}
+
+/* Operand that may come straight from the constant pool or a local */
+static int compile_rk(Compiler *c, ASTNode *node) {
+    if (is_literal(node)) {
+        return RK_CONST | add_constant(c, literal_value(node));
+    }
+    return compile_expr(c, node, -1);
+}
+
+static int binary_opcode(NodeType type) {
+    switch (type) {
+        case NODE_ADD: case NODE_INT_ADD: case NODE_PLUS_ASSIGN: return OP_ADD;
+        case NODE_SUB: case NODE_INT_SUB: case NODE_MINUS_ASSIGN: return OP_SUB;
+        case NODE_MUL: case NODE_INT_MUL: case NODE_MUL_ASSIGN: return OP_MUL;
+        case NODE_DIV: case NODE_DIV_ASSIGN: return OP_DIV;
+        case NODE_MOD: case NODE_INT_MOD: return OP_MOD;
+        case NODE_MATRIX_MUL: return OP_MATMUL;
+        case NODE_LT: case NODE_INT_LT: return OP_LT;
+        case NODE_GT: case NODE_INT_GT: return OP_GT;
+        case NODE_LE: case NODE_INT_LE: return OP_LE;
+        case NODE_GE: case NODE_INT_GE: return OP_GE;
+        case NODE_EQ: case NODE_INT_EQ: return OP_EQ;
+        case NODE_NE: case NODE_INT_NE: return OP_NE;
+        case NODE_PATTERN_MATCH: return OP_MATCH;
+        default: return -1;
+    }
+}
+
+static int compile_matrix_literal(Compiler *c, ASTNode *node, int dst) {
+    int rows = node->data.list.count;
+    int cols = 0;
+    int nested = rows > 0 && node->data.list.items[0]->type == NODE_ARRAY_LITERAL;
+
+    if (nested) {
+        cols = node->data.list.items[0]->data.list.count;
+        for (int i = 0; i < rows; i++) {
+            ASTNode *row = node->data.list.items[i];
+            if (row->type != NODE_ARRAY_LITERAL || row->data.list.count != cols) {
+                compile_error(c, node, "irregular matrix literal");
+                return 0;
+            }
+        }
+    } else if (rows > 0) {
+        cols = rows;
+        rows = 1;
+    }
+
+    /* Gather element nodes in row-major order */
+    int all_literal = 1;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            ASTNode *elem = nested ? node->data.list.items[i]->data.list.items[j]
+                                   : node->data.list.items[j];
+            if (!is_literal(elem)) all_literal = 0;
+        }
+    }
+
+    int target = dst >= 0 ? dst : alloc_reg(c);
+
+    if (all_literal) {
+        Value mat_val = create_matrix_value(rows, cols);
+        Matrix *mat = mat_val.data.matrix_val;
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                ASTNode *elem = nested ? node->data.list.items[i]->data.list.items[j]
+                                       : node->data.list.items[j];
+                if (elem->type == NODE_INT_LITERAL) {
+                    MATRIX_AT(mat, i, j) = elem->data.int_literal.value;
+                } else if (elem->type == NODE_FLOAT_LITERAL) {
+                    MATRIX_AT(mat, i, j) = elem->data.float_literal.value;
+                }
+            }
+        }
+        emit(c, OP_LOADK, 0, target, add_constant(c, mat_val), 0);
+        return target;
+    }
+
+    if (rows > 0xffff || cols > 0xffff) {
+        compile_error(c, node, "matrix literal too large");
+        return target;
+    }
+
+    int save = c->free_reg;
+    int first = c->free_reg;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            ASTNode *elem = nested ? node->data.list.items[i]->data.list.items[j]
+                                   : node->data.list.items[j];
+            compile_expr(c, elem, alloc_reg(c));
+        }
+    }
+    emit(c, OP_NEWMAT, 0, first, rows, cols);
+    c->free_reg = save;
+    return move_to(c, first, target);
+}
+
+static int is_user_call(ASTNode *node) {
+    if (!node || node->type != NODE_FUNC_CALL) return 0;
+    ASTNode *func = node->data.func_call.func;
+    return func->type == NODE_IDENTIFIER && !node->data.func_call.builtin;
+}
+
+/* A tail call reuses the caller's frame, so the callee's result is
+ * returned directly and nothing after the call runs */
+static int compile_call(Compiler *c, ASTNode *node, int dst, int want_result, int tail) {
+    if (node->data.func_call.func->type != NODE_IDENTIFIER) {
+        compile_error(c, node, "call of a non-identifier");
+        return 0;
+    }
+
+    Atom func_name = node->data.func_call.func->data.identifier.name;
+    ASTNode *args = node->data.func_call.args;
+    int arg_count = args ? args->data.list.count : 0;
+    int save = c->free_reg;
+
+    /* Built-ins */
+    const Builtin *builtin = node->data.func_call.builtin;
+    if (builtin && (builtin->kind == BUILTIN_PRINT || builtin->kind == BUILTIN_PRINTM)) {
+        int is_print = builtin->kind == BUILTIN_PRINT;
+        for (int i = 0; i < arg_count; i++) {
+            int reg = compile_expr(c, args->data.list.items[i], -1);
+            if (is_print) {
+                emit(c, OP_PRINT, i < arg_count - 1, reg, 0, 0);
+            } else {
+                emit(c, OP_PRINTM, 0, reg, 0, 0);
+            }
+            c->free_reg = save;
+        }
+        if (is_print) emit(c, OP_PRINTNL, 0, 0, 0, 0);
+        if (!want_result) return 0;
+        int target = dst >= 0 ? dst : alloc_reg(c);
+        emit(c, OP_LOADNIL, 0, target, 0, 0);
+        return target;
+    }
+    if (builtin && builtin->kind == BUILTIN_READ) {
+        int target = dst >= 0 ? dst : alloc_reg(c);
+        emit(c, OP_READ, 0, target, 0, 0);
+        return target;
+    }
+    if (builtin && (builtin->kind == BUILTIN_READALL || builtin->kind == BUILTIN_READM)) {
+        if (arg_count > 1) {
+            compile_error(c, node, "too many arguments to a builtin");
+            return 0;
+        }
+        int path = arg_count == 1 ? compile_expr(c, args->data.list.items[0], -1) : 0;
+        c->free_reg = save;
+        int target = dst >= 0 ? dst : alloc_reg(c);
+        emit(c, builtin->kind == BUILTIN_READM ? OP_READM : OP_READALL, arg_count, target, path, 0);
+        return target;
+    }
+    if (builtin && (builtin->kind == BUILTIN_LOADM || builtin->kind == BUILTIN_SAVEM)) {
+        if (arg_count != builtin->arity) {
+            compile_error(c, node, "wrong number of arguments to a builtin");
+            return 0;
+        }
+        int path = compile_expr(c, args->data.list.items[0], -1);
+        if (builtin->kind == BUILTIN_SAVEM) {
+            int mat = compile_expr(c, args->data.list.items[1], -1);
+            emit(c, OP_SAVEM, 0, path, mat, 0);
+            c->free_reg = save;
+            if (!want_result) return 0;
+            int target = dst >= 0 ? dst : alloc_reg(c);
+            emit(c, OP_LOADNIL, 0, target, 0, 0);
+            return target;
+        }
+        c->free_reg = save;
+        int target = dst >= 0 ? dst : alloc_reg(c);
+        emit(c, OP_LOADM, 0, target, path, 0);
+        return target;
+    }
+    if (builtin) {
+        /* Arguments go to consecutive registers; the VM checks them */
+        int base = alloc_reg(c);
+        for (int i = 0; i < arg_count; i++) {
+            int reg = i == 0 ? base : alloc_reg(c);
+            compile_expr(c, args->data.list.items[i], reg);
+        }
+        emit(c, OP_NATIVE, 0, base, builtin->index, arg_count);
+        c->free_reg = base + 1;
+        return move_to(c, base, dst);
+    }
+
+    /* User-defined function */
+    int func_index = name_index(c->funcs, func_name);
+    if (!c->is_script && node->data.func_call.func->data.identifier.ref.slot >= 0) {
+        compile_error(c, node, "call through a local variable");
+        return 0;
+    }
+    if (func_index >= 0 && func_name == atom_main) {
+        compile_error(c, node, "call of main");
+        return 0;
+    }
+    if (func_index < 0) {
+        compile_error(c, node, "call of an undefined function");
+        return 0;
+    }
+
+    ASTNode *params = c->funcs->decls[func_index]->data.func_decl.params;
+    int param_count = params ? params->data.list.count : 0;
+    int bound = arg_count < param_count ? arg_count : param_count;
+
+    /* Arguments go to consecutive registers, which become the callee's parameters */
+    int base = alloc_reg(c);
+    for (int i = 0; i < bound; i++) {
+        int reg = i == 0 ? base : alloc_reg(c);
+        compile_expr(c, args->data.list.items[i], reg);
+    }
+    emit(c, tail ? OP_TAILCALL : OP_CALL, 0, base, func_index, bound);
+    c->free_reg = base + 1;
+    return move_to(c, base, dst);
+}
+
+static int compile_incdec(Compiler *c, ASTNode *node, int dst, int want_result) {
+    ASTNode *operand = node->data.unary_op.operand;
+    if (operand->type != NODE_IDENTIFIER) {
+        compile_error(c, node, "increment of a non-variable");
+        return 0;
+    }
+
+    VarRegs ref = target_regs(c, node, operand->data.identifier.ref);
+    OpCode op = (node->type == NODE_PRE_INC || node->type == NODE_POST_INC) ? OP_INC : OP_DEC;
+    materialize_local(c, operand->data.identifier.name, ref);
+
+    /* When the old value is discarded x++ is the same as ++x */
+    if (node->type == NODE_PRE_INC || node->type == NODE_PRE_DEC || !want_result) {
+        emit(c, op, 0, ref.local, 0, 0);
+        return move_to(c, ref.local, dst);
+    }
+
+    int target = dst >= 0 ? dst : alloc_reg(c);
+    emit(c, OP_MOVE, 0, target, ref.local, 0);
+    emit(c, op, 0, ref.local, 0, 0);
+    return target;
+}
+
+static int compile_logical(Compiler *c, ASTNode *node, int dst) {
+    int target = dst >= 0 ? dst : alloc_reg(c);
+    int save = c->free_reg;
+    int is_and = node->type == NODE_AND;
+
+    int left = compile_expr(c, node->data.binary_op.left, -1);
+    int short_jump = emit_jump(c, is_and ? OP_JMPF : OP_JMPT, left);
+    c->free_reg = save;
+
+    int mark = c->assigned_count;
+    int right = compile_expr(c, node->data.binary_op.right, -1);
+    emit(c, OP_TOBOOL, 0, target, right, 0);
+    forget_assigned(c, mark);
+    int end_jump = emit_jump(c, OP_JMP, 0);
+
+    patch_jump(c, short_jump, here(c));
+    emit(c, OP_LOADK, 0, target, add_constant(c, create_bool_value(!is_and)), 0);
+    patch_jump(c, end_jump, here(c));
+
+    c->free_reg = save;
+    return target;
+}
+
+/* Compile an expression. If dst >= 0 the result is left in that register,
+ * otherwise in whichever register is cheapest (possibly a local). */
+static int compile_expr(Compiler *c, ASTNode *node, int dst) {
+    if (!node) {
+        int target = dst >= 0 ? dst : alloc_reg(c);
+        emit(c, OP_LOADNIL, 0, target, 0, 0);
+        return target;
+    }
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+        case NODE_FLOAT_LITERAL:
+        case NODE_STRING_LITERAL:
+        case NODE_BOOL_LITERAL: {
+            int target = dst >= 0 ? dst : alloc_reg(c);
+            emit(c, OP_LOADK, 0, target, add_constant(c, literal_value(node)), 0);
+            return target;
+        }
+
+        case NODE_ARRAY_LITERAL:
+            return compile_matrix_literal(c, node, dst);
+
+        case NODE_IDENTIFIER: {
+            VarRegs ref = var_regs(c, node->data.identifier.ref);
+            if (ref.local < 0 && ref.global < 0) {
+                compile_error(c, node, "reference to an undefined variable");
+                return 0;
+            }
+            if (ref.local < 0 && name_index(c->funcs, node->data.identifier.name) >= 0) {
+                compile_error(c, node, "function used as a value");
+                return 0;
+            }
+            name_regs(c, node->data.identifier.name, ref);
+            if (ref.local >= 0 && c->assigned[ref.local]) {
+                return move_to(c, ref.local, dst);
+            }
+            if (ref.global < 0) {
+                emit(c, OP_CHECKDEF, 0, ref.local, 0, 0);
+                mark_assigned(c, ref.local);
+                return move_to(c, ref.local, dst);
+            }
+            int target = dst >= 0 ? dst : alloc_reg(c);
+            if (ref.local >= 0) {
+                emit(c, OP_LOADLG, 0, target, ref.local, ref.global);
+            } else {
+                emit(c, OP_LOADG, 0, target, ref.global, 0);
+            }
+            return target;
+        }
+
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
+        case NODE_MATRIX_MUL: case NODE_LT: case NODE_GT: case NODE_LE: case NODE_GE:
+        case NODE_EQ: case NODE_NE: case NODE_PATTERN_MATCH:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE:
+        case NODE_INT_EQ: case NODE_INT_NE: {
+            int save = c->free_reg;
+            int target = dst >= 0 ? dst : alloc_reg(c);
+            if (node->type == NODE_PATTERN_MATCH &&
+                node->data.binary_op.right->type == NODE_STRING_LITERAL) {
+                int text = compile_expr(c, node->data.binary_op.left, -1);
+                int pattern = add_pattern(c, node->data.binary_op.right->data.string_literal.value);
+                emit(c, OP_MATCHK, 0, target, text, pattern);
+                c->free_reg = dst >= 0 ? save : target + 1;
+                return target;
+            }
+            int left = compile_rk(c, node->data.binary_op.left);
+            int right = compile_rk(c, node->data.binary_op.right);
+            emit(c, binary_opcode(node->type), 0, target, left, right);
+            c->free_reg = dst >= 0 ? save : target + 1;
+            return target;
+        }
+
+        case NODE_AND:
+        case NODE_OR:
+            return compile_logical(c, node, dst);
+
+        case NODE_NOT:
+        case NODE_UNARY_MINUS: {
+            int save = c->free_reg;
+            int target = dst >= 0 ? dst : alloc_reg(c);
+            int operand = compile_expr(c, node->data.unary_op.operand, -1);
+            emit(c, node->type == NODE_NOT ? OP_NOT : OP_NEG, 0, target, operand, 0);
+            c->free_reg = dst >= 0 ? save : target + 1;
+            return target;
+        }
+
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC:
+            return compile_incdec(c, node, dst, 1);
+
+        case NODE_ASSIGN: {
+            ASTNode *left = node->data.binary_op.left;
+            if (left->type != NODE_IDENTIFIER) {
+                return compile_expr(c, node->data.binary_op.right, dst);
+            }
+            VarRegs ref = target_regs(c, node, left->data.identifier.ref);
+            compile_expr(c, node->data.binary_op.right, ref.local);
+            mark_assigned(c, ref.local);
+            return move_to(c, ref.local, dst);
+        }
+
+        case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN: {
+            ASTNode *left = node->data.binary_op.left;
+            if (left->type != NODE_IDENTIFIER) {
+                int target = dst >= 0 ? dst : alloc_reg(c);
+                emit(c, OP_LOADNIL, 0, target, 0, 0);
+                return target;
+            }
+            VarRegs ref = target_regs(c, node, left->data.identifier.ref);
+            int save = c->free_reg;
+            materialize_local(c, left->data.identifier.name, ref);
+            int right = compile_rk(c, node->data.binary_op.right);
+            emit(c, binary_opcode(node->type), 0, ref.local, ref.local, right);
+            c->free_reg = save;
+            return move_to(c, ref.local, dst);
+        }
+
+        case NODE_FUNC_CALL:
+            return compile_call(c, node, dst, 1, 0);
+
+        default:
+            compile_error(c, node, "unsupported expression");
+            return 0;
+    }
+}
+
+static Value default_value(DataType type) {
+    switch (type) {
+        case TYPE_INT: return create_int_value(0);
+        case TYPE_FLOAT: return create_float_value(0.0);
+        case TYPE_BOOL: return create_bool_value(0);
+        case TYPE_STRING: return create_string_value("");
+        case TYPE_MATRIX: return create_matrix_value(0, 0);
+        default: return create_void_value();
+    }
+}
+
+static void compile_stmt(Compiler *c, ASTNode *node) {
+    if (!node) return;
+    int save = c->free_reg;
+
+    switch (node->type) {
+        case NODE_EXPR_STMT: {
+            ASTNode *expr = node->data.unary_op.operand;
+            if (!expr) break;
+            if (expr->type == NODE_FUNC_CALL) {
+                compile_call(c, expr, -1, 0, 0);
+            } else if (expr->type == NODE_POST_INC || expr->type == NODE_POST_DEC) {
+                compile_incdec(c, expr, -1, 0);
+            } else {
+                compile_expr(c, expr, -1);
+            }
+            break;
+        }
+
+        case NODE_VAR_DECL: {
+            int reg = target_regs(c, node, node->data.var_decl.ref).local;
+            if (node->data.var_decl.initializer) {
+                compile_expr(c, node->data.var_decl.initializer, reg);
+            } else {
+                Value val = default_value(node->data.var_decl.type.base_type);
+                if (val.type == VAL_VOID) {
+                    emit(c, OP_LOADNIL, 0, reg, 0, 0);
+                } else {
+                    emit(c, OP_LOADK, 0, reg, add_constant(c, val), 0);
+                }
+            }
+            mark_assigned(c, reg);
+            break;
+        }
+
+        case NODE_IF:
+        case NODE_IF_ELSE: {
+            int cond = compile_expr(c, node->data.if_stmt.condition, -1);
+            int else_jump = emit_jump(c, OP_JMPF, cond);
+            c->free_reg = save;
+            int mark = c->assigned_count;
+            compile_stmt(c, node->data.if_stmt.then_stmt);
+            forget_assigned(c, mark);
+            if (node->data.if_stmt.else_stmt) {
+                int end_jump = emit_jump(c, OP_JMP, 0);
+                patch_jump(c, else_jump, here(c));
+                compile_stmt(c, node->data.if_stmt.else_stmt);
+                forget_assigned(c, mark);
+                patch_jump(c, end_jump, here(c));
+            } else {
+                patch_jump(c, else_jump, here(c));
+            }
+            break;
+        }
+
+        case NODE_WHILE: {
+            int top = here(c);
+            int cond = compile_expr(c, node->data.while_stmt.condition, -1);
+            int exit_jump = emit_jump(c, OP_JMPF, cond);
+            c->free_reg = save;
+            int mark = c->assigned_count;
+            compile_stmt(c, node->data.while_stmt.body);
+            forget_assigned(c, mark);
+            int back = emit_jump(c, OP_JMP, 0);
+            patch_jump(c, back, top);
+            patch_jump(c, exit_jump, here(c));
+            break;
+        }
+
+        case NODE_FOR_RANGE: {
+            ASTNode *range = node->data.for_range.range;
+            int iter = target_regs(c, node, node->data.for_range.ref).local;
+
+            /* Counter, trip count and step live in three reserved registers */
+            int base = alloc_reg(c);
+            alloc_reg(c);
+            alloc_reg(c);
+            compile_expr(c, range->data.range.start, base);
+            compile_expr(c, range->data.range.end, base + 1);
+            if (range->data.range.step) {
+                compile_expr(c, range->data.range.step, base + 2);
+            } else {
+                emit(c, OP_LOADK, 0, base + 2, add_constant(c, create_int_value(1)), 0);
+            }
+
+            int inclusive = (range->type == NODE_RANGE_INCL || range->type == NODE_RANGE_STEP);
+            int prep = emit(c, OP_FORPREP, inclusive, base, 0, 0);
+            int body = here(c);
+            int mark = c->assigned_count;
+            emit(c, OP_MOVE, 0, iter, base, 0);
+            mark_assigned(c, iter);
+            compile_stmt(c, node->data.for_range.body);
+            forget_assigned(c, mark);
+            int loop = emit(c, OP_FORLOOP, 0, base, 0, 0);
+            patch_jump(c, loop, body);
+            patch_jump(c, prep, here(c));
+            break;
+        }
+
+        case NODE_RETURN:
+            if (c->is_script) {
+                /* A return outside a function stops the program */
+                if (node->data.return_stmt.value) {
+                    compile_expr(c, node->data.return_stmt.value, -1);
+                }
+                emit(c, OP_HALT, 0, 0, 0, 0);
+            } else if (is_user_call(node->data.return_stmt.value)) {
+                compile_call(c, node->data.return_stmt.value, -1, 1, 1);
+            } else if (node->data.return_stmt.value) {
+                int reg = compile_expr(c, node->data.return_stmt.value, -1);
+                emit(c, OP_RET, 0, reg, 0, 0);
+            } else {
+                emit(c, OP_RETV, 0, 0, 0, 0);
+            }
+            break;
+
+        case NODE_STMT_LIST:
+            for (int i = 0; i < node->data.list.count; i++) {
+                compile_stmt(c, node->data.list.items[i]);
+            }
+            break;
+
+        default:
+            /* Statements the tree walker ignores compile to nothing */
+            break;
+    }
+
+    c->free_reg = save;
+}
+
+/* Lower min_args to the argument count of every call of a user function */
+static void count_args(ASTNode *node, void *ctx) {
+    Compiler *c = (Compiler*)ctx;
+    if (!node) return;
+    if (is_user_call(node)) {
+        int index = name_index(c->funcs, node->data.func_call.func->data.identifier.name);
+        ASTNode *args = node->data.func_call.args;
+        int count = args ? args->data.list.count : 0;
+        if (index >= 0 && count < c->min_args[index]) c->min_args[index] = count;
+    }
+    ast_visit_children(node, count_args, ctx);
+}
+
+static void compile_function(Compiler *c, BytecodeFunction *fn, ASTNode *decl) {
+    ASTNode *params = decl->data.func_decl.params;
+
+    fn->name = decl->data.func_decl.name;
+    fn->num_params = params ? params->data.list.count : 0;
+
+    /* Parameters and locals occupy the first registers, as resolved */
+    begin_function(c, fn, decl->data.func_decl.num_slots);
+    c->is_script = 0;
+    c->free_reg = decl->data.func_decl.num_slots;
+    fn->num_regs = decl->data.func_decl.num_slots;
+    if (fn->num_regs >= MAX_REGS) compile_error(c, decl, "too many locals");
+
+    /* Parameters that every call passes are set on entry */
+    int min_args = c->min_args[fn - c->program->functions];
+    for (int i = 0; i < fn->num_params && i < min_args; i++) {
+        mark_assigned(c, params->data.list.items[i]->data.param.ref.slot);
+    }
+
+    compile_stmt(c, decl->data.func_decl.body);
+    emit(c, OP_RETV, 0, 0, 0, 0);
+}
+
+BytecodeProgram* compile_program(ASTNode *root) {
+    if (!root || root->type != NODE_DECL_LIST) return NULL;
+
+    int global_count = resolve_program(root);
+    BytecodeProgram *program = (BytecodeProgram*)calloc(1, sizeof(BytecodeProgram));
+    NameList funcs = {0};
+    ASTNode *main_decl = NULL;
+
+    /* Like the tree walker, a later definition of a name wins */
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type == NODE_FUNC_DECL) {
+            int idx = name_index(&funcs, decl->data.func_decl.name);
+            if (idx >= 0) {
+                funcs.decls[idx] = decl;
+            } else {
+                name_push(&funcs, decl->data.func_decl.name, decl);
+            }
+        }
+    }
+    int main_index = name_index(&funcs, atom_main);
+    if (main_index >= 0) {
+        main_decl = funcs.decls[main_index];
+    }
+
+    Compiler c = {0};
+    c.program = program;
+    c.funcs = &funcs;
+
+    program->func_count = funcs.count;
+    program->functions = (BytecodeFunction*)calloc(funcs.count > 0 ? funcs.count : 1,
+                                                   sizeof(BytecodeFunction));
+
+    c.min_args = (int*)malloc((funcs.count > 0 ? funcs.count : 1) * sizeof(int));
+    for (int i = 0; i < funcs.count; i++) {
+        c.min_args[i] = INT_MAX;
+    }
+    count_args(root, &c);
+
+    /* Script: top-level statements, then the body of main. Its window
+     * holds the globals. */
+    begin_function(&c, &program->script, global_count);
+    c.is_script = 1;
+    c.free_reg = global_count;
+    program->script.name = "<script>";
+    program->script.num_regs = global_count;
+    if (global_count >= MAX_REGS) compile_error(&c, root, "too many globals");
+
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL) {
+            compile_stmt(&c, decl);
+        }
+    }
+    if (main_decl) {
+        compile_stmt(&c, main_decl->data.func_decl.body);
+    }
+    emit(&c, OP_HALT, 0, 0, 0, 0);
+
+    /* main only runs as part of the script */
+    for (int i = 0; i < funcs.count; i++) {
+        if (i != main_index) {
+            compile_function(&c, &program->functions[i], funcs.decls[i]);
+        }
+    }
+
+    free_name_list(&funcs);
+    free(c.min_args);
+    free(c.assigned);
+    free(c.assigned_log);
+
+    if (c.error) {
+        fprintf(stderr, "VM: %s at line %d, using the tree-walking interpreter\n",
+                c.error, c.error_line);
+        free_bytecode_program(program);
+        return NULL;
+    }
+    return program;
+}
+
+static void free_function(BytecodeFunction *fn) {
+    for (int i = 0; i < fn->const_count; i++) {
+        free_value(&fn->constants[i]);
+    }
+    free(fn->constants);
+    free(fn->patterns);
+    free(fn->code);
+    free(fn->var_names);
+}
+
+void free_bytecode_program(BytecodeProgram *program) {
+    if (!program) return;
+    for (int i = 0; i < program->func_count; i++) {
+        free_function(&program->functions[i]);
+    }
+    free(program->functions);
+    free_function(&program->script);
+    free(program);
+}
+
+const char* opcode_to_string(OpCode op) {
+#define OPCODE_NAME(name) case name: return #name + 3;
+    switch (op) {
+        OPCODE_LIST(OPCODE_NAME)
+        default: return "UNKNOWN";
+    }
+#undef OPCODE_NAME
+}
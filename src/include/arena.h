@@ -0,0 +1,23 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator. Allocations are carved out of large chunks in order, so
+ * objects allocated together sit together in memory, and the whole arena
+ * is released at once; individual allocations are never freed.
+ */
+typedef struct ArenaChunk ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;    /* Chunk currently being filled */
+    size_t chunk_size;   /* Default size of new chunks */
+} Arena;
+
+void arena_init(Arena *arena, size_t chunk_size);
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strndup(Arena *arena, const char *str, size_t len);
+void arena_free(Arena *arena);
+
+#endif /* ARENA_H */
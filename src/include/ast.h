@@ -3,6 +3,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "atom.h"
+#include "arena.h"
 
 /* Node types */
 typedef enum {
@@ -33,6 +35,18 @@ typedef enum {
     NODE_GE,
     NODE_PATTERN_MATCH,
     
+    /* Specialized by the type pass: both operands are known to be ints */
+    NODE_INT_ADD,
+    NODE_INT_SUB,
+    NODE_INT_MUL,
+    NODE_INT_MOD,
+    NODE_INT_LT,
+    NODE_INT_GT,
+    NODE_INT_LE,
+    NODE_INT_GE,
+    NODE_INT_EQ,
+    NODE_INT_NE,
+    
     /* Logical operations */
     NODE_AND,
     NODE_OR,
@@ -111,6 +125,15 @@ typedef struct {
     int array_size;
 } TypeInfo;
 
+/* Runtime location of a variable, filled in by the resolver.
+ * slot indexes the enclosing function's frame, global_slot the global
+ * frame; either is -1 when the name is not bound there. A read tries the
+ * frame slot first and falls back to the global one. */
+typedef struct {
+    int slot;
+    int global_slot;
+} VarRef;
+
 /* AST Node structure */
 typedef struct ASTNode {
     NodeType type;
@@ -137,13 +160,15 @@ typedef struct ASTNode {
         
         /* Identifier */
         struct {
-            char *name;
+            Atom name;
+            VarRef ref;
         } identifier;
         
         /* Binary operations */
         struct {
             struct ASTNode *left;
             struct ASTNode *right;
+            struct CompiledRegex *regex;  /* ~= with a literal pattern, once compiled */
         } binary_op;
         
         /* Unary operations */
@@ -161,14 +186,15 @@ typedef struct ASTNode {
         /* Variable declaration */
         struct {
             TypeInfo type;
-            char *name;
+            Atom name;
             struct ASTNode *initializer;  /* NULL if no initializer */
+            VarRef ref;
         } var_decl;
         
         /* Array declaration */
         struct {
             TypeInfo type;
-            char *name;
+            Atom name;
             struct ASTNode *size;
             struct ASTNode *initializer;  /* NULL if no initializer */
         } array_decl;
@@ -176,15 +202,22 @@ typedef struct ASTNode {
         /* Function declaration */
         struct {
             TypeInfo return_type;
-            char *name;
+            Atom name;
             struct ASTNode *params;  /* Parameter list */
             struct ASTNode *body;    /* Compound statement */
+            int slot;                /* Global slot holding the function */
+            int num_slots;           /* Frame size: parameters + locals */
+            int fixed;               /* Calls by this name always reach this function */
+            struct JitFunction *jit; /* Call counts and native code, see jit.h */
+            struct MemoCache *memo;  /* Result cache of a pure function, see memo.h */
+            struct ProfileFunction *profile; /* Counters under --profile, see profile.h */
         } func_decl;
         
         /* Parameter */
         struct {
             TypeInfo type;
-            char *name;
+            Atom name;
+            VarRef ref;
         } param;
         
         /* If statement */
@@ -210,9 +243,10 @@ typedef struct ASTNode {
         
         /* Range-based for statement */
         struct {
-            char *iterator;
+            Atom iterator;
             struct ASTNode *range;
             struct ASTNode *body;
+            VarRef ref;
         } for_range;
         
         /* Return statement */
@@ -224,6 +258,7 @@ typedef struct ASTNode {
         struct {
             struct ASTNode *func;  /* Function identifier or expression */
             struct ASTNode *args;  /* Argument list */
+            const struct Builtin *builtin;  /* Set by the resolver for builtin calls */
         } func_call;
         
         /* Array indexing */
@@ -243,16 +278,27 @@ typedef struct ASTNode {
     
 } ASTNode;
 
-/* AST Node creation functions */
+/* AST Node creation functions
+ *
+ * Nodes, list arrays and string literals are allocated from one arena and
+ * released together by free_ast(). */
+
+/* Size of the chunks the AST arena grows by */
+#define AST_ARENA_CHUNK (64 * 1024)
+
+/* Allocate from arena (NULL for the default one) until the next switch,
+ * so that several trees can be kept and freed separately; returns the
+ * arena used before. The choice, like the default arena, is per thread. */
+Arena* ast_use_arena(Arena *arena);
 
 /* Literals */
 ASTNode* create_int_literal(int value, int line);
 ASTNode* create_float_literal(double value, int line);
-ASTNode* create_string_literal(char *value, int line);
+ASTNode* create_string_literal(char *value, int line);  /* value from ast_strndup */
 ASTNode* create_bool_literal(int value, int line);
 
 /* Identifiers */
-ASTNode* create_identifier(char *name, int line);
+ASTNode* create_identifier(Atom name, int line);
 
 /* Binary operations */
 ASTNode* create_binary_op(NodeType type, ASTNode *left, ASTNode *right, int line);
@@ -264,16 +310,16 @@ ASTNode* create_unary_op(NodeType type, ASTNode *operand, int line);
 ASTNode* create_range(NodeType type, ASTNode *start, ASTNode *end, ASTNode *step, int line);
 
 /* Declarations */
-ASTNode* create_var_decl(TypeInfo type, char *name, ASTNode *initializer, int line);
-ASTNode* create_array_decl(TypeInfo type, char *name, ASTNode *size, ASTNode *initializer, int line);
-ASTNode* create_func_decl(TypeInfo return_type, char *name, ASTNode *params, ASTNode *body, int line);
-ASTNode* create_param(TypeInfo type, char *name, int line);
+ASTNode* create_var_decl(TypeInfo type, Atom name, ASTNode *initializer, int line);
+ASTNode* create_array_decl(TypeInfo type, Atom name, ASTNode *size, ASTNode *initializer, int line);
+ASTNode* create_func_decl(TypeInfo return_type, Atom name, ASTNode *params, ASTNode *body, int line);
+ASTNode* create_param(TypeInfo type, Atom name, int line);
 
 /* Statements */
 ASTNode* create_if_stmt(ASTNode *condition, ASTNode *then_stmt, ASTNode *else_stmt, int line);
 ASTNode* create_while_stmt(ASTNode *condition, ASTNode *body, int line);
 ASTNode* create_for_stmt(ASTNode *init, ASTNode *condition, ASTNode *increment, ASTNode *body, int line);
-ASTNode* create_for_range(char *iterator, ASTNode *range, ASTNode *body, int line);
+ASTNode* create_for_range(Atom iterator, ASTNode *range, ASTNode *body, int line);
 ASTNode* create_return_stmt(ASTNode *value, int line);
 ASTNode* create_break_stmt(int line);
 ASTNode* create_continue_stmt(int line);
@@ -292,8 +338,10 @@ TypeInfo create_type(DataType base_type);
 TypeInfo create_array_type(DataType base_type, int size);
 
 /* Utility functions */
-void free_ast(ASTNode *node);
+char* ast_strndup(const char *str, size_t len);
+void free_ast(void);
 void print_ast(ASTNode *node, int indent);
+void ast_visit_children(ASTNode *node, void (*visit)(ASTNode *child, void *ctx), void *ctx);
 const char* node_type_to_string(NodeType type);
 const char* data_type_to_string(DataType type);
 
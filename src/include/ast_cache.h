@@ -0,0 +1,32 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include <stddef.h>
+#include "ast.h"
+
+/*
+ * Parsed programs cached next to their source (file.prog -> file.yaplc),
+ * so that running an unchanged program skips the scanner, the parser and
+ * the optimizer.
+ *
+ * A cache file holds the optimized AST in a compact pre-order encoding
+ * behind a header recording the length and a 64-bit hash of the source,
+ * the optimization level, the encoding version and the identity of the
+ * interpreter build that wrote it. A cache whose header does not match,
+ * or that is damaged, is ignored and rewritten. Names are stored once and
+ * interned on load; nodes are rebuilt in the AST arena.
+ *
+ * Bump AST_CACHE_VERSION whenever the AST changes shape.
+ */
+#define AST_CACHE_VERSION 3
+
+/* The sidecar path for source_path; free() it */
+char* ast_cache_path(const char *source_path);
+
+/* The program cached at cache_path for this source text, or NULL */
+ASTNode* ast_cache_load(const char *cache_path, const char *source, size_t len, int opt_level);
+
+/* Best effort: a cache that cannot be written is simply not written */
+void ast_cache_save(const char *cache_path, ASTNode *root, const char *source, size_t len, int opt_level);
+
+#endif /* AST_CACHE_H */
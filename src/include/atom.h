@@ -0,0 +1,24 @@
+#ifndef ATOM_H
+#define ATOM_H
+
+#include <stddef.h>
+
+/*
+ * Interned names. Every distinct identifier is stored once in a global
+ * table, so two atoms name the same thing exactly when the pointers are
+ * equal. Atoms live until atom_table_free() and must not be freed by
+ * their users. Interning is thread-safe.
+ */
+typedef const char *Atom;
+
+Atom atom_intern(const char *str);
+Atom atom_intern_n(const char *str, size_t len);
+void atom_table_free(void);
+
+/* Names the interpreter checks for; valid once anything has been interned */
+extern Atom atom_main;
+extern Atom atom_print;
+extern Atom atom_printm;
+extern Atom atom_read;
+
+#endif /* ATOM_H */
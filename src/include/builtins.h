@@ -0,0 +1,55 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "interpreter.h"
+#include "yapl_native.h"
+
+/*
+ * Registry of builtin functions: print, printm, read, readall, readm,
+ * loadm and savem, plus native functions registered by extensions (see
+ * yapl_native.h).
+ * The resolver looks every call site up once and records the entry on
+ * the call node, so calls never compare names at runtime.
+ */
+typedef enum {
+    BUILTIN_PRINT,
+    BUILTIN_PRINTM,
+    BUILTIN_READ,
+    BUILTIN_READALL,
+    BUILTIN_READM,
+    BUILTIN_LOADM,
+    BUILTIN_SAVEM,
+    BUILTIN_NATIVE
+} BuiltinKind;
+
+typedef struct Builtin {
+    Atom name;
+    BuiltinKind kind;
+    int arity;                              /* -1 for any number of arguments */
+    YaplType params[YAPL_NATIVE_MAX_ARGS];
+    YaplType ret;
+    YaplNativeFn fn;
+    int index;                              /* Position in the registry */
+} Builtin;
+
+const Builtin* builtin_lookup(Atom name);   /* NULL if name is not a builtin */
+
+/* Warn about each user function of root named like a builtin, since calls
+ * by that name always reach the builtin */
+void builtins_warn_shadowed(ASTNode *root);
+const Builtin* builtin_at(int index);
+DataType builtin_result_type(const Builtin *builtin);
+
+/* Stops the program unless the builtin takes nargs arguments */
+void builtin_check_arity(const Builtin *builtin, int nargs);
+
+/* Load an extension; prints the reason and returns -1 on failure */
+int builtins_load(const char *path);
+
+/* Call a native function with evaluated arguments (borrowed), after
+ * checking their number and types */
+Value builtin_call_native(const Builtin *builtin, Value *args, int nargs);
+
+void builtins_free(void);
+
+#endif /* BUILTINS_H */
@@ -0,0 +1,126 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include "ast.h"
+#include "interpreter.h"
+#include "regex_cache.h"
+
+/*
+ * Register-based bytecode for the yapl VM.
+ *
+ * Every function gets a window of registers on the VM stack: parameters
+ * first, then the other locals, then expression temporaries. The script
+ * (top-level statements followed by the body of main) runs in the bottom
+ * window, so its locals are the program's globals.
+ *
+ * Operands named RK may refer either to a register or, when RK_CONST is
+ * set, to an entry of the function's constant pool.
+ *
+ * A variable's register is unset until the variable is first assigned.
+ * Loads of globals check for that; a read of a local is preceded by
+ * OP_CHECKDEF unless the compiler can tell it has been assigned already.
+ */
+
+#define RK_CONST     0x8000
+#define MAX_REGS     RK_CONST
+#define MAX_CONSTS   RK_CONST
+
+/* X-macro so the opcode enum and the VM dispatch table stay in sync */
+#define OPCODE_LIST(X) \
+    X(OP_LOADK)     /* R[a] = K[b]                                   */ \
+    X(OP_LOADNIL)   /* R[a] = void                                   */ \
+    X(OP_MOVE)      /* R[a] = R[b]                                   */ \
+    X(OP_LOADG)     /* R[a] = G[b]                                   */ \
+    X(OP_LOADLG)    /* R[a] = R[b] if set, else G[c]                 */ \
+    X(OP_CHECKDEF)  /* error unless R[a] is set                      */ \
+    X(OP_ADD)       /* R[a] = RK[b] + RK[c]                          */ \
+    X(OP_SUB)                                                           \
+    X(OP_MUL)                                                           \
+    X(OP_DIV)                                                           \
+    X(OP_MOD)                                                           \
+    X(OP_MATMUL)                                                        \
+    X(OP_LT)                                                            \
+    X(OP_GT)                                                            \
+    X(OP_LE)                                                            \
+    X(OP_GE)                                                            \
+    X(OP_EQ)                                                            \
+    X(OP_NE)                                                            \
+    X(OP_MATCH)                                                         \
+    X(OP_MATCHK)    /* R[a] = R[b] ~= P[c] (precompiled pattern)     */ \
+    X(OP_NEG)       /* R[a] = -R[b]                                  */ \
+    X(OP_NOT)       /* R[a] = !R[b]                                  */ \
+    X(OP_TOBOOL)    /* R[a] = (bool)R[b]                             */ \
+    X(OP_INC)       /* R[a]++                                        */ \
+    X(OP_DEC)       /* R[a]--                                        */ \
+    X(OP_JMP)       /* pc = target                                   */ \
+    X(OP_JMPF)      /* if (!R[a]) pc = target                        */ \
+    X(OP_JMPT)      /* if (R[a]) pc = target                         */ \
+    X(OP_FORPREP)   /* R[a..a+2] = start, trips, step; x = inclusive */ \
+    X(OP_FORLOOP)   /* if (--trips) R[a] += step, pc = target        */ \
+    X(OP_NEWMAT)    /* R[a] = matrix b x c from R[a..]               */ \
+    X(OP_CALL)      /* R[a] = F[b](R[a], ..., R[a+c-1])              */ \
+    X(OP_TAILCALL)  /* return F[b](R[a], ..., R[a+c-1]) in this frame */ \
+    X(OP_RET)       /* return R[a]                                   */ \
+    X(OP_RETV)      /* return void                                   */ \
+    X(OP_HALT)      /* stop the program                              */ \
+    X(OP_PRINT)     /* print R[a], followed by a space if x          */ \
+    X(OP_PRINTNL)                                                       \
+    X(OP_PRINTM)    /* printm R[a]                                   */ \
+    X(OP_READ)      /* R[a] = read()                                 */ \
+    X(OP_READALL)   /* R[a] = readall(R[b] if x)                     */ \
+    X(OP_READM)     /* R[a] = readm(R[b] if x)                       */ \
+    X(OP_LOADM)     /* R[a] = loadm(R[b])                            */ \
+    X(OP_SAVEM)     /* savem(R[a], R[b])                             */ \
+    X(OP_NATIVE)    /* R[a] = N[b](R[a], ..., R[a+c-1]) (builtin b)  */
+
+#define OPCODE_ENUM(name) name,
+typedef enum {
+    OPCODE_LIST(OPCODE_ENUM)
+    OP_COUNT
+} OpCode;
+#undef OPCODE_ENUM
+
+/* One instruction: 8 bytes. Jump targets use b:c as a 32-bit index. */
+typedef struct {
+    uint8_t op;
+    uint8_t x;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+} Instr;
+
+#define INSTR_TARGET(ins) (((uint32_t)(ins).b << 16) | (ins).c)
+
+/* Compiled function */
+typedef struct {
+    const char *name;
+    Instr *code;
+    int code_count;
+    int code_capacity;
+    Value *constants;
+    int const_count;
+    int const_capacity;
+    CompiledRegex **patterns;  /* Literal ~= patterns, owned by the regex cache */
+    int pattern_count;
+    int pattern_capacity;
+    int num_params;
+    int num_regs;
+    Atom *var_names;  /* Variable held by each local register, for errors */
+} BytecodeFunction;
+
+/* Compiled program */
+typedef struct {
+    BytecodeFunction *functions;
+    int func_count;
+    BytecodeFunction script;  /* Top-level statements + body of main */
+} BytecodeProgram;
+
+/* Compile the AST. Returns NULL (after printing the reason to stderr)
+ * when the program uses a construct the compiler does not support. */
+BytecodeProgram* compile_program(ASTNode *root);
+void free_bytecode_program(BytecodeProgram *program);
+
+const char* opcode_to_string(OpCode op);
+
+#endif /* BYTECODE_H */
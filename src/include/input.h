@@ -0,0 +1,42 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+#include "interpreter.h"
+
+/*
+ * Program input: read(), readall() and readm(). Lines may be of any
+ * length. readall() and readm() take an optional file name; without one
+ * they consume the rest of stdin in large blocks, and a named file is
+ * mapped into memory rather than copied through stdio.
+ */
+
+/* The next line of stdin without its newline, or NULL at end of input.
+ * The buffer is reused by the next call. */
+char* input_line(size_t *len);
+
+/* The rest of stdin, or the whole of path, as a string */
+Value input_read_all(const char *path);
+
+/* Numbers separated by whitespace, commas or semicolons, one matrix row
+ * per non-empty line */
+Value input_read_matrix(const char *path);
+
+/* A block of input: a mapped file or a heap copy of stdin */
+typedef struct {
+    char *data;
+    size_t len;
+    int mapped;
+} InputBlock;
+
+/* Map path privately (pages may be written without touching the file);
+ * caller() names the builtin in error messages */
+InputBlock input_map_file(const char *path, const char *caller);
+void input_release(InputBlock *block);
+
+/* The file name passed to caller(); anything but a string is an error */
+const char* input_path(const char *caller, const Value *arg);
+
+void input_free(void);
+
+#endif /* INPUT_H */
@@ -3,6 +3,10 @@
 
 #include "ast.h"
 
+/* Call depth limit of the tree walker, which recurses on the C stack;
+ * the VM has its own, much higher limit (VM_MAX_CALL_DEPTH) */
+#define MAX_RECURSION_DEPTH 50
+
 /* ValueType enum */
 typedef enum {
     VAL_INT,
@@ -12,16 +16,31 @@ typedef enum {
     VAL_VOID,
     VAL_ARRAY,
     VAL_MATRIX,
-    VAL_FUNC
+    VAL_FUNC,
+    VAL_UNDEFINED   /* Slot that has not been assigned yet */
 } ValueType;
 
-/* Matrix structure */
+/* Matrix structure. Elements are stored row-major in one contiguous
+ * buffer allocated together with the header (or, for a matrix loaded
+ * from a binary file, in the file's mapping); rows are `stride` elements
+ * apart, every row starts on a MATRIX_ALIGN boundary and the padding
+ * after the last column is zero.
+ * Matrices are shared between values by reference count. A matrix is
+ * never written once it has been built, so sharing needs no copies. */
+#define MATRIX_ALIGN 64
+
 typedef struct {
     int rows;
     int cols;
-    double **data;
+    int stride;
+    int refcount;
+    double *data;
+    void *mapping;          /* File mapping holding data, or NULL */
+    size_t mapped_bytes;
 } Matrix;
 
+#define MATRIX_AT(mat, i, j) ((mat)->data[(size_t)(i) * (mat)->stride + (j)])
+
 /* Value union */
 typedef struct Value {
     ValueType type;
@@ -36,19 +55,15 @@ typedef struct Value {
             int size;
         } array_val;
         Matrix *matrix_val;
+        unsigned long long count;   /* Trips left in a VM range loop */
     } data;
 } Value;
 
-/* Symbol table entry */
-typedef struct Symbol {
-    char *name;
-    Value value;
-    struct Symbol *next;
-} Symbol;
-
-/* SymbolTable struct */
+/* SymbolTable struct: one fixed-size slot array per frame, indexed by
+ * the slots the resolver assigned (see VarRef in ast.h) */
 typedef struct SymbolTable {
-    Symbol *head;
+    Value *slots;
+    int slot_count;
     struct SymbolTable *parent;
     Value return_value;
     int is_returning;
@@ -57,6 +72,22 @@ typedef struct SymbolTable {
 /* Function to execute the AST */
 void execute_program(ASTNode *root);
 
+/* The steps of execute_program, for hosts running one tree many times.
+ * prepare_program resolves names and specializes types once and returns
+ * the number of global slots. run_program runs the prepared tree with
+ * fresh globals; with recover set, a runtime error ends only this run
+ * and makes it return 1 instead of exiting the process. JIT code and
+ * memo caches stay with the tree last run until release_program.
+ * Interpreter state is per thread: threads can run different trees at
+ * the same time, and a tree is run and released on one thread. */
+int prepare_program(ASTNode *root);
+int run_program(ASTNode *root, int global_count, int recover);
+void release_program(ASTNode *root);
+
+/* Ends the program after its runtime error has been reported: exits,
+ * or unwinds to the calling thread's recovering run_program */
+void runtime_abort(void) __attribute__((noreturn));
+
 /* Value operations */
 Value create_int_value(int val);
 Value create_float_value(double val);
@@ -65,18 +96,28 @@ Value create_bool_value(int val);
 Value create_void_value();
 Value create_matrix_value(int rows, int cols);
 void free_value(Value *val);
+Value copy_value(Value *val);
 void print_value(Value val);
 
+/* Operator semantics shared by the tree walker and the bytecode VM */
+Value eval_binary_op(NodeType op, Value *left, Value *right);
+Value read_input_value(void);
+
+/* Iterations of a range loop from start to end by step */
+unsigned long long range_trip_count(int start, int end, int step, int inclusive);
+
 /* Matrix operations */
 Matrix* create_matrix(int rows, int cols);
-void free_matrix(Matrix *mat);
+size_t matrix_stride(int cols);     /* Row length create_matrix uses */
+Matrix* retain_matrix(Matrix *mat);
+void free_matrix(Matrix *mat);  /* Drops one reference */
 Matrix* matrix_multiply(Matrix *a, Matrix *b);
 void print_matrix(Matrix *mat);
 
 /* Symbol table operations */
-SymbolTable* create_symbol_table(SymbolTable *parent);
+SymbolTable* create_symbol_table(SymbolTable *parent, int slot_count);
 void free_symbol_table(SymbolTable *table);
-void set_symbol(SymbolTable *table, const char *name, Value value);
-Value* get_symbol(SymbolTable *table, const char *name);
+void set_symbol(SymbolTable *table, VarRef ref, Value value);
+Value* get_symbol(SymbolTable *table, VarRef ref);
 
 #endif /* INTERPRETER_H */
\ No newline at end of file
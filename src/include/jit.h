@@ -0,0 +1,44 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+ * Baseline x86-64 JIT for the tree walker.
+ *
+ * Every user function counts its interpreted calls. Once a function has
+ * been called JIT_HOT_CALLS times (YAPL_JIT_THRESHOLD overrides) it is
+ * specialized for the argument types of that call and compiled, together
+ * with the functions it calls, straight from the AST into executable
+ * memory. Later calls whose arguments have the same types run the native
+ * code; any other call keeps using the interpreter.
+ *
+ * A function is compiled only if everything it does can be done natively:
+ * its locals each hold one of int, float or bool, it uses arithmetic,
+ * comparisons, logic, assignments, if/while/range-for and calls to other
+ * such functions, and every path returns a value. Anything else (globals,
+ * strings, matrices, builtins, ...) leaves the function to the interpreter,
+ * with the reason kept for jit_print_stats. Native code keeps the
+ * interpreter's semantics, including its runtime errors and the recursion
+ * limit.
+ */
+#define JIT_HOT_CALLS 100
+
+typedef struct JitFunction JitFunction;
+
+void jit_set_enabled(int enabled);
+
+/* Prepare root for compilation; call_depth is the interpreter's call
+ * depth, which native calls maintain too */
+void jit_init(ASTNode *root, int *call_depth, int max_depth);
+
+/* Called for every interpreted call of decl once its first nargs
+ * parameters are bound in args. Returns 1 with *result set if the call
+ * ran as native code, 0 if the interpreter should run it. */
+int jit_call(ASTNode *decl, Value *args, int nargs, Value *result);
+
+void jit_print_stats(FILE *out);
+void jit_free(void);
+
+#endif /* JIT_H */
@@ -0,0 +1,39 @@
+#ifndef MATRIX_IO_H
+#define MATRIX_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "interpreter.h"
+
+/*
+ * Matrix files for loadm() and savem(), and the text parser behind
+ * readm().
+ *
+ * A binary matrix file is a MatrixFileHeader followed by the rows, each
+ * `stride` doubles long, in native byte order. savem() writes rows
+ * padded as in memory, so loadm() maps such a file and uses it in place
+ * without reading it; other strides are copied. Any file without the
+ * header is read as text: numbers separated by spaces, tabs, commas or
+ * semicolons, one row per non-empty line. Large texts are parsed on the
+ * thread pool.
+ */
+#define MATRIX_FILE_MAGIC "YAPLMAT1"
+
+typedef struct {
+    char magic[8];
+    int64_t rows;
+    int64_t cols;
+    int64_t stride;
+    char reserved[32];      /* Zero */
+} MatrixFileHeader;
+
+/* caller() names the builtin in error messages */
+Matrix* matrix_parse_text(const char *text, size_t len, const char *caller);
+
+Value matrix_load(const char *path);
+
+/* Writes text if path ends in ".csv" and the binary format otherwise;
+ * value must be a matrix */
+void matrix_save(const char *path, const Value *value);
+
+#endif /* MATRIX_IO_H */
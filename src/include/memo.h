@@ -0,0 +1,46 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+ * Result caches for pure user functions (--memo).
+ *
+ * A function is pure when its result depends only on its arguments: it
+ * takes at most MEMO_MAX_ARGS int, float or bool parameters, reads no
+ * globals, and calls no builtins and only other pure functions. The
+ * tree walker answers calls to a memoized function from its cache when
+ * it has seen the same argument values before. Each cache holds at most
+ * MEMO_CACHE_SIZE results; a new result replaces the one stored in its
+ * place.
+ */
+#define MEMO_CACHE_SIZE 4096
+#define MEMO_MAX_ARGS 4
+
+typedef struct MemoCache MemoCache;
+
+/* Arguments of one call, captured before the body can change them */
+typedef struct {
+    Value args[MEMO_MAX_ARGS];
+    unsigned int hash;
+    int usable;
+} MemoKey;
+
+/* names is a comma-separated list of functions to memoize, or NULL for
+ * every pure function */
+void memo_enable(const char *names);
+
+/* Find the pure functions of root and give the selected ones a cache,
+ * dropping the caches of any earlier tree (all of them if root is NULL) */
+void memo_init(ASTNode *root);
+
+/* Returns 1 with *result set if the cache holds the result for these
+ * arguments; otherwise fills *key for memo_store */
+int memo_lookup(MemoCache *cache, Value *args, int nargs, MemoKey *key, Value *result);
+void memo_store(MemoCache *cache, MemoKey *key, Value *result);
+
+void memo_print_stats(FILE *out);
+void memo_free(void);
+
+#endif /* MEMO_H */
@@ -0,0 +1,25 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ast.h"
+
+/*
+ * AST optimizer, run between parsing and execution so both the tree
+ * walker and the bytecode compiler see the result (print_ast shows it).
+ *
+ * Levels:
+ *   0  no changes
+ *   1  fold operations over literals and drop if/while statements whose
+ *      condition is a literal
+ *   2  also substitute globals that are declared once with a literal and
+ *      never stored to again, then fold what that exposes
+ *
+ * Folding follows the interpreter's semantics exactly; anything that would
+ * raise a runtime error (division by zero, int overflow, mixed types the
+ * interpreter rejects) is left for runtime.
+ */
+#define OPT_LEVEL_DEFAULT 2
+
+void optimize_program(ASTNode *root, int level);
+
+#endif /* OPTIMIZER_H */
@@ -0,0 +1,44 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+/*
+ * Program output (print, printm). Everything a program prints collects
+ * in an interpreter-owned buffer and reaches stdout according to the
+ * flush policy, so no value goes through printf. Numbers are formatted
+ * by hand but byte for byte as "%d" and "%g" would.
+ */
+typedef enum {
+    OUTPUT_FLUSH_LINE,      /* After every newline (default on a terminal) */
+    OUTPUT_FLUSH_BLOCK,     /* When the buffer fills (default otherwise) */
+    OUTPUT_FLUSH_EXIT       /* Only when the program ends */
+} OutputFlush;
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+void output_set_flush(OutputFlush policy);
+
+/* The calling thread's flushed output goes to sink instead of stdout;
+ * NULL restores stdout */
+typedef void (*OutputSink)(const char *text, size_t len, void *ctx);
+void output_set_sink(OutputSink sink, void *ctx);
+
+void output_write(const char *text, size_t len);
+void output_str(const char *text);
+void output_char(char c);
+void output_int(int value);
+void output_float(double value);    /* As "%g" */
+
+/* Formats value as "%g" into buf (at least 32 bytes); returns the length */
+int format_float(double value, char *buf);
+
+/* Formats value as short text that reads back as exactly the same
+ * double (at most 25 bytes and a NUL); returns the length */
+int format_float_exact(double value, char *buf);
+
+/* Hand buffered output to stdout; also runs when the process exits */
+void output_flush(void);
+void output_free(void);
+
+#endif /* OUTPUT_H */
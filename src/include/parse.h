@@ -0,0 +1,20 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stdio.h>
+#include "ast.h"
+
+/*
+ * Front end: the flex scanner and the bison parser. Each call parses one
+ * whole program into the current AST arena (see ast_use_arena) and
+ * returns 0 with *program set, or nonzero after a syntax error, which is
+ * reported on stderr and, if error is given, stored there as
+ * "line N: message". An empty program parses to NULL.
+ *
+ * Scanner and parser are reentrant: every call uses its own scanner and
+ * parser state, so threads can parse concurrently.
+ */
+int parse_file(FILE *in, ASTNode **program, char *error, size_t error_size);
+int parse_text(const char *text, size_t len, ASTNode **program, char *error, size_t error_size);
+
+#endif /* PARSE_H */
@@ -0,0 +1,44 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "interpreter.h"
+
+/*
+ * Execution profile of the tree walker (--profile).
+ *
+ * Every call of a user function is counted and timed: inclusive time
+ * runs from entering the body to returning, exclusive time leaves out
+ * the user functions it called. Time spent in recursive calls counts
+ * once towards inclusive time. Every statement executed is also counted
+ * against its source line. Top-level statements and the body of main
+ * belong to the root of the call tree, named "main".
+ *
+ * The walker calls the hooks below only while profile_enabled is set, so
+ * an unprofiled run pays one well-predicted branch per statement and
+ * call. Profiling runs on the walker with the JIT off, since native code
+ * has no statements to count.
+ */
+typedef struct ProfileFunction ProfileFunction;
+
+extern int profile_enabled;
+
+/* folded_path, if not NULL, receives the call stacks in the folded
+ * format read by flamegraph tools ("main;f;g <microseconds>") */
+void profile_enable(const char *folded_path);
+
+/* Start the clock for root; stop it after the program */
+void profile_start(ASTNode *root);
+void profile_stop(void);
+
+void profile_enter(ASTNode *decl);      /* After its arguments are bound */
+void profile_exit(void);                /* Once its result is known */
+void profile_line(int line);
+
+/* Functions by exclusive time and the most executed lines. source_path
+ * names the program file to quote lines from (NULL for stdin); writes
+ * the folded stacks too if asked for. */
+void profile_report(FILE *out, const char *source_path);
+void profile_free(void);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,25 @@
+#ifndef REGEX_CACHE_H
+#define REGEX_CACHE_H
+
+#include <stdio.h>
+
+/*
+ * Compiled patterns for the ~= operator. Patterns that appear as string
+ * literals are compiled once and pinned to the code that uses them;
+ * patterns computed at runtime go through a bounded LRU cache keyed by
+ * pattern text.
+ */
+typedef struct CompiledRegex CompiledRegex;
+
+#define REGEX_CACHE_SIZE 64   /* Unpinned patterns kept at once */
+
+CompiledRegex* regex_pin(const char *pattern);     /* For literal patterns */
+CompiledRegex* regex_lookup(const char *pattern);  /* For dynamic patterns */
+
+/* Nonzero if text matches; an invalid pattern reports an error and never matches */
+int regex_match(CompiledRegex *re, const char *text);
+
+void regex_print_stats(FILE *out);
+void regex_cache_free(void);
+
+#endif /* REGEX_CACHE_H */
@@ -0,0 +1,23 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "ast.h"
+
+/*
+ * Scope resolution: binds every variable reference and declaration to a
+ * frame slot (see VarRef) so the interpreter never looks names up at
+ * runtime. Calls of builtins are bound to their registry entry (see
+ * builtins.h).
+ *
+ * Scoping follows the interpreter: top-level statements and the body of
+ * main run in the global frame; every other function gets its own frame
+ * holding its parameters (first) and every name it declares or assigns.
+ * Function names occupy global slots too. A function is marked fixed
+ * when it is the only one declared with its name and no code running in
+ * the global frame binds that name, so a call by name always reaches it.
+ *
+ * Returns the number of global slots.
+ */
+int resolve_program(ASTNode *root);
+
+#endif /* RESOLVER_H */
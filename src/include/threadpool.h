@@ -0,0 +1,17 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+/*
+ * Persistent worker pool for data-parallel kernels. Workers are started on
+ * first use and live until exit. The pool has YAPL_THREADS threads
+ * (environment variable) or one per online CPU; the calling thread counts
+ * as one of them.
+ */
+
+/* Runs task(arg, i) for every i in [0, count) and returns once all are done */
+typedef void (*ThreadTask)(void *arg, int index);
+
+int thread_pool_size(void);
+void thread_pool_run(ThreadTask task, void *arg, int count);
+
+#endif /* THREADPOOL_H */
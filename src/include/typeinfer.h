@@ -0,0 +1,19 @@
+#ifndef TYPEINFER_H
+#define TYPEINFER_H
+
+#include "ast.h"
+
+/*
+ * Type specialization pass. Runs after resolve_program (it needs the
+ * slots) and rewrites arithmetic and comparisons whose operands are
+ * provably ints into NODE_INT_* nodes, which the interpreter evaluates
+ * without checking value tags.
+ *
+ * Declarations do not convert values (`int x = 1.5;` stores a float), so
+ * a variable is only treated as an int when every assignment to it in its
+ * frame stores an int. Parameters, function results and read() are never
+ * assumed to be ints; anything unproven keeps the generic node.
+ */
+void infer_types(ASTNode *root, int global_count);
+
+#endif /* TYPEINFER_H */
@@ -0,0 +1,19 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+
+/*
+ * The VM keeps yapl calls off the C stack: frames and registers live in
+ * heap arrays that grow as calls nest, so recursion is bounded only by
+ * the depth limit below (--max-depth). Tail calls (return f(...)) reuse
+ * the caller's frame and do not count towards it.
+ */
+#define VM_MAX_CALL_DEPTH 1000000
+
+void vm_set_max_depth(int depth);
+
+/* Run a compiled program on the register VM */
+void vm_execute(BytecodeProgram *program);
+
+#endif /* VM_H */
@@ -0,0 +1,63 @@
+#ifndef YAPL_H
+#define YAPL_H
+
+#include <stddef.h>
+
+/*
+ * Embedding API (libyapl.a).
+ *
+ * A host compiles a program once from a buffer and runs the handle as
+ * often as it likes; every run starts with fresh globals. Program output
+ * is buffered as for the interpreter and handed to the callback set with
+ * yapl_set_output, or written to stdout. A runtime error is reported on
+ * stderr and ends only the run it happened in. read() and friends read
+ * the host's stdin.
+ *
+ * Threads can compile and run programs at the same time: each thread has
+ * its own interpreter state, output buffer and output callback. A program
+ * belongs to the thread that compiled it; run and free it there. Within a
+ * thread, JIT code and memo caches belong to the program run last, so
+ * running programs alternately recompiles their hot functions. Load
+ * extensions before starting threads.
+ *
+ * This header is self-contained and usable from C++.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct YaplProgram YaplProgram;
+
+typedef void (*YaplOutputFn)(const char *text, size_t len, void *ctx);
+
+/* Parse and optimize source. Returns NULL after a syntax error, which is
+ * described in error (if given) as "line N: message". */
+YaplProgram* yapl_compile(const char *source, size_t len, char *error, size_t error_size);
+
+/* Returns 0, or 1 if the run ended with a runtime error. Output is
+ * flushed before returning. */
+int yapl_run(YaplProgram *program);
+
+void yapl_free(YaplProgram *program);
+
+/* fn receives the calling thread's output in chunks; NULL sends it to
+ * stdout again */
+void yapl_set_output(YaplOutputFn fn, void *ctx);
+
+/* Register the native functions of an extension (see yapl_native.h);
+ * returns 0 on success */
+int yapl_load_extension(const char *path);
+
+/* Release what the calling thread holds; free its programs first. Call
+ * before a thread that used the library exits. */
+void yapl_release_thread(void);
+
+/* Release everything the library holds, once every other thread has
+ * released its state; free programs first */
+void yapl_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YAPL_H */
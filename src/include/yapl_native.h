@@ -0,0 +1,75 @@
+#ifndef YAPL_NATIVE_H
+#define YAPL_NATIVE_H
+
+/*
+ * C ABI for native extensions.
+ *
+ * An extension is a shared object, loaded with --load=path.so, that
+ * exports
+ *
+ *     int yapl_extension_init(const YaplHost *host);
+ *
+ * The interpreter calls it once after loading; it registers functions
+ * with host->define and returns 0 on success. Registered functions are
+ * called like builtins (they take precedence over user functions of the
+ * same name). The interpreter checks the argument count and types
+ * before every call, so a function only ever sees the types it declared.
+ *
+ * Matrix arguments are borrowed and must not be written. A matrix result
+ * must come from host->new_matrix or be one of the arguments.
+ *
+ * This header is self-contained so extensions need nothing else from
+ * the interpreter.
+ */
+#define YAPL_NATIVE_ABI_VERSION 1
+#define YAPL_NATIVE_MAX_ARGS 8
+#define YAPL_EXTENSION_INIT "yapl_extension_init"
+
+typedef enum {
+    YAPL_VOID,
+    YAPL_INT,
+    YAPL_FLOAT,     /* As a parameter, ints are converted */
+    YAPL_BOOL,
+    YAPL_MATRIX
+} YaplType;
+
+typedef struct {
+    int rows;
+    int cols;
+    int stride;     /* Element (i, j) is data[i * stride + j] */
+    double *data;
+    void *handle;   /* Owned by the interpreter */
+} YaplMatrix;
+
+typedef struct {
+    YaplType type;
+    union {
+        int i;
+        double f;
+        int b;
+        YaplMatrix m;
+    } as;
+} YaplValue;
+
+typedef struct YaplHost YaplHost;
+
+typedef YaplValue (*YaplNativeFn)(const YaplHost *host, const YaplValue *args, int nargs);
+
+struct YaplHost {
+    int abi_version;
+
+    /* Register a function taking exactly arity arguments of the given
+     * types. Returns 0 on success, -1 if the name is taken or the
+     * signature is invalid. */
+    int (*define)(const char *name, YaplNativeFn fn, int arity, const YaplType *params, YaplType ret);
+
+    /* A zero-filled matrix to return */
+    YaplMatrix (*new_matrix)(int rows, int cols);
+
+    /* Report a runtime error and stop the program */
+    void (*fail)(const char *message);
+};
+
+typedef int (*YaplExtensionInit)(const YaplHost *host);
+
+#endif /* YAPL_NATIVE_H */
@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "input.h"
+#include "matrix_io.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INPUT_BLOCK_SIZE (1 << 20)   /* Bytes per read when draining stdin */
+
+/* Per thread; the stream itself is shared */
+static _Thread_local struct {
+    char *line;
+    size_t capacity;
+} input = { NULL, 0 };
+
+char* input_line(size_t *len) {
+    ssize_t n = getline(&input.line, &input.capacity, stdin);
+    if (n < 0) return NULL;
+    if (n > 0 && input.line[n - 1] == '\n') input.line[--n] = '\0';
+    *len = (size_t)n;
+    return input.line;
+}
+
+static void* grow(void *data, size_t size) {
+    data = realloc(data, size);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return data;
+}
+
+/* Everything left on stdin; data is always NUL-terminated */
+static InputBlock read_stdin(void) {
+    InputBlock block = { NULL, 0, 0 };
+    size_t capacity = INPUT_BLOCK_SIZE;
+    block.data = (char*)grow(NULL, capacity + 1);
+    size_t n;
+    while ((n = fread(block.data + block.len, 1, capacity - block.len, stdin)) > 0) {
+        block.len += n;
+        if (block.len == capacity) {
+            capacity *= 2;
+            block.data = (char*)grow(block.data, capacity + 1);
+        }
+    }
+    block.data[block.len] = '\0';
+    return block;
+}
+
+InputBlock input_map_file(const char *path, const char *caller) {
+    InputBlock block = { NULL, 0, 1 };
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Runtime error: %s() cannot open '%s': %s\n", caller, path, strerror(errno));
+        if (fd >= 0) close(fd);
+        runtime_abort();
+    }
+    block.len = (size_t)st.st_size;
+    if (block.len > 0) {
+        block.data = (char*)mmap(NULL, block.len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (block.data == MAP_FAILED) {
+            fprintf(stderr, "Runtime error: %s() cannot read '%s': %s\n", caller, path, strerror(errno));
+            close(fd);
+            runtime_abort();
+        }
+        madvise(block.data, block.len, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return block;
+}
+
+void input_release(InputBlock *block) {
+    if (block->mapped) {
+        if (block->len > 0) munmap(block->data, block->len);
+    } else {
+        free(block->data);
+    }
+}
+
+Value input_read_all(const char *path) {
+    Value result;
+    result.type = VAL_STRING;
+    if (!path) {
+        /* The heap copy becomes the string itself */
+        result.data.string_val = read_stdin().data;
+        return result;
+    }
+    InputBlock block = input_map_file(path, "readall");
+    result.data.string_val = (char*)grow(NULL, block.len + 1);
+    if (block.len > 0) memcpy(result.data.string_val, block.data, block.len);
+    result.data.string_val[block.len] = '\0';
+    input_release(&block);
+    return result;
+}
+
+Value input_read_matrix(const char *path) {
+    InputBlock block = path ? input_map_file(path, "readm") : read_stdin();
+    Value result;
+    result.type = VAL_MATRIX;
+    result.data.matrix_val = matrix_parse_text(block.data, block.len, "readm");
+    input_release(&block);
+    return result;
+}
+
+const char* input_path(const char *caller, const Value *arg) {
+    if (arg->type != VAL_STRING) {
+        fprintf(stderr, "Runtime error: %s() expects a file name\n", caller);
+        runtime_abort();
+    }
+    return arg->data.string_val;
+}
+
+void input_free(void) {
+    free(input.line);
+    input.line = NULL;
+    input.capacity = 0;
+}
@@ -1,80 +1,107 @@
 #include "interpreter.h"
+#include "resolver.h"
+#include "builtins.h"
+#include "output.h"
+#include "input.h"
+#include "matrix_io.h"
+#include "typeinfer.h"
+#include "jit.h"
+#include "memo.h"
+#include "profile.h"
+#include "regex_cache.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <math.h>
-#include <regex.h>
+#include <setjmp.h>
+#include <sys/mman.h>
 
-static int recursion_depth = 0;
-#define MAX_RECURSION_DEPTH 50
+/* All state of a running program is per thread, so threads can each run
+ * their own programs at the same time. A program stays on the thread that
+ * runs it: the JIT and memo caches it is bound to live here too. */
+static _Thread_local int recursion_depth = 0;
 
-static SymbolTable *global_table = NULL;
+static _Thread_local SymbolTable *global_table = NULL;
+
+/* Call frames live on a stack allocated once per program: one frame
+ * header per recursion level and a slot area big enough for
+ * MAX_RECURSION_DEPTH frames of the largest function. Calls push and pop
+ * frames without touching the heap. */
+static _Thread_local SymbolTable frame_stack[MAX_RECURSION_DEPTH];
+static _Thread_local Value *frame_slots = NULL;
+static _Thread_local int frame_slots_used = 0;
+
+/* Where runtime_abort() unwinds to while run_program() recovers */
+static _Thread_local jmp_buf *abort_target = NULL;
+
+/* The tree the JIT and memo caches were set up for */
+static _Thread_local ASTNode *bound_root = NULL;
 
 
 static Value eval_expression(ASTNode *node, SymbolTable *table);
 static void execute_statement(ASTNode *node, SymbolTable *table);
 
+size_t matrix_stride(int cols) {
+    size_t per_unit = MATRIX_ALIGN / sizeof(double);
+    return (cols + per_unit - 1) / per_unit * per_unit;
+}
+
 Matrix* create_matrix(int rows, int cols) {
-    Matrix *mat = (Matrix*)malloc(sizeof(Matrix));
+    /* Pad rows to whole alignment units and the header likewise, so the
+     * header and zeroed elements share one allocation */
+    size_t stride = matrix_stride(cols);
+    size_t header = (sizeof(Matrix) + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+    size_t bytes = (size_t)rows * stride * sizeof(double);
+
+    Matrix *mat = (Matrix*)aligned_alloc(MATRIX_ALIGN, header + bytes);
+    if (!mat) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
     mat->rows = rows;
     mat->cols = cols;
-    mat->data = (double**)malloc(rows * sizeof(double*));
-    for (int i = 0; i < rows; i++) {
-        mat->data[i] = (double*)calloc(cols, sizeof(double));
-    }
+    mat->stride = (int)stride;
+    mat->refcount = 1;
+    mat->data = (double*)((char*)mat + header);
+    mat->mapping = NULL;
+    mat->mapped_bytes = 0;
+    memset(mat->data, 0, bytes);
     return mat;
 }
 
-void free_matrix(Matrix *mat) {
-    if (!mat) return;
-    for (int i = 0; i < mat->rows; i++) {
-        free(mat->data[i]);
-    }
-    free(mat->data);
-    free(mat);
+Matrix* retain_matrix(Matrix *mat) {
+    mat->refcount++;
+    return mat;
 }
 
-Matrix* matrix_multiply(Matrix *a, Matrix *b) {
-    if (a->cols != b->rows) {
-        fprintf(stderr, "Runtime error: Matrix dimension mismatch for multiplication (%dx%d) @ (%dx%d)\n",
-                a->rows, a->cols, b->rows, b->cols);
-        exit(1);
-    }
-    
-    Matrix *result = create_matrix(a->rows, b->cols);
-    
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < b->cols; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < a->cols; k++) {
-                sum += a->data[i][k] * b->data[k][j];
-            }
-            result->data[i][j] = sum;
-        }
-    }
-    
-    return result;
+void free_matrix(Matrix *mat) {
+    if (!mat || --mat->refcount > 0) return;
+    if (mat->mapping) munmap(mat->mapping, mat->mapped_bytes);
+    free(mat);
 }
 
 void print_matrix(Matrix *mat) {
     if (!mat) return;
     
-    printf("[\n");
+    output_write("[\n", 2);
     for (int i = 0; i < mat->rows; i++) {
-        printf("  [");
+        output_write("  [", 3);
         for (int j = 0; j < mat->cols; j++) {
-            if (mat->data[i][j] == (int)mat->data[i][j]) {
-                printf("%d", (int)mat->data[i][j]);
+            double v = MATRIX_AT(mat, i, j);
+            /* Whole numbers print as ints (the range check keeps the cast defined) */
+            if (v >= INT_MIN && v <= INT_MAX && v == (int)v) {
+                output_int((int)v);
             } else {
-                printf("%g", mat->data[i][j]);
+                output_float(v);
             }
-            if (j < mat->cols - 1) printf(", ");
+            if (j < mat->cols - 1) output_write(", ", 2);
         }
-        printf("]");
-        if (i < mat->rows - 1) printf(",");
-        printf("\n");
+        output_char(']');
+        if (i < mat->rows - 1) output_char(',');
+        output_char('\n');
     }
-    printf("]\n");
+    output_write("]\n", 2);
 }
 
 Value create_int_value(int val) {
@@ -126,34 +153,50 @@ void free_value(Value *val) {
     }
 }
 
+/* Copy a value so that the copy can be freed on its own: strings are
+ * duplicated, matrices gain a reference */
+Value copy_value(Value *val) {
+    Value copy = *val;
+    if (val->type == VAL_STRING) {
+        copy.data.string_val = strdup(val->data.string_val);
+    } else if (val->type == VAL_MATRIX) {
+        copy.data.matrix_val = retain_matrix(val->data.matrix_val);
+    }
+    return copy;
+}
+
 void print_value(Value val) {
     switch (val.type) {
         case VAL_INT:
-            printf("%d", val.data.int_val);
+            output_int(val.data.int_val);
             break;
         case VAL_FLOAT:
-            printf("%g", val.data.float_val);
+            output_float(val.data.float_val);
             break;
         case VAL_STRING:
-            printf("%s", val.data.string_val);
+            output_str(val.data.string_val);
             break;
         case VAL_BOOL:
-            printf("%s", val.data.bool_val ? "true" : "false");
+            output_str(val.data.bool_val ? "true" : "false");
             break;
         case VAL_VOID:
-            printf("void");
+            output_str("void");
             break;
         case VAL_MATRIX:
             print_matrix(val.data.matrix_val);
             break;
         default:
-            printf("(unknown type)");
+            output_str("(unknown type)");
     }
 }
 
-SymbolTable* create_symbol_table(SymbolTable *parent) {
+SymbolTable* create_symbol_table(SymbolTable *parent, int slot_count) {
     SymbolTable *table = (SymbolTable*)malloc(sizeof(SymbolTable));
-    table->head = NULL;
+    table->slots = (Value*)malloc((slot_count > 0 ? slot_count : 1) * sizeof(Value));
+    for (int i = 0; i < slot_count; i++) {
+        table->slots[i].type = VAL_UNDEFINED;
+    }
+    table->slot_count = slot_count;
     table->parent = parent;
     table->is_returning = 0;
     table->return_value = create_void_value();
@@ -161,48 +204,68 @@ SymbolTable* create_symbol_table(SymbolTable *parent) {
 }
 
 void free_symbol_table(SymbolTable *table) {
-    Symbol *current = table->head;
-    while (current) {
-        Symbol *next = current->next;
-        free(current->name);
-        free_value(&current->value);
-        free(current);
-        current = next;
+    for (int i = 0; i < table->slot_count; i++) {
+        free_value(&table->slots[i]);
     }
+    free(table->slots);
     free(table);
 }
 
-void set_symbol(SymbolTable *table, const char *name, Value value) {
-    Symbol *current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            free_value(&current->value);
-            current->value = value;
-            return;
-        }
-        current = current->next;
+static SymbolTable* push_frame(int slot_count) {
+    if (recursion_depth >= MAX_RECURSION_DEPTH) {
+        fprintf(stderr, "Runtime error: Max recursion depth (%d) exceeded\n", MAX_RECURSION_DEPTH);
+        runtime_abort();
     }
-    
-    Symbol *new_symbol = (Symbol*)malloc(sizeof(Symbol));
-    new_symbol->name = strdup(name);
-    new_symbol->value = value;
-    new_symbol->next = table->head;
-    table->head = new_symbol;
+
+    SymbolTable *frame = &frame_stack[recursion_depth++];
+    frame->slots = frame_slots + frame_slots_used;
+    frame->slot_count = slot_count;
+    frame->parent = global_table;
+    frame->is_returning = 0;
+    frame->return_value.type = VAL_VOID;
+    for (int i = 0; i < slot_count; i++) {
+        frame->slots[i].type = VAL_UNDEFINED;
+    }
+    frame_slots_used += slot_count;
+    return frame;
 }
 
-Value* get_symbol(SymbolTable *table, const char *name) {
-    /* Search in current scope */
-    Symbol *current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            return &current->value;
-        }
-        current = current->next;
+static void pop_frame(SymbolTable *frame) {
+    for (int i = 0; i < frame->slot_count; i++) {
+        free_value(&frame->slots[i]);
+    }
+    frame_slots_used -= frame->slot_count;
+    recursion_depth--;
+}
+
+/* The slot a store to ref writes: assignments bind in the current frame,
+ * and code running in the global frame has no frame slot and binds the
+ * global one. Frames never move while they are live, so a loop may hold
+ * on to the pointer. */
+static Value* store_slot(SymbolTable *table, VarRef ref) {
+    if (ref.slot >= 0) return &table->slots[ref.slot];
+    SymbolTable *global = table->parent ? table->parent : table;
+    return &global->slots[ref.global_slot];
+}
+
+void set_symbol(SymbolTable *table, VarRef ref, Value value) {
+    Value *slot = store_slot(table, ref);
+    free_value(slot);
+    *slot = value;
+}
+
+Value* get_symbol(SymbolTable *table, VarRef ref) {
+    /* Search in current frame */
+    if (ref.slot >= 0 && table->slots[ref.slot].type != VAL_UNDEFINED) {
+        return &table->slots[ref.slot];
     }
     
-    /* Search in parent scope */
-    if (table->parent) {
-        return get_symbol(table->parent, name);
+    /* Search in global frame */
+    if (ref.global_slot >= 0) {
+        SymbolTable *global = table->parent ? table->parent : table;
+        if (global->slots[ref.global_slot].type != VAL_UNDEFINED) {
+            return &global->slots[ref.global_slot];
+        }
     }
     
     return NULL;
@@ -215,12 +278,12 @@ static Value builtin_print(ASTNode *args, SymbolTable *table) {
             Value val = eval_expression(args->data.list.items[i], table);
             print_value(val);
             if (i < args->data.list.count - 1) {
-                printf(" ");
+                output_char(' ');
             }
             free_value(&val);
         }
     }
-    printf("\n");
+    output_char('\n');
     return create_void_value();
 }
 
@@ -240,13 +303,75 @@ static Value builtin_printm(ASTNode *args, SymbolTable *table) {
 }
 
 static Value builtin_read(ASTNode *args, SymbolTable *table) {
-    char buffer[1024];
-    if (fgets(buffer, sizeof(buffer), stdin)) {
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len-1] == '\n') {
-            buffer[len-1] = '\0';
-        }
-        
+    return read_input_value();
+}
+
+/* readall() and readm(), with an optional file name */
+static Value builtin_read_block(const Builtin *builtin, ASTNode *args, SymbolTable *table) {
+    int nargs = args ? args->data.list.count : 0;
+    if (nargs > 1) {
+        fprintf(stderr, "Runtime error: %s() expects at most 1 argument, got %d\n", builtin->name, nargs);
+        runtime_abort();
+    }
+    Value path = create_void_value();
+    if (nargs == 1) {
+        path = eval_expression(args->data.list.items[0], table);
+        input_path(builtin->name, &path);
+    }
+    const char *file = nargs == 1 ? path.data.string_val : NULL;
+    Value result = builtin->kind == BUILTIN_READM ? input_read_matrix(file) : input_read_all(file);
+    free_value(&path);
+    return result;
+}
+
+/* loadm(path) and savem(path, m) */
+static Value builtin_matrix_file(const Builtin *builtin, ASTNode *args, SymbolTable *table) {
+    builtin_check_arity(builtin, args ? args->data.list.count : 0);
+    Value path = eval_expression(args->data.list.items[0], table);
+    const char *file = input_path(builtin->name, &path);
+    Value result = create_void_value();
+    if (builtin->kind == BUILTIN_LOADM) {
+        result = matrix_load(file);
+    } else {
+        Value mat = eval_expression(args->data.list.items[1], table);
+        matrix_save(file, &mat);
+        free_value(&mat);
+    }
+    free_value(&path);
+    return result;
+}
+
+static Value builtin_native(const Builtin *builtin, ASTNode *args, SymbolTable *table) {
+    int nargs = args ? args->data.list.count : 0;
+    builtin_check_arity(builtin, nargs);
+    Value argv[YAPL_NATIVE_MAX_ARGS];
+    for (int i = 0; i < nargs; i++) {
+        argv[i] = eval_expression(args->data.list.items[i], table);
+    }
+    Value result = builtin_call_native(builtin, argv, nargs);
+    for (int i = 0; i < nargs; i++) {
+        free_value(&argv[i]);
+    }
+    return result;
+}
+
+/* The limit is computed in 64 bits, so an exclusive range ending at
+ * INT_MIN is empty. A zero step never reaches its limit. */
+unsigned long long range_trip_count(int start, int end, int step, int inclusive) {
+    long long limit = inclusive ? end : (long long)end - 1;
+    if (step == 0) {
+        return start >= limit ? ULLONG_MAX : 0;
+    }
+    if (step > 0) {
+        return start <= limit ? (limit - start) / step + 1 : 0;
+    }
+    return start >= limit ? (start - limit) / -(long long)step + 1 : 0;
+}
+
+Value read_input_value(void) {
+    size_t len;
+    char *buffer = input_line(&len);
+    if (buffer) {
         /* Try to parse as integer */
         char *endptr;
         long val = strtol(buffer, &endptr, 10);
@@ -270,7 +395,7 @@ static Value builtin_read(ASTNode *args, SymbolTable *table) {
 static Value array_literal_to_matrix(ASTNode *node, SymbolTable *table) {
     if (!node || node->type != NODE_ARRAY_LITERAL) {
         fprintf(stderr, "Runtime error: Expected array literal for matrix\n");
-        exit(1);
+        runtime_abort();
     }
     
     int rows = node->data.list.count;
@@ -295,9 +420,9 @@ static Value array_literal_to_matrix(ASTNode *node, SymbolTable *table) {
         for (int j = 0; j < cols; j++) {
             Value elem = eval_expression(node->data.list.items[j], table);
             if (elem.type == VAL_INT) {
-                mat->data[0][j] = elem.data.int_val;
+                MATRIX_AT(mat, 0, j) = elem.data.int_val;
             } else if (elem.type == VAL_FLOAT) {
-                mat->data[0][j] = elem.data.float_val;
+                MATRIX_AT(mat, 0, j) = elem.data.float_val;
             }
             free_value(&elem);
         }
@@ -313,19 +438,19 @@ static Value array_literal_to_matrix(ASTNode *node, SymbolTable *table) {
         ASTNode *row = node->data.list.items[i];
         if (row->type != NODE_ARRAY_LITERAL) {
             fprintf(stderr, "Runtime error: Matrix row must be an array\n");
-            exit(1);
+            runtime_abort();
         }
         if (row->data.list.count != cols) {
             fprintf(stderr, "Runtime error: All matrix rows must have same length\n");
-            exit(1);
+            runtime_abort();
         }
         
         for (int j = 0; j < cols; j++) {
             Value elem = eval_expression(row->data.list.items[j], table);
             if (elem.type == VAL_INT) {
-                mat->data[i][j] = elem.data.int_val;
+                MATRIX_AT(mat, i, j) = elem.data.int_val;
             } else if (elem.type == VAL_FLOAT) {
-                mat->data[i][j] = elem.data.float_val;
+                MATRIX_AT(mat, i, j) = elem.data.float_val;
             }
             free_value(&elem);
         }
@@ -334,280 +459,230 @@ static Value array_literal_to_matrix(ASTNode *node, SymbolTable *table) {
     return mat_val;
 }
 
-/* Evaluate expressions */
-static Value eval_expression(ASTNode *node, SymbolTable *table) {
-    if (!node) return create_void_value();
-    
-    switch (node->type) {
-        case NODE_INT_LITERAL:
-            return create_int_value(node->data.int_literal.value);
-            
-        case NODE_FLOAT_LITERAL:
-            return create_float_value(node->data.float_literal.value);
-            
-        case NODE_STRING_LITERAL:
-            return create_string_value(node->data.string_literal.value);
-            
-        case NODE_BOOL_LITERAL:
-            return create_bool_value(node->data.bool_literal.value);
-            
-        case NODE_ARRAY_LITERAL:
-            return array_literal_to_matrix(node, table);
-            
-        case NODE_IDENTIFIER: {
-            Value *val = get_symbol(table, node->data.identifier.name);
-            if (val) {
-                /* Return a copy */
-                Value copy = *val;
-                if (copy.type == VAL_STRING) {
-                    copy.data.string_val = strdup(val->data.string_val);
-                } else if (copy.type == VAL_MATRIX) {
-                    /* Deep copy matrix */
-                    Matrix *orig = val->data.matrix_val;
-                    Matrix *new_mat = create_matrix(orig->rows, orig->cols);
-                    for (int i = 0; i < orig->rows; i++) {
-                        for (int j = 0; j < orig->cols; j++) {
-                            new_mat->data[i][j] = orig->data[i][j];
-                        }
-                    }
-                    copy.data.matrix_val = new_mat;
-                }
-                return copy;
-            }
-            fprintf(stderr, "Runtime error: Undefined variable '%s'\n", 
-                    node->data.identifier.name);
-            exit(1);
-        }
-        
-        case NODE_ADD: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            Value result;
-            
-            if (left.type == VAL_INT && right.type == VAL_INT) {
-                result = create_int_value(left.data.int_val + right.data.int_val);
-            } else {
-                double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-                double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                result = create_float_value(l + r);
-            }
-            
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
-        
-        case NODE_SUB: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            Value result;
-            
-            if (left.type == VAL_INT && right.type == VAL_INT) {
-                result = create_int_value(left.data.int_val - right.data.int_val);
-            } else {
-                double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-                double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                result = create_float_value(l - r);
-            }
-            
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
-        
+/* Binary operators, shared by the tree walker and the bytecode VM.
+ * Operands are borrowed: the caller still owns (and frees) them. */
+Value eval_binary_op(NodeType op, Value *left, Value *right) {
+    switch (op) {
+        case NODE_ADD:
+        case NODE_SUB:
         case NODE_MUL: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            Value result;
-            
-            if (left.type == VAL_INT && right.type == VAL_INT) {
-                result = create_int_value(left.data.int_val * right.data.int_val);
-            } else {
-                double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-                double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                result = create_float_value(l * r);
+            if (left->type == VAL_INT && right->type == VAL_INT) {
+                int l = left->data.int_val;
+                int r = right->data.int_val;
+                return create_int_value(op == NODE_ADD ? l + r : op == NODE_SUB ? l - r : l * r);
             }
-            
-            free_value(&left);
-            free_value(&right);
-            return result;
+            double l = (left->type == VAL_INT) ? left->data.int_val : left->data.float_val;
+            double r = (right->type == VAL_INT) ? right->data.int_val : right->data.float_val;
+            return create_float_value(op == NODE_ADD ? l + r : op == NODE_SUB ? l - r : l * r);
         }
         
         case NODE_DIV: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            Value result;
-            
-            double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-            double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
+            double l = (left->type == VAL_INT) ? left->data.int_val : left->data.float_val;
+            double r = (right->type == VAL_INT) ? right->data.int_val : right->data.float_val;
             
             if (r == 0) {
                 fprintf(stderr, "Runtime error: Division by zero\n");
-                exit(1);
+                runtime_abort();
             }
-            
-            result = create_float_value(l / r);
-            free_value(&left);
-            free_value(&right);
-            return result;
+            return create_float_value(l / r);
         }
         
-        case NODE_MOD: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            Value result;
-            
-            if (left.type != VAL_INT || right.type != VAL_INT) {
+        case NODE_MOD:
+            if (left->type != VAL_INT || right->type != VAL_INT) {
                 fprintf(stderr, "Runtime error: Modulo operator requires integer operands\n");
-                exit(1);
+                runtime_abort();
             }
-            
-            if (right.data.int_val == 0) {
+            if (right->data.int_val == 0) {
                 fprintf(stderr, "Runtime error: Modulo by zero\n");
-                exit(1);
+                runtime_abort();
             }
-            
-            result = create_int_value(left.data.int_val % right.data.int_val);
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
+            return create_int_value(left->data.int_val % right->data.int_val);
         
         case NODE_MATRIX_MUL: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
-            if (left.type != VAL_MATRIX || right.type != VAL_MATRIX) {
+            if (left->type != VAL_MATRIX || right->type != VAL_MATRIX) {
                 fprintf(stderr, "Runtime error: Matrix multiplication requires matrix operands\n");
-                exit(1);
+                runtime_abort();
             }
-            
-            Matrix *result_mat = matrix_multiply(left.data.matrix_val, right.data.matrix_val);
             Value result;
             result.type = VAL_MATRIX;
-            result.data.matrix_val = result_mat;
-            
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
-        
-        case NODE_LT: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
-            double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-            double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-            
-            Value result = create_bool_value(l < r);
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
-        
-        case NODE_GT: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
-            double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-            double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-            
-            Value result = create_bool_value(l > r);
-            free_value(&left);
-            free_value(&right);
-            return result;
-        }
-        
-        case NODE_LE: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
-            double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-            double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-            
-            Value result = create_bool_value(l <= r);
-            free_value(&left);
-            free_value(&right);
+            result.data.matrix_val = matrix_multiply(left->data.matrix_val, right->data.matrix_val);
             return result;
         }
         
+        case NODE_LT:
+        case NODE_GT:
+        case NODE_LE:
         case NODE_GE: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
+            double l = (left->type == VAL_INT) ? left->data.int_val : left->data.float_val;
+            double r = (right->type == VAL_INT) ? right->data.int_val : right->data.float_val;
             
-            double l = (left.type == VAL_INT) ? left.data.int_val : left.data.float_val;
-            double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-            
-            Value result = create_bool_value(l >= r);
-            free_value(&left);
-            free_value(&right);
-            return result;
+            switch (op) {
+                case NODE_LT: return create_bool_value(l < r);
+                case NODE_GT: return create_bool_value(l > r);
+                case NODE_LE: return create_bool_value(l <= r);
+                default:      return create_bool_value(l >= r);
+            }
         }
         
         case NODE_EQ: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
             int equal = 0;
-            if (left.type == VAL_INT && right.type == VAL_INT) {
-                equal = (left.data.int_val == right.data.int_val);
-            } else if (left.type == VAL_BOOL && right.type == VAL_BOOL) {
-                equal = (left.data.bool_val == right.data.bool_val);
-            } else if (left.type == VAL_STRING && right.type == VAL_STRING) {
-                equal = (strcmp(left.data.string_val, right.data.string_val) == 0);
+            if (left->type == VAL_INT && right->type == VAL_INT) {
+                equal = (left->data.int_val == right->data.int_val);
+            } else if (left->type == VAL_BOOL && right->type == VAL_BOOL) {
+                equal = (left->data.bool_val == right->data.bool_val);
+            } else if (left->type == VAL_STRING && right->type == VAL_STRING) {
+                equal = (strcmp(left->data.string_val, right->data.string_val) == 0);
             }
-            
-            Value result = create_bool_value(equal);
-            free_value(&left);
-            free_value(&right);
-            return result;
+            return create_bool_value(equal);
         }
         
         case NODE_NE: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
             int equal = 0;
-            if (left.type == VAL_INT && right.type == VAL_INT) {
-                equal = (left.data.int_val == right.data.int_val);
-            } else if (left.type == VAL_BOOL && right.type == VAL_BOOL) {
-                equal = (left.data.bool_val == right.data.bool_val);
+            if (left->type == VAL_INT && right->type == VAL_INT) {
+                equal = (left->data.int_val == right->data.int_val);
+            } else if (left->type == VAL_BOOL && right->type == VAL_BOOL) {
+                equal = (left->data.bool_val == right->data.bool_val);
             }
-            
-            Value result = create_bool_value(!equal);
-            free_value(&left);
-            free_value(&right);
-            return result;
+            return create_bool_value(!equal);
         }
         
         case NODE_PATTERN_MATCH: {
-            Value left = eval_expression(node->data.binary_op.left, table);
-            Value right = eval_expression(node->data.binary_op.right, table);
-            
             int matches = 0;
+            if (left->type == VAL_STRING && right->type == VAL_STRING) {
+                matches = regex_match(regex_lookup(right->data.string_val), left->data.string_val);
+            }
+            return create_bool_value(matches);
+        }
+        
+        default:
+            fprintf(stderr, "Runtime error: Unhandled binary operator %d\n", op);
+            return create_void_value();
+    }
+}
+
+/* Evaluate an expression the type pass proved to be an int, without
+ * building Values or checking tags along the way */
+static int eval_int(ASTNode *node, SymbolTable *table) {
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            return node->data.int_literal.value;
+
+        case NODE_IDENTIFIER: {
+            Value *val = get_symbol(table, node->data.identifier.ref);
+            if (!val) {
+                fprintf(stderr, "Runtime error: Undefined variable '%s'\n",
+                        node->data.identifier.name);
+                runtime_abort();
+            }
+            return val->data.int_val;
+        }
+
+        case NODE_INT_ADD:
+            return eval_int(node->data.binary_op.left, table) + eval_int(node->data.binary_op.right, table);
+        case NODE_INT_SUB:
+            return eval_int(node->data.binary_op.left, table) - eval_int(node->data.binary_op.right, table);
+        case NODE_INT_MUL:
+            return eval_int(node->data.binary_op.left, table) * eval_int(node->data.binary_op.right, table);
+
+        case NODE_INT_MOD: {
+            int l = eval_int(node->data.binary_op.left, table);
+            int r = eval_int(node->data.binary_op.right, table);
+            if (r == 0) {
+                fprintf(stderr, "Runtime error: Modulo by zero\n");
+                runtime_abort();
+            }
+            return l % r;
+        }
+
+        default:
+            return eval_expression(node, table).data.int_val;
+    }
+}
+
+/* Evaluate expressions */
+static Value eval_expression(ASTNode *node, SymbolTable *table) {
+    if (!node) return create_void_value();
+    
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            return create_int_value(node->data.int_literal.value);
             
-            if (left.type == VAL_STRING && right.type == VAL_STRING) {
-                regex_t regex;
-                int reti = regcomp(&regex, right.data.string_val, REG_EXTENDED);
-                
-                if (reti == 0) {
-                    reti = regexec(&regex, left.data.string_val, 0, NULL, 0);
-                    matches = (reti == 0);
-                    regfree(&regex);
-                } else {
-                    char error_buf[100];
-                    regerror(reti, &regex, error_buf, sizeof(error_buf));
-                    fprintf(stderr, "Runtime error: Invalid regex pattern: %s\n", error_buf);
-                    regfree(&regex);
+        case NODE_FLOAT_LITERAL:
+            return create_float_value(node->data.float_literal.value);
+            
+        case NODE_STRING_LITERAL:
+            return create_string_value(node->data.string_literal.value);
+            
+        case NODE_BOOL_LITERAL:
+            return create_bool_value(node->data.bool_literal.value);
+            
+        case NODE_ARRAY_LITERAL:
+            return array_literal_to_matrix(node, table);
+            
+        case NODE_IDENTIFIER: {
+            Value *val = get_symbol(table, node->data.identifier.ref);
+            if (val) {
+                return copy_value(val);
+            }
+            fprintf(stderr, "Runtime error: Undefined variable '%s'\n", 
+                    node->data.identifier.name);
+            runtime_abort();
+        }
+        
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MUL:
+        case NODE_DIV:
+        case NODE_MOD:
+        case NODE_MATRIX_MUL:
+        case NODE_LT:
+        case NODE_GT:
+        case NODE_LE:
+        case NODE_GE:
+        case NODE_EQ:
+        case NODE_NE:
+        case NODE_PATTERN_MATCH: {
+            if (node->type == NODE_PATTERN_MATCH &&
+                node->data.binary_op.right->type == NODE_STRING_LITERAL) {
+                /* Literal pattern: compile on first use and keep it on the node */
+                Value text = eval_expression(node->data.binary_op.left, table);
+                int matches = 0;
+                if (text.type == VAL_STRING) {
+                    if (!node->data.binary_op.regex) {
+                        node->data.binary_op.regex =
+                            regex_pin(node->data.binary_op.right->data.string_literal.value);
+                    }
+                    matches = regex_match(node->data.binary_op.regex, text.data.string_val);
                 }
+                free_value(&text);
+                return create_bool_value(matches);
             }
-            
-            Value result = create_bool_value(matches);
+            Value left = eval_expression(node->data.binary_op.left, table);
+            Value right = eval_expression(node->data.binary_op.right, table);
+            Value result = eval_binary_op(node->type, &left, &right);
             free_value(&left);
             free_value(&right);
             return result;
         }
         
+        case NODE_INT_ADD:
+        case NODE_INT_SUB:
+        case NODE_INT_MUL:
+        case NODE_INT_MOD:
+            return create_int_value(eval_int(node, table));
+
+#define INT_COMPARE(node_type, cmp) \
+        case node_type: \
+            return create_bool_value(eval_int(node->data.binary_op.left, table) cmp \
+                                     eval_int(node->data.binary_op.right, table));
+        INT_COMPARE(NODE_INT_LT, <)
+        INT_COMPARE(NODE_INT_GT, >)
+        INT_COMPARE(NODE_INT_LE, <=)
+        INT_COMPARE(NODE_INT_GE, >=)
+        INT_COMPARE(NODE_INT_EQ, ==)
+        INT_COMPARE(NODE_INT_NE, !=)
+#undef INT_COMPARE
+        
         case NODE_AND: {
             Value left = eval_expression(node->data.binary_op.left, table);
             if (!left.data.bool_val) {
@@ -653,11 +728,12 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
         
         case NODE_PRE_INC: {
             if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
-                char *name = node->data.unary_op.operand->data.identifier.name;
-                Value *current = get_symbol(table, name);
+                Atom name = node->data.unary_op.operand->data.identifier.name;
+                VarRef ref = node->data.unary_op.operand->data.identifier.ref;
+                Value *current = get_symbol(table, ref);
                 if (!current) {
                     fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 Value result;
@@ -667,10 +743,10 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                     result = create_float_value(current->data.float_val + 1.0);
                 } else {
                     fprintf(stderr, "Runtime error: Cannot increment non-numeric type\n");
-                    exit(1);
+                    runtime_abort();
                 }
                 
-                set_symbol(table, name, result);
+                set_symbol(table, ref, result);
                 
                 /* Return updated value (copy for safety) */
                 Value ret = result;
@@ -680,16 +756,17 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                 return ret;
             }
             fprintf(stderr, "Runtime error: Pre-increment requires lvalue\n");
-            exit(1);
+            runtime_abort();
         }
         
         case NODE_PRE_DEC: {
             if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
-                char *name = node->data.unary_op.operand->data.identifier.name;
-                Value *current = get_symbol(table, name);
+                Atom name = node->data.unary_op.operand->data.identifier.name;
+                VarRef ref = node->data.unary_op.operand->data.identifier.ref;
+                Value *current = get_symbol(table, ref);
                 if (!current) {
                     fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 Value result;
@@ -699,10 +776,10 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                     result = create_float_value(current->data.float_val - 1.0);
                 } else {
                     fprintf(stderr, "Runtime error: Cannot decrement non-numeric type\n");
-                    exit(1);
+                    runtime_abort();
                 }
                 
-                set_symbol(table, name, result);
+                set_symbol(table, ref, result);
                 
                 /* Return updated value (copy for safety) */
                 Value ret = result;
@@ -712,16 +789,17 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                 return ret;
             }
             fprintf(stderr, "Runtime error: Pre-decrement requires lvalue\n");
-            exit(1);
+            runtime_abort();
         }
         
         case NODE_POST_INC: {
             if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
-                char *name = node->data.unary_op.operand->data.identifier.name;
-                Value *current = get_symbol(table, name);
+                Atom name = node->data.unary_op.operand->data.identifier.name;
+                VarRef ref = node->data.unary_op.operand->data.identifier.ref;
+                Value *current = get_symbol(table, ref);
                 if (!current) {
                     fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 /* Save old value to return */
@@ -732,7 +810,7 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                     old_val = create_float_value(current->data.float_val);
                 } else {
                     fprintf(stderr, "Runtime error: Cannot increment non-numeric type\n");
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 /* Increment variable */
@@ -742,22 +820,23 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                 } else {
                     new_val = create_float_value(current->data.float_val + 1.0);
                 }
-                set_symbol(table, name, new_val);
+                set_symbol(table, ref, new_val);
                 
                 /* Return old value */
                 return old_val;
             }
             fprintf(stderr, "Runtime error: Post-increment requires lvalue\n");
-            exit(1);
+            runtime_abort();
         }
         
         case NODE_POST_DEC: {
             if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
-                char *name = node->data.unary_op.operand->data.identifier.name;
-                Value *current = get_symbol(table, name);
+                Atom name = node->data.unary_op.operand->data.identifier.name;
+                VarRef ref = node->data.unary_op.operand->data.identifier.ref;
+                Value *current = get_symbol(table, ref);
                 if (!current) {
                     fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 /* Save old value to return */
@@ -768,7 +847,7 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                     old_val = create_float_value(current->data.float_val);
                 } else {
                     fprintf(stderr, "Runtime error: Cannot decrement non-numeric type\n");
-                    exit(1);
+                    runtime_abort();
                 }
                 
                 /* Decrement variable */
@@ -778,207 +857,123 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
                 } else {
                     new_val = create_float_value(current->data.float_val - 1.0);
                 }
-                set_symbol(table, name, new_val);
+                set_symbol(table, ref, new_val);
                 
                 /* Return old value */
                 return old_val;
             }
             fprintf(stderr, "Runtime error: Post-decrement requires lvalue\n");
-            exit(1);
+            runtime_abort();
         }
         
         case NODE_ASSIGN: {
             Value val = eval_expression(node->data.binary_op.right, table);
             
             if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
-                char *name = node->data.binary_op.left->data.identifier.name;
-                /* Make a copy for storage */
-                Value store_val = val;
-                if (val.type == VAL_STRING) {
-                    store_val.data.string_val = strdup(val.data.string_val);
-                } else if (val.type == VAL_MATRIX) {
-                    /* Deep copy matrix */
-                    Matrix *orig = val.data.matrix_val;
-                    Matrix *new_mat = create_matrix(orig->rows, orig->cols);
-                    for (int i = 0; i < orig->rows; i++) {
-                        for (int j = 0; j < orig->cols; j++) {
-                            new_mat->data[i][j] = orig->data[i][j];
-                        }
-                    }
-                    store_val.data.matrix_val = new_mat;
-                }
-                set_symbol(table, name, store_val);
+                VarRef ref = node->data.binary_op.left->data.identifier.ref;
+                /* Store a copy; the result of the assignment is returned */
+                set_symbol(table, ref, copy_value(&val));
             }
             
             return val;
         }
         
-        case NODE_PLUS_ASSIGN: {
-            if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
-                char *name = node->data.binary_op.left->data.identifier.name;
-                Value *current = get_symbol(table, name);
-                Value right = eval_expression(node->data.binary_op.right, table);
-                
-                Value result;
-                if (current->type == VAL_INT && right.type == VAL_INT) {
-                    result = create_int_value(current->data.int_val + right.data.int_val);
-                } else {
-                    double l = (current->type == VAL_INT) ? current->data.int_val : current->data.float_val;
-                    double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                    result = create_float_value(l + r);
-                }
-                
-                set_symbol(table, name, result);
-                free_value(&right);
-                
-                Value ret = result;
-                if (ret.type == VAL_STRING) {
-                    ret.data.string_val = strdup(result.data.string_val);
-                }
-                return ret;
-            }
-            return create_void_value();
-        }
-        
-        case NODE_MINUS_ASSIGN: {
-            if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
-                char *name = node->data.binary_op.left->data.identifier.name;
-                Value *current = get_symbol(table, name);
-                Value right = eval_expression(node->data.binary_op.right, table);
-                
-                Value result;
-                if (current->type == VAL_INT && right.type == VAL_INT) {
-                    result = create_int_value(current->data.int_val - right.data.int_val);
-                } else {
-                    double l = (current->type == VAL_INT) ? current->data.int_val : current->data.float_val;
-                    double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                    result = create_float_value(l - r);
-                }
-                
-                set_symbol(table, name, result);
-                free_value(&right);
-                
-                Value ret = result;
-                if (ret.type == VAL_STRING) {
-                    ret.data.string_val = strdup(result.data.string_val);
-                }
-                return ret;
-            }
-            return create_void_value();
-        }
-        
-        case NODE_MUL_ASSIGN: {
-            if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
-                char *name = node->data.binary_op.left->data.identifier.name;
-                Value *current = get_symbol(table, name);
-                Value right = eval_expression(node->data.binary_op.right, table);
-                
-                Value result;
-                if (current->type == VAL_INT && right.type == VAL_INT) {
-                    result = create_int_value(current->data.int_val * right.data.int_val);
-                } else {
-                    double l = (current->type == VAL_INT) ? current->data.int_val : current->data.float_val;
-                    double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
-                    result = create_float_value(l * r);
-                }
-                
-                set_symbol(table, name, result);
-                free_value(&right);
-                
-                Value ret = result;
-                if (ret.type == VAL_STRING) {
-                    ret.data.string_val = strdup(result.data.string_val);
-                }
-                return ret;
-            }
-            return create_void_value();
-        }
-        
+        case NODE_PLUS_ASSIGN:
+        case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN:
         case NODE_DIV_ASSIGN: {
             if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
-                char *name = node->data.binary_op.left->data.identifier.name;
-                Value *current = get_symbol(table, name);
+                Atom name = node->data.binary_op.left->data.identifier.name;
+                VarRef ref = node->data.binary_op.left->data.identifier.ref;
+                Value *current = get_symbol(table, ref);
+                if (!current) {
+                    fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
+                    runtime_abort();
+                }
                 Value right = eval_expression(node->data.binary_op.right, table);
                 
-                double l = (current->type == VAL_INT) ? current->data.int_val : current->data.float_val;
-                double r = (right.type == VAL_INT) ? right.data.int_val : right.data.float_val;
+                NodeType op = node->type == NODE_PLUS_ASSIGN ? NODE_ADD :
+                              node->type == NODE_MINUS_ASSIGN ? NODE_SUB :
+                              node->type == NODE_MUL_ASSIGN ? NODE_MUL : NODE_DIV;
+                Value result = eval_binary_op(op, current, &right);
                 
-                if (r == 0) {
-                    fprintf(stderr, "Runtime error: Division by zero\n");
-                    exit(1);
-                }
-                
-                Value result = create_float_value(l / r);
-                set_symbol(table, name, result);
+                set_symbol(table, ref, result);
                 free_value(&right);
-                
-                Value ret = result;
-                if (ret.type == VAL_STRING) {
-                    ret.data.string_val = strdup(result.data.string_val);
-                }
-                return ret;
+                return result;
             }
             return create_void_value();
         }
         
         case NODE_FUNC_CALL: {
             if (node->data.func_call.func->type == NODE_IDENTIFIER) {
-                char *func_name = node->data.func_call.func->data.identifier.name;
+                Atom func_name = node->data.func_call.func->data.identifier.name;
                 
                 /* Check built-ins first */
-                if (strcmp(func_name, "print") == 0) return builtin_print(node->data.func_call.args, table);
-                if (strcmp(func_name, "printm") == 0) return builtin_printm(node->data.func_call.args, table);
-                if (strcmp(func_name, "read") == 0) return builtin_read(node->data.func_call.args, table);
+                const Builtin *builtin = node->data.func_call.builtin;
+                if (builtin) {
+                    switch (builtin->kind) {
+                        case BUILTIN_PRINT:  return builtin_print(node->data.func_call.args, table);
+                        case BUILTIN_PRINTM: return builtin_printm(node->data.func_call.args, table);
+                        case BUILTIN_READ:   return builtin_read(node->data.func_call.args, table);
+                        case BUILTIN_READALL:
+                        case BUILTIN_READM:  return builtin_read_block(builtin, node->data.func_call.args, table);
+                        case BUILTIN_LOADM:
+                        case BUILTIN_SAVEM:  return builtin_matrix_file(builtin, node->data.func_call.args, table);
+                        case BUILTIN_NATIVE: return builtin_native(builtin, node->data.func_call.args, table);
+                    }
+                }
 
                 /* Lookup user-defined function */
-                Value *val = get_symbol(table, func_name);
+                Value *val = get_symbol(table, node->data.func_call.func->data.identifier.ref);
                 if (!val || val->type != VAL_FUNC) {
                     fprintf(stderr, "Runtime error: Undefined function '%s'\n", func_name);
-                    exit(1);
-                }
-
-                /* Check recursion limit */
-                if (recursion_depth >= MAX_RECURSION_DEPTH) {
-                    fprintf(stderr, "Runtime error: Max recursion depth (%d) exceeded\n", MAX_RECURSION_DEPTH);
-                    exit(1);
+                    runtime_abort();
                 }
 
                 ASTNode *func_decl = val->data.func_node;
                 ASTNode *params = func_decl->data.func_decl.params;
                 ASTNode *args = node->data.func_call.args;
                 
-                /* Create new scope */
-                SymbolTable *func_scope = create_symbol_table(global_table);
-                recursion_depth++;
+                /* Push a frame for the callee (checks the recursion limit) */
+                SymbolTable *func_scope = push_frame(func_decl->data.func_decl.num_slots);
 
                 /* Bind arguments to parameters */
                 if (params && args) {
                     for (int i = 0; i < params->data.list.count && i < args->data.list.count; i++) {
                         Value arg_val = eval_expression(args->data.list.items[i], table);
-                        set_symbol(func_scope, params->data.list.items[i]->data.param.name, arg_val);
+                        set_symbol(func_scope, params->data.list.items[i]->data.param.ref, arg_val);
                     }
                 }
 
+                if (profile_enabled) profile_enter(func_decl);
+
+                /* Pure functions answer repeated calls from their cache */
+                MemoCache *memo = func_decl->data.func_decl.memo;
+                int nargs = args ? args->data.list.count : 0;
+                MemoKey key;
+                Value result;
+                if (memo && memo_lookup(memo, func_scope->slots, nargs, &key, &result)) {
+                    pop_frame(func_scope);
+                    if (profile_enabled) profile_exit();
+                    return result;
+                }
+
+                /* Hot functions run as native code once compiled */
+                if (!memo && jit_call(func_decl, func_scope->slots, nargs, &result)) {
+                    pop_frame(func_scope);
+                    if (profile_enabled) profile_exit();
+                    return result;
+                }
+
                 /* Execute body */
                 execute_statement(func_decl->data.func_decl.body, func_scope);
                 
-                Value result = func_scope->return_value;
-                /* Copy string/matrix result if necessary */
-                if (result.type == VAL_STRING) {
-                    result.data.string_val = strdup(result.data.string_val);
-                } else if (result.type == VAL_MATRIX) {
-                    Matrix *orig = result.data.matrix_val;
-                    Matrix *new_mat = create_matrix(orig->rows, orig->cols);
-                    for (int i = 0; i < orig->rows; i++) {
-                        for (int j = 0; j < orig->cols; j++) {
-                            new_mat->data[i][j] = orig->data[i][j];
-                        }
-                    }
-                    result.data.matrix_val = new_mat;
-                }
+                /* The return value is owned by the frame; hand it to the caller */
+                result = func_scope->return_value;
+                if (memo) memo_store(memo, &key, &result);
                 
-                free_symbol_table(func_scope);
-                recursion_depth--;
+                pop_frame(func_scope);
+                if (profile_enabled) profile_exit();
                 return result;
             }
         }
@@ -991,6 +986,9 @@ static Value eval_expression(ASTNode *node, SymbolTable *table) {
 
 static void execute_statement(ASTNode *node, SymbolTable *table) {
     if (!node || table->is_returning) return;
+    if (profile_enabled && node->type != NODE_COMPOUND && node->type != NODE_STMT_LIST) {
+        profile_line(node->line_number);
+    }
     
     switch (node->type) {
         case NODE_EXPR_STMT:
@@ -1026,7 +1024,7 @@ static void execute_statement(ASTNode *node, SymbolTable *table) {
                         val = create_void_value();
                 }
             }
-            set_symbol(table, node->data.var_decl.name, val);
+            set_symbol(table, node->data.var_decl.ref, val);
             break;
         }
         
@@ -1043,7 +1041,8 @@ static void execute_statement(ASTNode *node, SymbolTable *table) {
         }
         
         case NODE_WHILE: {
-            while (1) {
+            /* Stop once the body returns, without re-testing the condition */
+            while (!table->is_returning) {
                 Value cond = eval_expression(node->data.while_stmt.condition, table);
                 int should_continue = cond.data.bool_val || cond.data.int_val;
                 free_value(&cond);
@@ -1076,13 +1075,21 @@ static void execute_statement(ASTNode *node, SymbolTable *table) {
             
             /* Determine if inclusive or exclusive */
             int inclusive = (range->type == NODE_RANGE_INCL || range->type == NODE_RANGE_STEP);
-            int limit = inclusive ? end : end - 1;
             
-            /* Execute loop */
-            char *iterator = node->data.for_range.iterator;
-            for (int i = start; (step > 0 ? i <= limit : i >= limit); i += step) {
-                set_symbol(table, iterator, create_int_value(i));
-                execute_statement(node->data.for_range.body, table);
+            /* Counted loop: the trip count is fixed up front and the
+             * iterator's slot is written directly each iteration */
+            unsigned long long trips = range_trip_count(start, end, step, inclusive);
+            
+            Value *iterator = store_slot(table, node->data.for_range.ref);
+            ASTNode *body = node->data.for_range.body;
+            long long i = start;
+            for (; trips > 0 && !table->is_returning; trips--, i += step) {
+                if (iterator->type != VAL_INT) {
+                    free_value(iterator);
+                    iterator->type = VAL_INT;
+                }
+                iterator->data.int_val = (int)i;
+                execute_statement(body, table);
             }
             break;
         }
@@ -1107,13 +1114,72 @@ static void execute_statement(ASTNode *node, SymbolTable *table) {
     }
 }
 
-/* Execute program */
-void execute_program(ASTNode *root) {
-    if (!root) return;
-    
-    global_table = create_symbol_table(NULL);
+void runtime_abort(void) {
+    if (abort_target) longjmp(*abort_target, 1);
+    exit(1);
+}
+
+int prepare_program(ASTNode *root) {
+    if (!root) return 0;
+    int global_count = resolve_program(root);
+    infer_types(root, global_count);
+    return global_count;
+}
+
+void release_program(ASTNode *root) {
+    if (!root || root != bound_root) return;
+    jit_free();
+    memo_init(NULL);
+    bound_root = NULL;
+}
+
+/* Drop the frames and globals of a run cut short by runtime_abort() */
+static void discard_run(void) {
+    for (int i = 0; i < frame_slots_used; i++) {
+        free_value(&frame_slots[i]);
+    }
+    frame_slots_used = 0;
+    recursion_depth = 0;
+    if (global_table) free_symbol_table(global_table);
+    global_table = NULL;
+    free(frame_slots);
+    frame_slots = NULL;
+}
+
+int run_program(ASTNode *root, int global_count, int recover) {
+    if (!root) return 0;
+
+    jmp_buf target;
+    if (recover) {
+        if (setjmp(target)) {
+            abort_target = NULL;
+            discard_run();
+            return 1;
+        }
+        abort_target = &target;
+    }
+
+    /* Native code and result caches belong to one tree at a time */
+    if (root != bound_root) {
+        release_program(bound_root);
+        memo_init(root);
+        jit_init(root, &recursion_depth, MAX_RECURSION_DEPTH);
+        bound_root = root;
+    }
+    profile_start(root);
+    global_table = create_symbol_table(NULL, global_count);
     
     if (root->type == NODE_DECL_LIST) {
+        int max_slots = 0;
+        for (int i = 0; i < root->data.list.count; i++) {
+            ASTNode *decl = root->data.list.items[i];
+            if (decl->type == NODE_FUNC_DECL && decl->data.func_decl.num_slots > max_slots) {
+                max_slots = decl->data.func_decl.num_slots;
+            }
+        }
+        frame_slots = (Value*)malloc((MAX_RECURSION_DEPTH * max_slots + 1) * sizeof(Value));
+        frame_slots_used = 0;
+
         for (int i = 0; i < root->data.list.count; i++) {
             ASTNode *decl = root->data.list.items[i];
             
@@ -1122,7 +1188,8 @@ void execute_program(ASTNode *root) {
                 Value func_val;
                 func_val.type = VAL_FUNC;
                 func_val.data.func_node = decl;
-                set_symbol(global_table, decl->data.func_decl.name, func_val);
+                VarRef ref = { -1, decl->data.func_decl.slot };
+                set_symbol(global_table, ref, func_val);
             } else {
                 /* Execute top-level statements */
                 execute_statement(decl, global_table);
@@ -1130,12 +1197,29 @@ void execute_program(ASTNode *root) {
         }
         
         /* If main function exists, execute it */
-        Value *main_val = get_symbol(global_table, "main");
+        Value *main_val = NULL;
+        for (int i = 0; i < root->data.list.count; i++) {
+            ASTNode *decl = root->data.list.items[i];
+            if (decl->type == NODE_FUNC_DECL && decl->data.func_decl.name == atom_main) {
+                main_val = &global_table->slots[decl->data.func_decl.slot];
+                break;
+            }
+        }
         if (main_val && main_val->type == VAL_FUNC) {
             ASTNode *main_func = main_val->data.func_node;
             execute_statement(main_func->data.func_decl.body, global_table);
         }
     }
+    profile_stop();
     
     free_symbol_table(global_table);
+    global_table = NULL;
+    free(frame_slots);
+    frame_slots = NULL;
+    abort_target = NULL;
+    return 0;
+}
+
+void execute_program(ASTNode *root) {
+    run_program(root, prepare_program(root), 0);
 }
\ No newline at end of file
@@ -0,0 +1,1435 @@
+#include "jit.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Code generation is a simple stack machine over the AST. Every variable
+ * has an 8-byte home in the native frame at [rbp - 8 * (slot + 1)], using
+ * the slots the resolver assigned. Expressions leave ints and bools in eax
+ * and floats in xmm0; the left operand of a binary operation waits on the
+ * machine stack while the right one is computed.
+ *
+ * Native functions take one argument, a pointer to their arguments stored
+ * as raw 8-byte values with the last argument first (the order a caller
+ * pushes them), and return the raw result in rax.
+ */
+
+#if defined(__x86_64__) && defined(__unix__) && !defined(YAPL_NO_JIT)
+#define JIT_AVAILABLE 1
+#include <sys/mman.h>
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+typedef int64_t (*JitEntry)(const int64_t *args);
+
+/* Static types the compiler tracks; KIND_NONE means not known yet */
+typedef enum {
+    KIND_NONE,
+    KIND_INT,
+    KIND_FLOAT,
+    KIND_BOOL
+} Kind;
+
+typedef enum {
+    JIT_COLD,        /* Interpreted, counting calls */
+    JIT_PENDING,     /* Being compiled as part of a unit */
+    JIT_COMPILED,
+    JIT_REJECTED
+} JitState;
+
+struct JitFunction {
+    ASTNode *decl;
+    JitState state;
+    int calls;              /* Interpreted calls so far */
+    long entries;           /* Calls from the interpreter that ran natively */
+    int num_params;
+    int num_slots;
+    Kind *slot_kinds;       /* Parameters first; they form the signature */
+    Kind ret_kind;
+    JitEntry code;
+    size_t code_size;
+    size_t offset;          /* Within its unit while being compiled */
+    char reason[128];       /* Why it was rejected */
+};
+
+/* Functions compiled together: the hot one and everything it calls */
+typedef struct {
+    JitFunction **fns;
+    int count;
+    int capacity;
+    int failed;
+    JitFunction *blame;
+    char reason[128];
+} JitUnit;
+
+typedef struct {
+    void *base;
+    size_t size;
+} CodeRegion;
+
+/* Set once, before any program runs */
+static int jit_enabled = 1;
+
+/* Native code and call counts of the program the thread runs */
+static _Thread_local struct {
+    int threshold;
+    int *call_depth;
+    int max_depth;
+    JitFunction *fns;       /* One per function declaration */
+    int fn_count;
+    CodeRegion *regions;
+    int region_count;
+    size_t code_bytes;
+} jit = { JIT_HOT_CALLS, NULL, 0, NULL, 0, NULL, 0, 0 };
+
+void jit_set_enabled(int enabled) {
+    jit_enabled = enabled;
+}
+
+static const char* kind_name(Kind kind) {
+    switch (kind) {
+        case KIND_INT:   return "int";
+        case KIND_FLOAT: return "float";
+        case KIND_BOOL:  return "bool";
+        default:         return "?";
+    }
+}
+
+static Kind value_kind(const Value *val) {
+    switch (val->type) {
+        case VAL_INT:   return KIND_INT;
+        case VAL_FLOAT: return KIND_FLOAT;
+        case VAL_BOOL:  return KIND_BOOL;
+        default:        return KIND_NONE;
+    }
+}
+
+/* ---------- Setup ---------- */
+
+void jit_init(ASTNode *root, int *call_depth, int max_depth) {
+    jit.call_depth = call_depth;
+    jit.max_depth = max_depth;
+    if (!jit_enabled || !JIT_AVAILABLE || !root || root->type != NODE_DECL_LIST) return;
+
+    const char *env = getenv("YAPL_JIT_THRESHOLD");
+    if (env) jit.threshold = atoi(env) > 0 ? atoi(env) : 1;
+
+    int count = 0;
+    for (int i = 0; i < root->data.list.count; i++) {
+        if (root->data.list.items[i]->type == NODE_FUNC_DECL) count++;
+    }
+    jit.fns = (JitFunction*)calloc(count > 0 ? count : 1, sizeof(JitFunction));
+    if (!jit.fns) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL) continue;
+
+        JitFunction *fn = &jit.fns[jit.fn_count++];
+        ASTNode *params = decl->data.func_decl.params;
+        fn->decl = decl;
+        fn->state = JIT_COLD;
+        fn->num_params = params ? params->data.list.count : 0;
+        fn->num_slots = decl->data.func_decl.num_slots;
+        fn->slot_kinds = (Kind*)calloc(fn->num_slots > 0 ? fn->num_slots : 1, sizeof(Kind));
+        if (!fn->slot_kinds) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        decl->data.func_decl.jit = fn;
+    }
+}
+
+/* The function a call by this name always reaches, or NULL; calls are
+ * bound statically, so the name must keep referring to one function */
+static JitFunction* find_callee(Atom name) {
+    for (int i = 0; i < jit.fn_count; i++) {
+        ASTNode *decl = jit.fns[i].decl;
+        if (decl->data.func_decl.name == name) {
+            return decl->data.func_decl.fixed ? &jit.fns[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* ---------- Type analysis ---------- */
+
+typedef struct {
+    JitUnit *unit;
+    JitFunction *fn;
+    int strict;         /* Final pass: everything must be known */
+    int changed;
+    char *assigned;     /* Strict pass: slots definitely assigned so far */
+} Analysis;
+
+static void reject(Analysis *a, const char *fmt, ...) {
+    if (a->unit->failed) return;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(a->unit->reason, sizeof(a->unit->reason), fmt, args);
+    va_end(args);
+    a->unit->failed = 1;
+    a->unit->blame = a->fn;
+}
+
+static void unit_add(JitUnit *unit, JitFunction *fn) {
+    if (unit->count >= unit->capacity) {
+        unit->capacity = unit->capacity == 0 ? 8 : unit->capacity * 2;
+        unit->fns = (JitFunction**)realloc(unit->fns, unit->capacity * sizeof(JitFunction*));
+        if (!unit->fns) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    unit->fns[unit->count++] = fn;
+    fn->state = JIT_PENDING;
+}
+
+static void unify(Analysis *a, Kind *slot, Kind kind, Atom name) {
+    if (kind == KIND_NONE) return;
+    if (*slot == KIND_NONE) {
+        *slot = kind;
+        a->changed = 1;
+    } else if (*slot != kind) {
+        reject(a, "'%s' holds both %s and %s values", name, kind_name(*slot), kind_name(kind));
+    }
+}
+
+/* Both operands of an arithmetic operator must be numbers */
+static Kind arithmetic_kind(Analysis *a, NodeType op, Kind left, Kind right) {
+    if (left == KIND_NONE || right == KIND_NONE) return KIND_NONE;
+    if (left == KIND_BOOL || right == KIND_BOOL) {
+        reject(a, "does arithmetic on a bool");
+        return KIND_NONE;
+    }
+    if (op == NODE_MOD && (left != KIND_INT || right != KIND_INT)) {
+        reject(a, "uses %% on a float");
+        return KIND_NONE;
+    }
+    if (op == NODE_DIV) return KIND_FLOAT;
+    return left == KIND_INT && right == KIND_INT ? KIND_INT : KIND_FLOAT;
+}
+
+static NodeType base_op(NodeType type) {
+    switch (type) {
+        case NODE_INT_ADD: case NODE_PLUS_ASSIGN:  return NODE_ADD;
+        case NODE_INT_SUB: case NODE_MINUS_ASSIGN: return NODE_SUB;
+        case NODE_INT_MUL: case NODE_MUL_ASSIGN:   return NODE_MUL;
+        case NODE_DIV_ASSIGN: return NODE_DIV;
+        case NODE_INT_MOD: return NODE_MOD;
+        case NODE_INT_LT:  return NODE_LT;
+        case NODE_INT_GT:  return NODE_GT;
+        case NODE_INT_LE:  return NODE_LE;
+        case NODE_INT_GE:  return NODE_GE;
+        case NODE_INT_EQ:  return NODE_EQ;
+        case NODE_INT_NE:  return NODE_NE;
+        default:           return type;
+    }
+}
+
+/* Slot of a local variable reference, or -1 after rejecting the function */
+static int local_slot(Analysis *a, ASTNode *ident, int reading) {
+    if (ident->type != NODE_IDENTIFIER) {
+        reject(a, "assigns to something other than a variable");
+        return -1;
+    }
+    int slot = ident->data.identifier.ref.slot;
+    if (slot < 0) {
+        reject(a, "uses global '%s'", ident->data.identifier.name);
+        return -1;
+    }
+    if (reading && a->strict && !a->assigned[slot]) {
+        reject(a, "may read '%s' before assigning it", ident->data.identifier.name);
+        return -1;
+    }
+    return slot;
+}
+
+static void mark_assigned(Analysis *a, int slot) {
+    if (a->assigned) a->assigned[slot] = 1;
+}
+
+static Kind analyze_expr(Analysis *a, ASTNode *node);
+
+static Kind analyze_call(Analysis *a, ASTNode *node) {
+    ASTNode *func = node->data.func_call.func;
+    ASTNode *args = node->data.func_call.args;
+    if (func->type != NODE_IDENTIFIER) {
+        reject(a, "calls a computed function");
+        return KIND_NONE;
+    }
+    Atom name = func->data.identifier.name;
+    if (node->data.func_call.builtin) {
+        reject(a, "calls %s", name);
+        return KIND_NONE;
+    }
+    JitFunction *target = func->data.identifier.ref.slot < 0 ? find_callee(name) : NULL;
+    if (!target) {
+        reject(a, "calls '%s', which is not a fixed function", name);
+        return KIND_NONE;
+    }
+    /* Native calls would bypass the cache */
+    if (target->decl->data.func_decl.memo) {
+        reject(a, "calls '%s', which is memoized", name);
+        return KIND_NONE;
+    }
+    int nargs = args ? args->data.list.count : 0;
+    if (nargs != target->num_params) {
+        reject(a, "calls '%s' with %d arguments", name, nargs);
+        return KIND_NONE;
+    }
+
+    Kind kinds[nargs > 0 ? nargs : 1];
+    int known = 1;
+    for (int i = 0; i < nargs; i++) {
+        kinds[i] = analyze_expr(a, args->data.list.items[i]);
+        if (kinds[i] == KIND_NONE) known = 0;
+    }
+    if (!known || a->unit->failed) return KIND_NONE;
+
+    switch (target->state) {
+        case JIT_REJECTED:
+            reject(a, "calls '%s', which cannot be compiled", name);
+            return KIND_NONE;
+        case JIT_COLD:
+            for (int i = 0; i < nargs; i++) target->slot_kinds[i] = kinds[i];
+            unit_add(a->unit, target);
+            a->changed = 1;
+            return KIND_NONE;
+        default:
+            for (int i = 0; i < nargs; i++) {
+                if (target->slot_kinds[i] != kinds[i]) {
+                    reject(a, "calls '%s' with differently typed arguments", name);
+                    return KIND_NONE;
+                }
+            }
+            return target->ret_kind;
+    }
+}
+
+static Kind analyze_expr_inner(Analysis *a, ASTNode *node) {
+    NodeType op = base_op(node->type);
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:   return KIND_INT;
+        case NODE_FLOAT_LITERAL: return KIND_FLOAT;
+        case NODE_BOOL_LITERAL:  return KIND_BOOL;
+
+        case NODE_IDENTIFIER: {
+            int slot = local_slot(a, node, 1);
+            return slot < 0 ? KIND_NONE : a->fn->slot_kinds[slot];
+        }
+
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD: {
+            Kind left = analyze_expr(a, node->data.binary_op.left);
+            Kind right = analyze_expr(a, node->data.binary_op.right);
+            return arithmetic_kind(a, op, left, right);
+        }
+
+        case NODE_LT: case NODE_GT: case NODE_LE: case NODE_GE:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE: {
+            Kind left = analyze_expr(a, node->data.binary_op.left);
+            Kind right = analyze_expr(a, node->data.binary_op.right);
+            if (left == KIND_NONE || right == KIND_NONE) return KIND_NONE;
+            if (left == KIND_BOOL || right == KIND_BOOL) {
+                reject(a, "orders bools");
+                return KIND_NONE;
+            }
+            return KIND_BOOL;
+        }
+
+        case NODE_EQ: case NODE_NE: case NODE_INT_EQ: case NODE_INT_NE: {
+            Kind left = analyze_expr(a, node->data.binary_op.left);
+            Kind right = analyze_expr(a, node->data.binary_op.right);
+            return left == KIND_NONE || right == KIND_NONE ? KIND_NONE : KIND_BOOL;
+        }
+
+        case NODE_AND:
+        case NODE_OR: {
+            Kind left = analyze_expr(a, node->data.binary_op.left);
+            /* The right operand may not run */
+            char *saved = NULL;
+            if (a->assigned) {
+                saved = (char*)malloc(a->fn->num_slots + 1);
+                memcpy(saved, a->assigned, a->fn->num_slots);
+            }
+            Kind right = analyze_expr(a, node->data.binary_op.right);
+            if (saved) {
+                memcpy(a->assigned, saved, a->fn->num_slots);
+                free(saved);
+            }
+            if (left == KIND_NONE || right == KIND_NONE) return KIND_NONE;
+            if (left == KIND_FLOAT || right == KIND_FLOAT) {
+                reject(a, "uses a float as a condition");
+                return KIND_NONE;
+            }
+            return KIND_BOOL;
+        }
+
+        case NODE_NOT: {
+            Kind operand = analyze_expr(a, node->data.unary_op.operand);
+            if (operand == KIND_FLOAT) {
+                reject(a, "uses a float as a condition");
+                return KIND_NONE;
+            }
+            return operand == KIND_NONE ? KIND_NONE : KIND_BOOL;
+        }
+
+        case NODE_UNARY_MINUS: {
+            Kind operand = analyze_expr(a, node->data.unary_op.operand);
+            if (operand == KIND_BOOL) {
+                reject(a, "negates a bool");
+                return KIND_NONE;
+            }
+            return operand;
+        }
+
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC: {
+            int slot = local_slot(a, node->data.unary_op.operand, 1);
+            if (slot < 0) return KIND_NONE;
+            if (a->fn->slot_kinds[slot] == KIND_BOOL) {
+                reject(a, "increments a bool");
+                return KIND_NONE;
+            }
+            return a->fn->slot_kinds[slot];
+        }
+
+        case NODE_ASSIGN: {
+            Kind value = analyze_expr(a, node->data.binary_op.right);
+            int slot = local_slot(a, node->data.binary_op.left, 0);
+            if (slot < 0) return KIND_NONE;
+            unify(a, &a->fn->slot_kinds[slot], value, node->data.binary_op.left->data.identifier.name);
+            mark_assigned(a, slot);
+            return value;
+        }
+
+        case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN: {
+            Kind right = analyze_expr(a, node->data.binary_op.right);
+            int slot = local_slot(a, node->data.binary_op.left, 1);
+            if (slot < 0) return KIND_NONE;
+            Kind result = arithmetic_kind(a, op, a->fn->slot_kinds[slot], right);
+            unify(a, &a->fn->slot_kinds[slot], result, node->data.binary_op.left->data.identifier.name);
+            return result;
+        }
+
+        case NODE_FUNC_CALL:
+            return analyze_call(a, node);
+
+        case NODE_STRING_LITERAL:
+            reject(a, "uses strings");
+            return KIND_NONE;
+
+        default:
+            reject(a, "uses %s", node_type_to_string(node->type));
+            return KIND_NONE;
+    }
+}
+
+static Kind analyze_expr(Analysis *a, ASTNode *node) {
+    if (a->unit->failed) return KIND_NONE;
+    Kind kind = analyze_expr_inner(a, node);
+    if (kind == KIND_NONE && a->strict) {
+        reject(a, "has an expression of unknown type");
+    }
+    return kind;
+}
+
+static void analyze_condition(Analysis *a, ASTNode *cond) {
+    if (analyze_expr(a, cond) == KIND_FLOAT) {
+        reject(a, "uses a float as a condition");
+    }
+}
+
+/* Whether executing node always ends in a return */
+static int always_returns(ASTNode *node) {
+    if (!node) return 0;
+    switch (node->type) {
+        case NODE_RETURN:
+            return 1;
+        case NODE_IF_ELSE:
+            return always_returns(node->data.if_stmt.then_stmt) &&
+                   always_returns(node->data.if_stmt.else_stmt);
+        case NODE_STMT_LIST:
+            for (int i = 0; i < node->data.list.count; i++) {
+                if (always_returns(node->data.list.items[i])) return 1;
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static void analyze_stmt(Analysis *a, ASTNode *node);
+
+/* Analyze a statement that may not run; afterwards only what was assigned
+ * before it counts as assigned, or everything if it never falls through */
+static void analyze_branch(Analysis *a, ASTNode *node, char *out) {
+    int n = a->fn->num_slots;
+    char *before = NULL;
+    if (a->assigned) {
+        before = (char*)malloc(n + 1);
+        memcpy(before, a->assigned, n);
+    }
+    analyze_stmt(a, node);
+    if (before) {
+        if (out) {
+            if (always_returns(node)) memset(out, 1, n);
+            else memcpy(out, a->assigned, n);
+        }
+        memcpy(a->assigned, before, n);
+        free(before);
+    }
+}
+
+static void analyze_stmt(Analysis *a, ASTNode *node) {
+    if (!node || a->unit->failed) return;
+    int n = a->fn->num_slots;
+
+    switch (node->type) {
+        case NODE_STMT_LIST:
+            for (int i = 0; i < node->data.list.count; i++) {
+                analyze_stmt(a, node->data.list.items[i]);
+            }
+            break;
+
+        case NODE_EXPR_STMT:
+            if (node->data.unary_op.operand) analyze_expr(a, node->data.unary_op.operand);
+            break;
+
+        case NODE_VAR_DECL: {
+            int slot = node->data.var_decl.ref.slot;
+            Kind kind = KIND_NONE;
+            if (node->data.var_decl.initializer) {
+                kind = analyze_expr(a, node->data.var_decl.initializer);
+            } else {
+                switch (node->data.var_decl.type.base_type) {
+                    case TYPE_INT:   kind = KIND_INT; break;
+                    case TYPE_FLOAT: kind = KIND_FLOAT; break;
+                    case TYPE_BOOL:  kind = KIND_BOOL; break;
+                    default:
+                        reject(a, "declares a %s", data_type_to_string(node->data.var_decl.type.base_type));
+                        return;
+                }
+            }
+            if (slot < 0) {
+                reject(a, "declares a global");
+                return;
+            }
+            unify(a, &a->fn->slot_kinds[slot], kind, node->data.var_decl.name);
+            mark_assigned(a, slot);
+            break;
+        }
+
+        case NODE_IF:
+        case NODE_IF_ELSE: {
+            analyze_condition(a, node->data.if_stmt.condition);
+            char *then_out = a->assigned ? (char*)malloc(n + 1) : NULL;
+            char *else_out = a->assigned ? (char*)malloc(n + 1) : NULL;
+            analyze_branch(a, node->data.if_stmt.then_stmt, then_out);
+            if (node->data.if_stmt.else_stmt) {
+                analyze_branch(a, node->data.if_stmt.else_stmt, else_out);
+            } else if (else_out) {
+                memcpy(else_out, a->assigned, n);
+            }
+            if (a->assigned) {
+                for (int i = 0; i < n; i++) a->assigned[i] = then_out[i] && else_out[i];
+            }
+            free(then_out);
+            free(else_out);
+            break;
+        }
+
+        case NODE_WHILE:
+            analyze_condition(a, node->data.while_stmt.condition);
+            analyze_branch(a, node->data.while_stmt.body, NULL);
+            break;
+
+        case NODE_FOR_RANGE: {
+            ASTNode *range = node->data.for_range.range;
+            ASTNode *bounds[3] = { range->data.range.start, range->data.range.end, range->data.range.step };
+            for (int i = 0; i < 3; i++) {
+                if (bounds[i] && analyze_expr(a, bounds[i]) == KIND_BOOL) {
+                    reject(a, "has a bool range bound");
+                }
+            }
+            int slot = node->data.for_range.ref.slot;
+            if (slot < 0) {
+                reject(a, "iterates over a global");
+                return;
+            }
+            unify(a, &a->fn->slot_kinds[slot], KIND_INT, node->data.for_range.iterator);
+            char *before = NULL;
+            if (a->assigned) {
+                before = (char*)malloc(n + 1);
+                memcpy(before, a->assigned, n);
+                a->assigned[slot] = 1;
+            }
+            analyze_stmt(a, node->data.for_range.body);
+            if (before) {
+                memcpy(a->assigned, before, n);
+                free(before);
+            }
+            break;
+        }
+
+        case NODE_RETURN:
+            if (!node->data.return_stmt.value) {
+                reject(a, "returns no value");
+                return;
+            }
+            {
+                Kind kind = analyze_expr(a, node->data.return_stmt.value);
+                if (kind != KIND_NONE && a->fn->ret_kind == KIND_NONE) {
+                    a->fn->ret_kind = kind;
+                    a->changed = 1;
+                } else if (kind != KIND_NONE && a->fn->ret_kind != kind) {
+                    reject(a, "returns both %s and %s values", kind_name(a->fn->ret_kind), kind_name(kind));
+                }
+            }
+            break;
+
+        /* The interpreter treats these as no-ops */
+        case NODE_FOR:
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+            break;
+
+        default:
+            reject(a, "uses %s", node_type_to_string(node->type));
+            break;
+    }
+}
+
+static void analyze_function(JitUnit *unit, JitFunction *fn, int strict, int *changed) {
+    Analysis a = { unit, fn, strict, 0, NULL };
+    if (strict) {
+        a.assigned = (char*)calloc(fn->num_slots + 1, 1);
+        for (int i = 0; i < fn->num_params; i++) a.assigned[i] = 1;
+    }
+    analyze_stmt(&a, fn->decl->data.func_decl.body);
+    if (strict && !unit->failed) {
+        if (!always_returns(fn->decl->data.func_decl.body)) {
+            reject(&a, "may finish without returning a value");
+        } else if (fn->ret_kind == KIND_NONE) {
+            reject(&a, "has a return value of unknown type");
+        }
+    }
+    free(a.assigned);
+    if (a.changed) *changed = 1;
+}
+
+#if JIT_AVAILABLE
+
+/* ---------- x86-64 emitter ---------- */
+
+typedef struct {
+    unsigned char *bytes;
+    size_t len;
+    size_t cap;
+} CodeBuffer;
+
+static void emit_bytes(CodeBuffer *buf, const void *bytes, size_t n) {
+    if (buf->len + n > buf->cap) {
+        buf->cap = buf->cap == 0 ? 4096 : buf->cap * 2;
+        while (buf->cap < buf->len + n) buf->cap *= 2;
+        buf->bytes = (unsigned char*)realloc(buf->bytes, buf->cap);
+        if (!buf->bytes) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    memcpy(buf->bytes + buf->len, bytes, n);
+    buf->len += n;
+}
+
+#define EMIT(buf, ...) do { \
+        static const unsigned char bytes_[] = { __VA_ARGS__ }; \
+        emit_bytes(buf, bytes_, sizeof(bytes_)); \
+    } while (0)
+
+static void emit32(CodeBuffer *buf, int32_t value) {
+    emit_bytes(buf, &value, 4);
+}
+
+static void emit64(CodeBuffer *buf, uint64_t value) {
+    emit_bytes(buf, &value, 8);
+}
+
+/* Emit a jump opcode with a rel32 to be patched; returns the rel32's position */
+static size_t emit_jump(CodeBuffer *buf, const unsigned char *opcode, size_t n) {
+    emit_bytes(buf, opcode, n);
+    emit32(buf, 0);
+    return buf->len - 4;
+}
+
+#define JMP(buf)     emit_jump(buf, (const unsigned char[]){ 0xE9 }, 1)
+#define JCC(buf, cc) emit_jump(buf, (const unsigned char[]){ 0x0F, 0x80 | (cc) }, 2)
+
+enum { CC_P = 0xA, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+       CC_AE = 0x3, CC_A = 0x7 };
+
+static void patch_jump(CodeBuffer *buf, size_t at, size_t target) {
+    int32_t rel = (int32_t)(target - (at + 4));
+    memcpy(buf->bytes + at, &rel, 4);
+}
+
+/* op [rbp + disp32] with a ModRM reg field */
+static void emit_rbp(CodeBuffer *buf, const unsigned char *opcode, size_t n, int reg, int32_t disp) {
+    emit_bytes(buf, opcode, n);
+    unsigned char modrm = 0x85 | (reg << 3);
+    emit_bytes(buf, &modrm, 1);
+    emit32(buf, disp);
+}
+
+#define RBP_OP(buf, reg, disp, ...) \
+    emit_rbp(buf, (const unsigned char[]){ __VA_ARGS__ }, sizeof((const unsigned char[]){ __VA_ARGS__ }), reg, disp)
+
+static int32_t slot_disp(int slot) {
+    return -8 * (slot + 1);
+}
+
+/* ---------- Runtime helpers called from native code ---------- */
+
+static void jit_fail_depth(void) {
+    fprintf(stderr, "Runtime error: Max recursion depth (%d) exceeded\n", jit.max_depth);
+    runtime_abort();
+}
+
+static void jit_fail_div_zero(void) {
+    fprintf(stderr, "Runtime error: Division by zero\n");
+    runtime_abort();
+}
+
+static void jit_fail_mod_zero(void) {
+    fprintf(stderr, "Runtime error: Modulo by zero\n");
+    runtime_abort();
+}
+
+/* ---------- Code generation ---------- */
+
+typedef struct {
+    size_t at;
+    JitFunction *target;
+} CallFixup;
+
+typedef struct {
+    CodeBuffer *buf;
+    JitUnit *unit;
+    JitFunction *fn;
+    int pushes;             /* 8-byte values on the stack beyond the frame */
+    int loop_depth;         /* Range loops being generated */
+    int max_loop_depth;
+    size_t *returns;        /* Jumps to the epilogue */
+    int return_count;
+    CallFixup *calls;       /* Calls within the unit */
+    int call_count;
+} Codegen;
+
+static void push_result(Codegen *cg, Kind kind) {
+    if (kind == KIND_FLOAT) EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x7E, 0xC0);  /* movq rax, xmm0 */
+    EMIT(cg->buf, 0x50);                                                  /* push rax */
+    cg->pushes++;
+}
+
+static void pop_rax(Codegen *cg) {
+    EMIT(cg->buf, 0x58);
+    cg->pushes--;
+}
+
+static void call_absolute(Codegen *cg, const void *addr) {
+    EMIT(cg->buf, 0x48, 0xB8);                 /* movabs rax, addr */
+    emit64(cg->buf, (uint64_t)(uintptr_t)addr);
+    EMIT(cg->buf, 0xFF, 0xD0);                 /* call rax */
+}
+
+/* Call a helper that reports an error and exits */
+static void call_fatal(Codegen *cg, void (*helper)(void)) {
+    if (cg->pushes & 1) EMIT(cg->buf, 0x48, 0x83, 0xEC, 0x08);   /* sub rsp, 8 */
+    call_absolute(cg, (const void*)helper);
+}
+
+static void load_slot(Codegen *cg, int slot, Kind kind) {
+    if (kind == KIND_FLOAT) RBP_OP(cg->buf, 0, slot_disp(slot), 0xF2, 0x0F, 0x10);  /* movsd xmm0, [slot] */
+    else RBP_OP(cg->buf, 0, slot_disp(slot), 0x8B);                                   /* mov eax, [slot] */
+}
+
+static void store_slot(Codegen *cg, int slot, Kind kind) {
+    if (kind == KIND_FLOAT) RBP_OP(cg->buf, 0, slot_disp(slot), 0xF2, 0x0F, 0x11);  /* movsd [slot], xmm0 */
+    else RBP_OP(cg->buf, 0, slot_disp(slot), 0x89);                                   /* mov [slot], eax */
+}
+
+static void load_double(Codegen *cg, double value, int xmm) {
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    EMIT(cg->buf, 0x48, 0xB8);                 /* movabs rax, bits */
+    emit64(cg->buf, bits);
+    if (xmm == 0) EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x6E, 0xC0);   /* movq xmm0, rax */
+    else EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x6E, 0xC8);            /* movq xmm1, rax */
+}
+
+/* Right operand (in eax or xmm0) to xmm1 as a double */
+static void right_to_xmm1(Codegen *cg, Kind kind) {
+    if (kind == KIND_INT) EMIT(cg->buf, 0xF2, 0x0F, 0x2A, 0xC8);  /* cvtsi2sd xmm1, eax */
+    else EMIT(cg->buf, 0xF2, 0x0F, 0x10, 0xC8);                   /* movsd xmm1, xmm0 */
+}
+
+/* Pop the left operand into xmm0 as a double */
+static void pop_left_to_xmm0(Codegen *cg, Kind kind) {
+    pop_rax(cg);
+    if (kind == KIND_INT) EMIT(cg->buf, 0xF2, 0x0F, 0x2A, 0xC0);  /* cvtsi2sd xmm0, eax */
+    else EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x6E, 0xC0);             /* movq xmm0, rax */
+}
+
+static void float_op(Codegen *cg, NodeType op) {
+    switch (op) {
+        case NODE_ADD: EMIT(cg->buf, 0xF2, 0x0F, 0x58, 0xC1); break;  /* addsd xmm0, xmm1 */
+        case NODE_SUB: EMIT(cg->buf, 0xF2, 0x0F, 0x5C, 0xC1); break;  /* subsd xmm0, xmm1 */
+        case NODE_MUL: EMIT(cg->buf, 0xF2, 0x0F, 0x59, 0xC1); break;  /* mulsd xmm0, xmm1 */
+        default: {
+            /* divsd, after the interpreter's r == 0 check (NaN passes) */
+            EMIT(cg->buf, 0x66, 0x0F, 0x57, 0xD2);                    /* xorpd xmm2, xmm2 */
+            EMIT(cg->buf, 0x66, 0x0F, 0x2E, 0xCA);                    /* ucomisd xmm1, xmm2 */
+            size_t unordered = JCC(cg->buf, CC_P);
+            size_t nonzero = JCC(cg->buf, CC_NE);
+            call_fatal(cg, jit_fail_div_zero);
+            patch_jump(cg->buf, unordered, cg->buf->len);
+            patch_jump(cg->buf, nonzero, cg->buf->len);
+            EMIT(cg->buf, 0xF2, 0x0F, 0x5E, 0xC1);                    /* divsd xmm0, xmm1 */
+            break;
+        }
+    }
+}
+
+/* eax = eax op ecx */
+static void int_op(Codegen *cg, NodeType op) {
+    switch (op) {
+        case NODE_ADD: EMIT(cg->buf, 0x01, 0xC8); break;        /* add eax, ecx */
+        case NODE_SUB: EMIT(cg->buf, 0x29, 0xC8); break;        /* sub eax, ecx */
+        case NODE_MUL: EMIT(cg->buf, 0x0F, 0xAF, 0xC1); break;  /* imul eax, ecx */
+        default: {
+            EMIT(cg->buf, 0x85, 0xC9);                          /* test ecx, ecx */
+            size_t nonzero = JCC(cg->buf, CC_NE);
+            call_fatal(cg, jit_fail_mod_zero);
+            patch_jump(cg->buf, nonzero, cg->buf->len);
+            EMIT(cg->buf, 0x99, 0xF7, 0xF9, 0x89, 0xD0);        /* cdq; idiv ecx; mov eax, edx */
+            break;
+        }
+    }
+}
+
+static void setcc_eax(Codegen *cg, int cc) {
+    unsigned char set[] = { 0x0F, (unsigned char)(0x90 | cc), 0xC0 };
+    emit_bytes(cg->buf, set, sizeof(set));      /* setcc al */
+    EMIT(cg->buf, 0x0F, 0xB6, 0xC0);            /* movzx eax, al */
+}
+
+static Kind gen_expr(Codegen *cg, ASTNode *node);
+static void gen_stmt(Codegen *cg, ASTNode *node);
+
+static Kind gen_arithmetic(Codegen *cg, NodeType op, ASTNode *node) {
+    Kind left = gen_expr(cg, node->data.binary_op.left);
+    push_result(cg, left);
+    Kind right = gen_expr(cg, node->data.binary_op.right);
+
+    if (op == NODE_MOD || (op != NODE_DIV && left == KIND_INT && right == KIND_INT)) {
+        EMIT(cg->buf, 0x89, 0xC1);              /* mov ecx, eax */
+        pop_rax(cg);
+        int_op(cg, op);
+        return KIND_INT;
+    }
+    right_to_xmm1(cg, right);
+    pop_left_to_xmm0(cg, left);
+    float_op(cg, op);
+    return KIND_FLOAT;
+}
+
+static Kind gen_comparison(Codegen *cg, NodeType op, ASTNode *node) {
+    Kind left = gen_expr(cg, node->data.binary_op.left);
+    push_result(cg, left);
+    Kind right = gen_expr(cg, node->data.binary_op.right);
+
+    if (op == NODE_EQ || op == NODE_NE) {
+        /* Only ints and bools compare equal, each within their own type */
+        if (left == right && left != KIND_FLOAT) {
+            EMIT(cg->buf, 0x89, 0xC1);          /* mov ecx, eax */
+            pop_rax(cg);
+            EMIT(cg->buf, 0x39, 0xC8);          /* cmp eax, ecx */
+            setcc_eax(cg, op == NODE_EQ ? CC_E : CC_NE);
+        } else {
+            pop_rax(cg);
+            EMIT(cg->buf, 0xB8);                /* mov eax, imm32 */
+            emit32(cg->buf, op == NODE_NE);
+        }
+        return KIND_BOOL;
+    }
+
+    if (left == KIND_INT && right == KIND_INT) {
+        EMIT(cg->buf, 0x89, 0xC1);              /* mov ecx, eax */
+        pop_rax(cg);
+        EMIT(cg->buf, 0x39, 0xC8);              /* cmp eax, ecx */
+        setcc_eax(cg, op == NODE_LT ? CC_L : op == NODE_GT ? CC_G : op == NODE_LE ? CC_LE : CC_GE);
+        return KIND_BOOL;
+    }
+
+    right_to_xmm1(cg, right);
+    pop_left_to_xmm0(cg, left);
+    /* Unordered operands compare false, as in C */
+    if (op == NODE_LT || op == NODE_LE) EMIT(cg->buf, 0x66, 0x0F, 0x2E, 0xC8);  /* ucomisd xmm1, xmm0 */
+    else EMIT(cg->buf, 0x66, 0x0F, 0x2E, 0xC1);                                  /* ucomisd xmm0, xmm1 */
+    setcc_eax(cg, op == NODE_LT || op == NODE_GT ? CC_A : CC_AE);
+    return KIND_BOOL;
+}
+
+/* && and || short-circuit and yield the right operand itself, as the
+ * interpreter does */
+static Kind gen_logical(Codegen *cg, ASTNode *node) {
+    int is_and = node->type == NODE_AND;
+    gen_expr(cg, node->data.binary_op.left);
+    EMIT(cg->buf, 0x85, 0xC0);                  /* test eax, eax */
+    size_t short_circuit = JCC(cg->buf, is_and ? CC_E : CC_NE);
+    gen_expr(cg, node->data.binary_op.right);
+    size_t done = JMP(cg->buf);
+    patch_jump(cg->buf, short_circuit, cg->buf->len);
+    EMIT(cg->buf, 0xB8);                        /* mov eax, imm32 */
+    emit32(cg->buf, !is_and);
+    patch_jump(cg->buf, done, cg->buf->len);
+    return KIND_BOOL;
+}
+
+static Kind gen_incdec(Codegen *cg, ASTNode *node) {
+    int slot = node->data.unary_op.operand->data.identifier.ref.slot;
+    Kind kind = cg->fn->slot_kinds[slot];
+    int is_inc = node->type == NODE_PRE_INC || node->type == NODE_POST_INC;
+    int is_post = node->type == NODE_POST_INC || node->type == NODE_POST_DEC;
+
+    load_slot(cg, slot, kind);
+    if (kind == KIND_INT) {
+        if (is_post) {
+            if (is_inc) EMIT(cg->buf, 0x8D, 0x48, 0x01);    /* lea ecx, [rax + 1] */
+            else EMIT(cg->buf, 0x8D, 0x48, 0xFF);           /* lea ecx, [rax - 1] */
+            RBP_OP(cg->buf, 1, slot_disp(slot), 0x89);      /* mov [slot], ecx */
+        } else {
+            if (is_inc) EMIT(cg->buf, 0x83, 0xC0, 0x01);    /* add eax, 1 */
+            else EMIT(cg->buf, 0x83, 0xE8, 0x01);           /* sub eax, 1 */
+            store_slot(cg, slot, kind);
+        }
+        return kind;
+    }
+
+    EMIT(cg->buf, 0xF2, 0x0F, 0x10, 0xD0);                  /* movsd xmm2, xmm0 */
+    load_double(cg, 1.0, 1);
+    if (is_inc) EMIT(cg->buf, 0xF2, 0x0F, 0x58, 0xD1);      /* addsd xmm2, xmm1 */
+    else EMIT(cg->buf, 0xF2, 0x0F, 0x5C, 0xD1);             /* subsd xmm2, xmm1 */
+    RBP_OP(cg->buf, 2, slot_disp(slot), 0xF2, 0x0F, 0x11);  /* movsd [slot], xmm2 */
+    if (!is_post) EMIT(cg->buf, 0xF2, 0x0F, 0x10, 0xC2);    /* movsd xmm0, xmm2 */
+    return kind;
+}
+
+/* The variable is read after the right operand, as in the interpreter */
+static Kind gen_compound(Codegen *cg, NodeType op, ASTNode *node) {
+    int slot = node->data.binary_op.left->data.identifier.ref.slot;
+    Kind kind = cg->fn->slot_kinds[slot];
+    Kind right = gen_expr(cg, node->data.binary_op.right);
+
+    if (kind == KIND_INT) {
+        EMIT(cg->buf, 0x89, 0xC1);              /* mov ecx, eax */
+        load_slot(cg, slot, KIND_INT);
+        int_op(cg, op);
+    } else {
+        right_to_xmm1(cg, right);
+        load_slot(cg, slot, KIND_FLOAT);
+        float_op(cg, op);
+    }
+    store_slot(cg, slot, kind);
+    return kind;
+}
+
+static void depth_counter(Codegen *cg) {
+    EMIT(cg->buf, 0x49, 0xBB);                  /* movabs r11, call_depth */
+    emit64(cg->buf, (uint64_t)(uintptr_t)jit.call_depth);
+}
+
+static Kind gen_call(Codegen *cg, ASTNode *node) {
+    JitFunction *target = find_callee(node->data.func_call.func->data.identifier.name);
+    ASTNode *args = node->data.func_call.args;
+    int nargs = args ? args->data.list.count : 0;
+
+    /* Enter the callee's frame before evaluating arguments, like the
+     * interpreter, so the recursion limit trips at the same point */
+    depth_counter(cg);
+    EMIT(cg->buf, 0x41, 0x8B, 0x03);            /* mov eax, [r11] */
+    EMIT(cg->buf, 0x3D);                        /* cmp eax, max_depth */
+    emit32(cg->buf, jit.max_depth);
+    size_t ok = JCC(cg->buf, CC_L);
+    call_fatal(cg, jit_fail_depth);
+    patch_jump(cg->buf, ok, cg->buf->len);
+    EMIT(cg->buf, 0x41, 0xFF, 0x03);            /* inc dword [r11] */
+
+    int pad = (cg->pushes + nargs) & 1;
+    if (pad) {
+        EMIT(cg->buf, 0x48, 0x83, 0xEC, 0x08);  /* sub rsp, 8 */
+        cg->pushes++;
+    }
+    for (int i = 0; i < nargs; i++) {
+        push_result(cg, gen_expr(cg, args->data.list.items[i]));
+    }
+    EMIT(cg->buf, 0x48, 0x89, 0xE7);            /* mov rdi, rsp */
+
+    if (target->state == JIT_COMPILED) {
+        call_absolute(cg, (const void*)target->code);
+    } else {
+        EMIT(cg->buf, 0xE8);                    /* call rel32 */
+        emit32(cg->buf, 0);
+        cg->calls = (CallFixup*)realloc(cg->calls, (cg->call_count + 1) * sizeof(CallFixup));
+        cg->calls[cg->call_count].at = cg->buf->len - 4;
+        cg->calls[cg->call_count].target = target;
+        cg->call_count++;
+    }
+
+    EMIT(cg->buf, 0x48, 0x81, 0xC4);            /* add rsp, imm32 */
+    emit32(cg->buf, 8 * (nargs + pad));
+    cg->pushes -= nargs + pad;
+    depth_counter(cg);
+    EMIT(cg->buf, 0x41, 0xFF, 0x0B);            /* dec dword [r11] */
+    if (target->ret_kind == KIND_FLOAT) EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x6E, 0xC0);  /* movq xmm0, rax */
+    return target->ret_kind;
+}
+
+static Kind gen_expr(Codegen *cg, ASTNode *node) {
+    NodeType op = base_op(node->type);
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+        case NODE_BOOL_LITERAL:
+            EMIT(cg->buf, 0xB8);                /* mov eax, imm32 */
+            emit32(cg->buf, node->type == NODE_INT_LITERAL ? node->data.int_literal.value
+                                                           : node->data.bool_literal.value);
+            return node->type == NODE_INT_LITERAL ? KIND_INT : KIND_BOOL;
+
+        case NODE_FLOAT_LITERAL:
+            load_double(cg, node->data.float_literal.value, 0);
+            return KIND_FLOAT;
+
+        case NODE_IDENTIFIER: {
+            int slot = node->data.identifier.ref.slot;
+            load_slot(cg, slot, cg->fn->slot_kinds[slot]);
+            return cg->fn->slot_kinds[slot];
+        }
+
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+            return gen_arithmetic(cg, op, node);
+
+        case NODE_LT: case NODE_GT: case NODE_LE: case NODE_GE: case NODE_EQ: case NODE_NE:
+        case NODE_INT_LT: case NODE_INT_GT: case NODE_INT_LE: case NODE_INT_GE:
+        case NODE_INT_EQ: case NODE_INT_NE:
+            return gen_comparison(cg, op, node);
+
+        case NODE_AND:
+        case NODE_OR:
+            return gen_logical(cg, node);
+
+        case NODE_NOT:
+            gen_expr(cg, node->data.unary_op.operand);
+            EMIT(cg->buf, 0x85, 0xC0);          /* test eax, eax */
+            setcc_eax(cg, CC_E);
+            return KIND_BOOL;
+
+        case NODE_UNARY_MINUS: {
+            Kind kind = gen_expr(cg, node->data.unary_op.operand);
+            if (kind == KIND_INT) {
+                EMIT(cg->buf, 0xF7, 0xD8);      /* neg eax */
+            } else {
+                EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x7E, 0xC0);    /* movq rax, xmm0 */
+                EMIT(cg->buf, 0x48, 0x0F, 0xBA, 0xF8, 0x3F);    /* btc rax, 63 */
+                EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x6E, 0xC0);    /* movq xmm0, rax */
+            }
+            return kind;
+        }
+
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC:
+            return gen_incdec(cg, node);
+
+        case NODE_ASSIGN: {
+            Kind kind = gen_expr(cg, node->data.binary_op.right);
+            store_slot(cg, node->data.binary_op.left->data.identifier.ref.slot, kind);
+            return kind;
+        }
+
+        case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
+            return gen_compound(cg, op, node);
+
+        case NODE_FUNC_CALL:
+            return gen_call(cg, node);
+
+        default:
+            /* The analysis only admits the nodes above */
+            return KIND_NONE;
+    }
+}
+
+/* Ranges run as counted loops over three hidden slots past the
+ * function's own: trips left, the next iterator value and the step */
+static void gen_range_loop(Codegen *cg, ASTNode *node) {
+    ASTNode *range = node->data.for_range.range;
+    int hidden = cg->fn->num_slots + 3 * cg->loop_depth++;
+    if (cg->loop_depth > cg->max_loop_depth) cg->max_loop_depth = cg->loop_depth;
+    int trips = hidden, next = hidden + 1, step = hidden + 2;
+
+    ASTNode *bounds[2] = { range->data.range.start, range->data.range.end };
+    for (int i = 0; i < 2; i++) {
+        if (gen_expr(cg, bounds[i]) == KIND_FLOAT) EMIT(cg->buf, 0xF2, 0x0F, 0x2C, 0xC0);  /* cvttsd2si eax, xmm0 */
+        push_result(cg, KIND_INT);
+    }
+    if (range->data.range.step) {
+        if (gen_expr(cg, range->data.range.step) == KIND_FLOAT) EMIT(cg->buf, 0xF2, 0x0F, 0x2C, 0xC0);
+    } else {
+        EMIT(cg->buf, 0xB8);                    /* mov eax, 1 */
+        emit32(cg->buf, 1);
+    }
+    EMIT(cg->buf, 0x89, 0xC2);                  /* mov edx, eax */
+    EMIT(cg->buf, 0x5E, 0x5F);                  /* pop rsi; pop rdi */
+    cg->pushes -= 2;
+    EMIT(cg->buf, 0xB9);                        /* mov ecx, inclusive */
+    emit32(cg->buf, range->type != NODE_RANGE_EXCL);
+    RBP_OP(cg->buf, 7, slot_disp(next), 0x89);  /* mov [next], edi */
+    RBP_OP(cg->buf, 2, slot_disp(step), 0x89);  /* mov [step], edx */
+
+    if (cg->pushes & 1) EMIT(cg->buf, 0x48, 0x83, 0xEC, 0x08);      /* sub rsp, 8 */
+    call_absolute(cg, (const void*)range_trip_count);
+    if (cg->pushes & 1) EMIT(cg->buf, 0x48, 0x83, 0xC4, 0x08);      /* add rsp, 8 */
+    RBP_OP(cg->buf, 0, slot_disp(trips), 0x48, 0x89);               /* mov [trips], rax */
+
+    size_t top = cg->buf->len;
+    RBP_OP(cg->buf, 0, slot_disp(trips), 0x48, 0x8B);               /* mov rax, [trips] */
+    EMIT(cg->buf, 0x48, 0x85, 0xC0);                                /* test rax, rax */
+    size_t done = JCC(cg->buf, CC_E);
+    load_slot(cg, next, KIND_INT);
+    store_slot(cg, node->data.for_range.ref.slot, KIND_INT);
+
+    gen_stmt(cg, node->data.for_range.body);
+
+    RBP_OP(cg->buf, 1, slot_disp(trips), 0x48, 0xFF);               /* dec qword [trips] */
+    load_slot(cg, next, KIND_INT);
+    RBP_OP(cg->buf, 0, slot_disp(step), 0x03);                      /* add eax, [step] */
+    store_slot(cg, next, KIND_INT);
+    patch_jump(cg->buf, JMP(cg->buf), top);
+    patch_jump(cg->buf, done, cg->buf->len);
+    cg->loop_depth--;
+}
+
+static void gen_stmt(Codegen *cg, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_STMT_LIST:
+            for (int i = 0; i < node->data.list.count; i++) {
+                gen_stmt(cg, node->data.list.items[i]);
+            }
+            break;
+
+        case NODE_EXPR_STMT:
+            if (node->data.unary_op.operand) gen_expr(cg, node->data.unary_op.operand);
+            break;
+
+        case NODE_VAR_DECL: {
+            int slot = node->data.var_decl.ref.slot;
+            Kind kind = cg->fn->slot_kinds[slot];
+            if (node->data.var_decl.initializer) {
+                kind = gen_expr(cg, node->data.var_decl.initializer);
+            } else if (kind == KIND_FLOAT) {
+                EMIT(cg->buf, 0x66, 0x0F, 0x57, 0xC0);  /* xorpd xmm0, xmm0 */
+            } else {
+                EMIT(cg->buf, 0x31, 0xC0);              /* xor eax, eax */
+            }
+            store_slot(cg, slot, kind);
+            break;
+        }
+
+        case NODE_IF:
+        case NODE_IF_ELSE: {
+            gen_expr(cg, node->data.if_stmt.condition);
+            EMIT(cg->buf, 0x85, 0xC0);                  /* test eax, eax */
+            size_t skip_then = JCC(cg->buf, CC_E);
+            gen_stmt(cg, node->data.if_stmt.then_stmt);
+            if (node->data.if_stmt.else_stmt) {
+                size_t skip_else = JMP(cg->buf);
+                patch_jump(cg->buf, skip_then, cg->buf->len);
+                gen_stmt(cg, node->data.if_stmt.else_stmt);
+                patch_jump(cg->buf, skip_else, cg->buf->len);
+            } else {
+                patch_jump(cg->buf, skip_then, cg->buf->len);
+            }
+            break;
+        }
+
+        case NODE_WHILE: {
+            size_t top = cg->buf->len;
+            gen_expr(cg, node->data.while_stmt.condition);
+            EMIT(cg->buf, 0x85, 0xC0);                  /* test eax, eax */
+            size_t done = JCC(cg->buf, CC_E);
+            gen_stmt(cg, node->data.while_stmt.body);
+            patch_jump(cg->buf, JMP(cg->buf), top);
+            patch_jump(cg->buf, done, cg->buf->len);
+            break;
+        }
+
+        case NODE_FOR_RANGE:
+            gen_range_loop(cg, node);
+            break;
+
+        case NODE_RETURN: {
+            if (gen_expr(cg, node->data.return_stmt.value) == KIND_FLOAT) {
+                EMIT(cg->buf, 0x66, 0x48, 0x0F, 0x7E, 0xC0);    /* movq rax, xmm0 */
+            }
+            cg->returns = (size_t*)realloc(cg->returns, (cg->return_count + 1) * sizeof(size_t));
+            cg->returns[cg->return_count++] = JMP(cg->buf);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void gen_function(Codegen *cg) {
+    JitFunction *fn = cg->fn;
+
+    EMIT(cg->buf, 0x55);                        /* push rbp */
+    EMIT(cg->buf, 0x48, 0x89, 0xE5);            /* mov rbp, rsp */
+    EMIT(cg->buf, 0x48, 0x81, 0xEC);            /* sub rsp, frame size */
+    size_t frame_size = cg->buf->len;
+    emit32(cg->buf, 0);
+
+    for (int i = 0; i < fn->num_params; i++) {
+        EMIT(cg->buf, 0x48, 0x8B, 0x87);        /* mov rax, [rdi + disp32] */
+        emit32(cg->buf, 8 * (fn->num_params - 1 - i));
+        RBP_OP(cg->buf, 0, slot_disp(i), 0x48, 0x89);   /* mov [slot], rax */
+    }
+
+    gen_stmt(cg, fn->decl->data.func_decl.body);
+
+    for (int i = 0; i < cg->return_count; i++) {
+        patch_jump(cg->buf, cg->returns[i], cg->buf->len);
+    }
+    EMIT(cg->buf, 0x48, 0x89, 0xEC);            /* mov rsp, rbp */
+    EMIT(cg->buf, 0x5D, 0xC3);                  /* pop rbp; ret */
+
+    /* Keep rsp 16-byte aligned below the frame */
+    int slots = fn->num_slots + 3 * cg->max_loop_depth;
+    int32_t size = 8 * (slots + (slots & 1));
+    memcpy(cg->buf->bytes + frame_size, &size, 4);
+}
+
+/* Generate every function of the unit into one block of executable memory */
+static int install_unit(JitUnit *unit) {
+    CodeBuffer buf = { NULL, 0, 0 };
+    CallFixup *calls = NULL;
+    int call_count = 0;
+
+    for (int i = 0; i < unit->count; i++) {
+        Codegen cg = { &buf, unit, unit->fns[i], 0, 0, 0, NULL, 0, NULL, 0 };
+        unit->fns[i]->offset = buf.len;
+        gen_function(&cg);
+        unit->fns[i]->code_size = buf.len - unit->fns[i]->offset;
+
+        calls = (CallFixup*)realloc(calls, (call_count + cg.call_count + 1) * sizeof(CallFixup));
+        memcpy(calls + call_count, cg.calls, cg.call_count * sizeof(CallFixup));
+        call_count += cg.call_count;
+        free(cg.calls);
+        free(cg.returns);
+    }
+    for (int i = 0; i < call_count; i++) {
+        patch_jump(&buf, calls[i].at, calls[i].target->offset);
+    }
+    free(calls);
+
+    void *mem = mmap(NULL, buf.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        free(buf.bytes);
+        return 0;
+    }
+    memcpy(mem, buf.bytes, buf.len);
+    free(buf.bytes);
+    if (mprotect(mem, buf.len, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, buf.len);
+        return 0;
+    }
+
+    jit.regions = (CodeRegion*)realloc(jit.regions, (jit.region_count + 1) * sizeof(CodeRegion));
+    jit.regions[jit.region_count].base = mem;
+    jit.regions[jit.region_count].size = buf.len;
+    jit.region_count++;
+    jit.code_bytes += buf.len;
+
+    for (int i = 0; i < unit->count; i++) {
+        JitFunction *fn = unit->fns[i];
+        fn->code = (JitEntry)(void*)((unsigned char*)mem + fn->offset);
+        fn->state = JIT_COMPILED;
+    }
+    return 1;
+}
+
+#endif /* JIT_AVAILABLE */
+
+static void reset_function(JitFunction *fn) {
+    fn->state = JIT_COLD;
+    fn->ret_kind = KIND_NONE;
+    memset(fn->slot_kinds, 0, (fn->num_slots > 0 ? fn->num_slots : 1) * sizeof(Kind));
+}
+
+/* Specialize fn for the argument types of this call and compile it with
+ * everything it calls; on failure only fn is marked as rejected */
+static void compile(JitFunction *fn, Value *args) {
+    JitUnit unit = { NULL, 0, 0, 0, NULL, "" };
+
+    for (int i = 0; i < fn->num_params; i++) {
+        fn->slot_kinds[i] = value_kind(&args[i]);
+        if (fn->slot_kinds[i] == KIND_NONE) {
+            snprintf(fn->reason, sizeof(fn->reason), "argument %d is not an int, float or bool", i + 1);
+            reset_function(fn);
+            fn->state = JIT_REJECTED;
+            return;
+        }
+    }
+    unit_add(&unit, fn);
+
+    int changed;
+    do {
+        changed = 0;
+        for (int i = 0; i < unit.count && !unit.failed; i++) {
+            analyze_function(&unit, unit.fns[i], 0, &changed);
+        }
+    } while (changed && !unit.failed);
+    for (int i = 0; i < unit.count && !unit.failed; i++) {
+        analyze_function(&unit, unit.fns[i], 1, &changed);
+    }
+
+#if JIT_AVAILABLE
+    if (!unit.failed && !install_unit(&unit)) {
+        unit.failed = 1;
+        unit.blame = fn;
+        snprintf(unit.reason, sizeof(unit.reason), "no executable memory");
+    }
+#endif
+
+    if (unit.failed) {
+        if (unit.blame == fn) {
+            snprintf(fn->reason, sizeof(fn->reason), "%s", unit.reason);
+        } else {
+            snprintf(fn->reason, sizeof(fn->reason), "calls '%s', which %.96s",
+                     unit.blame->decl->data.func_decl.name, unit.reason);
+        }
+        /* Callees stay eligible on their own */
+        for (int i = 0; i < unit.count; i++) reset_function(unit.fns[i]);
+        fn->state = JIT_REJECTED;
+    }
+    free(unit.fns);
+}
+
+int jit_call(ASTNode *decl, Value *args, int nargs, Value *result) {
+    JitFunction *fn = decl->data.func_decl.jit;
+    if (!fn) return 0;
+
+    if (fn->state == JIT_COLD) {
+        if (++fn->calls < jit.threshold) return 0;
+        if (nargs != fn->num_params) {
+            snprintf(fn->reason, sizeof(fn->reason), "called with %d arguments", nargs);
+            fn->state = JIT_REJECTED;
+            return 0;
+        }
+        compile(fn, args);
+    }
+    if (fn->state != JIT_COMPILED || nargs != fn->num_params) return 0;
+
+    int64_t raw[nargs > 0 ? nargs : 1];
+    for (int i = 0; i < nargs; i++) {
+        if (value_kind(&args[i]) != fn->slot_kinds[i]) return 0;
+        int64_t *arg = &raw[nargs - 1 - i];
+        switch (args[i].type) {
+            case VAL_FLOAT: memcpy(arg, &args[i].data.float_val, 8); break;
+            case VAL_BOOL:  *arg = args[i].data.bool_val; break;
+            default:        *arg = args[i].data.int_val; break;
+        }
+    }
+
+    fn->entries++;
+    int64_t ret = fn->code(raw);
+    switch (fn->ret_kind) {
+        case KIND_FLOAT: {
+            double d;
+            memcpy(&d, &ret, 8);
+            *result = create_float_value(d);
+            break;
+        }
+        case KIND_BOOL:
+            *result = create_bool_value((int)ret);
+            break;
+        default:
+            *result = create_int_value((int)ret);
+            break;
+    }
+    return 1;
+}
+
+void jit_print_stats(FILE *out) {
+    if (!JIT_AVAILABLE) {
+        fprintf(out, "JIT: not available on this platform\n");
+        return;
+    }
+    if (!jit_enabled) {
+        fprintf(out, "JIT: disabled\n");
+        return;
+    }
+    int compiled = 0, rejected = 0;
+    for (int i = 0; i < jit.fn_count; i++) {
+        if (jit.fns[i].state == JIT_COMPILED) compiled++;
+        if (jit.fns[i].state == JIT_REJECTED) rejected++;
+    }
+    fprintf(out, "JIT: %d function%s compiled (%zu bytes of code), %d rejected, threshold %d calls\n",
+            compiled, compiled == 1 ? "" : "s", jit.code_bytes, rejected, jit.threshold);
+
+    for (int i = 0; i < jit.fn_count; i++) {
+        JitFunction *fn = &jit.fns[i];
+        if (fn->state == JIT_COLD) continue;
+
+        fprintf(out, "  %s(", fn->decl->data.func_decl.name);
+        if (fn->state == JIT_COMPILED) {
+            for (int p = 0; p < fn->num_params; p++) {
+                fprintf(out, "%s%s", p ? ", " : "", kind_name(fn->slot_kinds[p]));
+            }
+            fprintf(out, ") -> %s: %zu bytes, %ld calls entered natively\n",
+                    kind_name(fn->ret_kind), fn->code_size, fn->entries);
+        } else {
+            fprintf(out, "): not compiled, %s\n", fn->reason);
+        }
+    }
+}
+
+void jit_free(void) {
+#if JIT_AVAILABLE
+    for (int i = 0; i < jit.region_count; i++) {
+        munmap(jit.regions[i].base, jit.regions[i].size);
+    }
+#endif
+    for (int i = 0; i < jit.fn_count; i++) {
+        free(jit.fns[i].slot_kinds);
+        jit.fns[i].decl->data.func_decl.jit = NULL;
+    }
+    free(jit.fns);
+    free(jit.regions);
+    jit.fns = NULL;
+    jit.regions = NULL;
+    jit.fn_count = 0;
+    jit.region_count = 0;
+    jit.code_bytes = 0;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "parse.h"
+#include "interpreter.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "regex_cache.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "memo.h"
+#include "profile.h"
+#include "builtins.h"
+#include "output.h"
+#include "input.h"
+#include "ast_cache.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-O0|-O1|-O2] [--vm] [--max-depth=N] [--no-jit] [--jit-stats] [--memo[=f,...]] [--memo-stats] [--regex-stats] [--profile] [--profile-folded=file] [--load=ext.so] [--flush=line|block|exit] [--ast] [--no-cache] [file.prog]\n", prog);
+    fprintf(stderr, "  -O<level>       AST optimization level (default %d, 0 disables)\n", OPT_LEVEL_DEFAULT);
+    fprintf(stderr, "  --vm            compile to bytecode and run on the register VM\n");
+    fprintf(stderr, "  --max-depth=N   call depth limit under --vm (default %d)\n", VM_MAX_CALL_DEPTH);
+    fprintf(stderr, "  --no-jit        never compile hot functions to native code\n");
+    fprintf(stderr, "  --jit-stats     report which functions were compiled, and why not, on exit\n");
+    fprintf(stderr, "  --memo[=f,...]  cache results of pure functions (all of them, or those named)\n");
+    fprintf(stderr, "                  (runs on the tree walker)\n");
+    fprintf(stderr, "  --memo-stats    report memoization hits and misses on exit\n");
+    fprintf(stderr, "  --regex-stats   report regex cache hits and misses on exit\n");
+    fprintf(stderr, "  --profile       report time per function and executions per line on exit\n");
+    fprintf(stderr, "                  (runs on the tree walker without the JIT)\n");
+    fprintf(stderr, "  --profile-folded=FILE  profile and write folded stacks for flamegraphs\n");
+    fprintf(stderr, "  --load=ext.so   load native functions from an extension (repeatable)\n");
+    fprintf(stderr, "  --flush=POLICY  write program output after every line, when the buffer fills,\n");
+    fprintf(stderr, "                  or at exit (default: line on a terminal, block otherwise)\n");
+    fprintf(stderr, "  --ast           print the syntax tree before running the program\n");
+    fprintf(stderr, "  --no-cache      neither use nor write the parsed program cache (file.yaplc)\n");
+}
+
+/* The whole of f, which is left at its start; NULL if it cannot be read */
+static char* read_source(FILE *f, size_t *len) {
+    if (fseek(f, 0, SEEK_END) != 0) return NULL;
+    long size = ftell(f);
+    rewind(f);
+    if (size < 0) return NULL;
+    char *source = (char*)malloc((size_t)size + 1);
+    if (!source) return NULL;
+    *len = fread(source, 1, (size_t)size, f);
+    rewind(f);
+    if (*len != (size_t)size) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    int use_vm = 0;
+    int regex_stats = 0;
+    int jit_stats = 0;
+    int memo = 0;
+    int memo_stats = 0;
+    int profile = 0;
+    int print_tree = 0;
+    int use_cache = 1;
+    int opt_level = OPT_LEVEL_DEFAULT;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--vm") == 0) {
+            use_vm = 1;
+        } else if (strncmp(argv[i], "--max-depth=", 12) == 0 && atoi(argv[i] + 12) > 0) {
+            vm_set_max_depth(atoi(argv[i] + 12));
+        } else if (strcmp(argv[i], "--no-jit") == 0) {
+            jit_set_enabled(0);
+        } else if (strcmp(argv[i], "--jit-stats") == 0) {
+            jit_stats = 1;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            memo_enable(NULL);
+            memo = 1;
+        } else if (strncmp(argv[i], "--memo=", 7) == 0) {
+            memo_enable(argv[i] + 7);
+            memo = 1;
+        } else if (strcmp(argv[i], "--memo-stats") == 0) {
+            memo_stats = 1;
+        } else if (strcmp(argv[i], "--regex-stats") == 0) {
+            regex_stats = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile_enable(NULL);
+            profile = 1;
+        } else if (strncmp(argv[i], "--profile-folded=", 17) == 0 && argv[i][17]) {
+            profile_enable(argv[i] + 17);
+            profile = 1;
+        } else if (strcmp(argv[i], "--flush=line") == 0) {
+            output_set_flush(OUTPUT_FLUSH_LINE);
+        } else if (strcmp(argv[i], "--flush=block") == 0) {
+            output_set_flush(OUTPUT_FLUSH_BLOCK);
+        } else if (strcmp(argv[i], "--flush=exit") == 0) {
+            output_set_flush(OUTPUT_FLUSH_EXIT);
+        } else if (strcmp(argv[i], "--ast") == 0) {
+            print_tree = 1;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strncmp(argv[i], "--load=", 7) == 0) {
+            if (builtins_load(argv[i] + 7) != 0) return 1;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '2' &&
+                   argv[i][3] == '\0') {
+            opt_level = argv[i][2] - '0';
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    
+    if (profile) {
+        /* Native code and bytecode have no statements to count */
+        jit_set_enabled(0);
+        use_vm = 0;
+    }
+    if (memo && use_vm) {
+        /* Only the tree walker consults the result caches */
+        fprintf(stderr, "Warning: --memo is not supported by the VM, using the tree-walking interpreter\n");
+        use_vm = 0;
+    }
+    
+    /* An unchanged program file is loaded already parsed and optimized */
+    FILE *in = stdin;
+    ASTNode *root = NULL;
+    char *source = NULL;
+    size_t source_len = 0;
+    char *cache_path = NULL;
+    if (path) {
+        in = fopen(path, "r");
+        if (!in) {
+            perror("Error opening file");
+            return 1;
+        }
+        if (use_cache && (source = read_source(in, &source_len))) {
+            cache_path = ast_cache_path(path);
+            root = ast_cache_load(cache_path, source, source_len, opt_level);
+        }
+    }
+    
+    int result = 0;
+    if (!root) {
+        result = parse_file(in, &root, NULL, 0);
+        if (result == 0 && root) {
+            optimize_program(root, opt_level);
+            if (cache_path) ast_cache_save(cache_path, root, source, source_len, opt_level);
+        }
+    }
+    free(source);
+    free(cache_path);
+    
+    if (result == 0 && root) {
+        builtins_warn_shadowed(root);
+        if (print_tree) {
+            printf("\n=== Abstract Syntax Tree ===\n");
+            print_ast(root, 0);
+            printf("\n=== Program Execution ===\n");
+        }
+        
+        BytecodeProgram *program = use_vm ? compile_program(root) : NULL;
+        if (program) {
+            vm_execute(program);
+            free_bytecode_program(program);
+        } else {
+            execute_program(root);
+        }
+        output_flush();
+        if (jit_stats) jit_print_stats(stderr);
+        if (memo_stats) memo_print_stats(stderr);
+        if (regex_stats) regex_print_stats(stderr);
+        if (profile) profile_report(stderr, path);
+    }
+    output_free();
+    input_free();
+    jit_free();
+    memo_free();
+    profile_free();
+    regex_cache_free();
+    free_ast();
+    builtins_free();
+    atom_table_free();
+    
+    if (in != stdin) {
+        fclose(in);
+    }
+    
+    return result;
+}
@@ -0,0 +1,227 @@
+#include "interpreter.h"
+#include "threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Blocked matrix multiplication, C = A @ B.
+ *
+ * B is processed in KC x NC blocks that are packed into a contiguous
+ * buffer of NR-column panels, so the micro-kernel streams B from one
+ * sequential array that stays in L2 while A's rows stay in L1. The
+ * micro-kernel updates an MR x NR tile of C in registers.
+ *
+ * Rows of every matrix are padded to whole MATRIX_ALIGN units and the
+ * padding is zero, so column tiles never need a tail: padded columns of B
+ * only produce zeros in the padding of C.
+ *
+ * Products of at least YAPL_MATMUL_PARALLEL_MIN multiply-adds (default
+ * MATMUL_PARALLEL_MIN) are split into tiles of C computed on the thread
+ * pool.
+ */
+
+/* Use AVX2/FMA kernels on x86 when the CPU supports them */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(MATMUL_NO_SIMD)
+#define MATMUL_AVX2 1
+#include <immintrin.h>
+#else
+#define MATMUL_AVX2 0
+#endif
+
+#define MR 6      /* Rows of C per micro-tile */
+#define NR 8      /* Columns of C per micro-tile */
+#define KC 256    /* Depth of a packed block of B */
+#define NC 256    /* Columns of a packed block of B */
+
+#define MATMUL_PARALLEL_MIN (1L << 21)   /* About a 128x128x128 product */
+
+_Static_assert(MATRIX_ALIGN % (NR * sizeof(double)) == 0,
+               "matrix rows must pad to whole micro-tile columns");
+
+typedef void (*MicroKernel)(int mr, int kc, const double *a, int lda,
+                            const double *bp, double *c, int ldc);
+
+/* Copy B[k0..k0+kc) x [j0..j0+nc) into NR-column panels, each kc x NR */
+static void pack_b(const Matrix *b, int k0, int kc, int j0, int nc, double *pack) {
+    for (int jp = 0; jp < nc; jp += NR) {
+        for (int p = 0; p < kc; p++) {
+            memcpy(pack, &MATRIX_AT(b, k0 + p, j0 + jp), NR * sizeof(double));
+            pack += NR;
+        }
+    }
+}
+
+static void kernel_scalar(int mr, int kc, const double *a, int lda,
+                          const double *bp, double *c, int ldc) {
+    for (int r = 0; r < mr; r++) {
+        double acc[NR];
+        for (int j = 0; j < NR; j++) acc[j] = c[r * ldc + j];
+        for (int p = 0; p < kc; p++) {
+            double av = a[r * lda + p];
+            for (int j = 0; j < NR; j++) acc[j] += av * bp[p * NR + j];
+        }
+        for (int j = 0; j < NR; j++) c[r * ldc + j] = acc[j];
+    }
+}
+
+#if MATMUL_AVX2
+__attribute__((target("avx2,fma")))
+static void kernel_avx2_row(int kc, const double *a, const double *bp, double *c) {
+    __m256d c0 = _mm256_load_pd(c);
+    __m256d c1 = _mm256_load_pd(c + 4);
+    for (int p = 0; p < kc; p++) {
+        __m256d av = _mm256_broadcast_sd(&a[p]);
+        c0 = _mm256_fmadd_pd(av, _mm256_load_pd(bp), c0);
+        c1 = _mm256_fmadd_pd(av, _mm256_load_pd(bp + 4), c1);
+        bp += NR;
+    }
+    _mm256_store_pd(c, c0);
+    _mm256_store_pd(c + 4, c1);
+}
+
+__attribute__((target("avx2,fma")))
+static void kernel_avx2(int mr, int kc, const double *a, int lda,
+                        const double *bp, double *c, int ldc) {
+    if (mr < MR) {
+        for (int r = 0; r < mr; r++) {
+            kernel_avx2_row(kc, a + r * lda, bp, c + r * ldc);
+        }
+        return;
+    }
+
+    /* Full 6x8 tile: 12 accumulators, 2 B vectors, 1 broadcast */
+#define ROW_LOAD(r) \
+    __m256d c##r##0 = _mm256_load_pd(c + r * ldc); \
+    __m256d c##r##1 = _mm256_load_pd(c + r * ldc + 4);
+#define ROW_FMA(r) do { \
+        __m256d av = _mm256_broadcast_sd(&a[r * lda + p]); \
+        c##r##0 = _mm256_fmadd_pd(av, b0, c##r##0); \
+        c##r##1 = _mm256_fmadd_pd(av, b1, c##r##1); \
+    } while (0)
+#define ROW_STORE(r) \
+    _mm256_store_pd(c + r * ldc, c##r##0); \
+    _mm256_store_pd(c + r * ldc + 4, c##r##1);
+
+    ROW_LOAD(0) ROW_LOAD(1) ROW_LOAD(2) ROW_LOAD(3) ROW_LOAD(4) ROW_LOAD(5)
+    for (int p = 0; p < kc; p++) {
+        __m256d b0 = _mm256_load_pd(bp);
+        __m256d b1 = _mm256_load_pd(bp + 4);
+        ROW_FMA(0); ROW_FMA(1); ROW_FMA(2); ROW_FMA(3); ROW_FMA(4); ROW_FMA(5);
+        bp += NR;
+    }
+    ROW_STORE(0) ROW_STORE(1) ROW_STORE(2) ROW_STORE(3) ROW_STORE(4) ROW_STORE(5)
+
+#undef ROW_LOAD
+#undef ROW_FMA
+#undef ROW_STORE
+}
+#endif
+
+/* Pick the micro-kernel once, from CPUID. Threads racing here all pick
+ * the same one. */
+static MicroKernel select_kernel(void) {
+    static MicroKernel selected = NULL;
+    MicroKernel kernel = __atomic_load_n(&selected, __ATOMIC_RELAXED);
+    if (!kernel) {
+        kernel = kernel_scalar;
+#if MATMUL_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            kernel = kernel_avx2;
+        }
+#endif
+        __atomic_store_n(&selected, kernel, __ATOMIC_RELAXED);
+    }
+    return kernel;
+}
+
+/* Accumulate rows [i0, i1) and padded columns [j0, j1) of a @ b into c.
+ * j0 and j1 must be multiples of NR. */
+static void multiply_block(const Matrix *a, const Matrix *b, Matrix *c,
+                           int i0, int i1, int j0, int j1) {
+    MicroKernel kernel = select_kernel();
+    int depth = a->cols;
+    double *pack = (double*)aligned_alloc(MATRIX_ALIGN, (size_t)KC * NC * sizeof(double));
+    if (!pack) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    for (int jj = j0; jj < j1; jj += NC) {
+        int nc = j1 - jj < NC ? j1 - jj : NC;
+        for (int kk = 0; kk < depth; kk += KC) {
+            int kc = depth - kk < KC ? depth - kk : KC;
+            pack_b(b, kk, kc, jj, nc, pack);
+            for (int i = i0; i < i1; i += MR) {
+                int mr = i1 - i < MR ? i1 - i : MR;
+                for (int jp = 0; jp < nc; jp += NR) {
+                    kernel(mr, kc, &MATRIX_AT(a, i, kk), a->stride,
+                           pack + (size_t)jp * kc, &MATRIX_AT(c, i, jj + jp), c->stride);
+                }
+            }
+        }
+    }
+
+    free(pack);
+}
+
+/* A grid of C tiles for the thread pool: row bands of whole MR tiles and
+ * column bands of whole NC blocks */
+typedef struct {
+    const Matrix *a;
+    const Matrix *b;
+    Matrix *c;
+    int row_step;
+    int col_bands;
+} ParallelProduct;
+
+static void multiply_tile(void *arg, int index) {
+    ParallelProduct *job = (ParallelProduct*)arg;
+    int i0 = (index / job->col_bands) * job->row_step;
+    int j0 = (index % job->col_bands) * NC;
+    int i1 = i0 + job->row_step < job->c->rows ? i0 + job->row_step : job->c->rows;
+    int j1 = j0 + NC < job->c->stride ? j0 + NC : job->c->stride;
+    multiply_block(job->a, job->b, job->c, i0, i1, j0, j1);
+}
+
+static long parallel_threshold(void) {
+    static long cached = -1;
+    long threshold = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if (threshold < 0) {
+        const char *env = getenv("YAPL_MATMUL_PARALLEL_MIN");
+        threshold = env ? atol(env) : MATMUL_PARALLEL_MIN;
+        __atomic_store_n(&cached, threshold, __ATOMIC_RELAXED);
+    }
+    return threshold;
+}
+
+Matrix* matrix_multiply(Matrix *a, Matrix *b) {
+    if (a->cols != b->rows) {
+        fprintf(stderr, "Runtime error: Matrix dimension mismatch for multiplication (%dx%d) @ (%dx%d)\n",
+                a->rows, a->cols, b->rows, b->cols);
+        runtime_abort();
+    }
+
+    Matrix *result = create_matrix(a->rows, b->cols);
+    long work = (long)a->rows * a->cols * b->cols;
+    int threads = work >= parallel_threshold() ? thread_pool_size() : 1;
+
+    if (threads == 1) {
+        multiply_block(a, b, result, 0, a->rows, 0, result->stride);
+        return result;
+    }
+
+    /* Aim for about two tiles per thread, keeping row bands at least
+     * 8 micro-tiles tall so packing B stays cheap next to the compute */
+    ParallelProduct job = { a, b, result, 0, (result->stride + NC - 1) / NC };
+    int row_bands = (2 * threads + job.col_bands - 1) / job.col_bands;
+    int max_bands = (a->rows + 8 * MR - 1) / (8 * MR);
+    if (row_bands > max_bands) row_bands = max_bands;
+    if (row_bands < 1) row_bands = 1;
+    job.row_step = ((a->rows + row_bands - 1) / row_bands + MR - 1) / MR * MR;
+    row_bands = (a->rows + job.row_step - 1) / job.row_step;
+
+    thread_pool_run(multiply_tile, &job, row_bands * job.col_bands);
+    return result;
+}
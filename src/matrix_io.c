@@ -0,0 +1,435 @@
+#include "matrix_io.h"
+#include "input.h"
+#include "output.h"
+#include "threadpool.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define TEXT_PARALLEL_MIN (1 << 20)   /* Bytes of text worth splitting */
+#define SAVE_BUFFER_SIZE (1 << 20)
+
+_Static_assert(sizeof(MatrixFileHeader) == MATRIX_ALIGN,
+               "mapped rows must start on a MATRIX_ALIGN boundary");
+
+static void* grow(void *data, size_t size) {
+    data = realloc(data, size);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return data;
+}
+
+/* ---------- Text ---------- */
+
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == ',' || c == ';';
+}
+
+/*
+ * Decimal numbers whose digits fit in 2^53 and whose scale is an exact
+ * power of ten convert with a single correctly rounded operation.
+ * Returns 0 for anything else, which then goes through strtod.
+ */
+static int parse_simple(const char *p, const char *end, double *out) {
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, seen = 0, exp10 = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, seen++) {
+        if (mantissa == 0 && *p == '0') continue;
+        if (++digits > 19) return 0;
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, seen++) {
+            exp10--;
+            if (mantissa == 0 && *p == '0') continue;
+            if (++digits > 19) return 0;
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    if (seen == 0) return 0;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int exp_negative = 0, exp = 0, exp_digits = 0;
+        if (p < end && (*p == '-' || *p == '+')) exp_negative = *p++ == '-';
+        for (; p < end && *p >= '0' && *p <= '9'; p++, exp_digits++) {
+            if (exp < 10000) exp = exp * 10 + (*p - '0');
+        }
+        if (exp_digits == 0) return 0;
+        exp10 += exp_negative ? -exp : exp;
+    }
+    if (p != end) return 0;
+
+    double value;
+    if (mantissa == 0) {
+        value = 0.0;
+    } else if (mantissa <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        value = (double)mantissa;
+        value = exp10 >= 0 ? value * exact_powers[exp10] : value / exact_powers[-exp10];
+    } else {
+        return 0;
+    }
+    *out = negative ? -value : value;
+    return 1;
+}
+
+static int parse_number(const char *p, const char *end, double *out) {
+    if (parse_simple(p, end, out)) return 1;
+
+    char token[64];
+    size_t len = (size_t)(end - p);
+    if (len >= sizeof(token)) return 0;
+    memcpy(token, p, len);
+    token[len] = '\0';
+    char *stop;
+    *out = strtod(token, &stop);
+    return stop == token + len;
+}
+
+/* A run of whole lines, parsed on its own; line numbers are local */
+typedef struct {
+    const char *begin;
+    const char *end;
+    double *values;
+    size_t count;
+    size_t capacity;
+    int rows;
+    int cols;               /* Values on the first row */
+    int lines;
+    int first_row_line;
+    int error_line;         /* First problem, or 0 */
+    const char *bad_token;  /* Invalid number, or NULL for a short/long row */
+    size_t bad_len;
+    int bad_count;          /* Values on the mismatched row */
+} TextChunk;
+
+static void parse_chunk(TextChunk *chunk) {
+    const char *p = chunk->begin;
+    const char *end = chunk->end;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        chunk->lines++;
+
+        int n = 0;
+        while (p < eol) {
+            while (p < eol && is_separator(*p)) p++;
+            if (p == eol) break;
+            const char *start = p;
+            while (p < eol && !is_separator(*p)) p++;
+            if (chunk->count == chunk->capacity) {
+                chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 4096;
+                chunk->values = (double*)grow(chunk->values, chunk->capacity * sizeof(double));
+            }
+            if (!parse_number(start, p, &chunk->values[chunk->count])) {
+                chunk->error_line = chunk->lines;
+                chunk->bad_token = start;
+                chunk->bad_len = (size_t)(p - start);
+                return;
+            }
+            chunk->count++;
+            n++;
+        }
+        if (n > 0) {
+            if (chunk->rows == 0) {
+                chunk->cols = n;
+                chunk->first_row_line = chunk->lines;
+            } else if (n != chunk->cols) {
+                chunk->error_line = chunk->lines;
+                chunk->bad_count = n;
+                return;
+            }
+            chunk->rows++;
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+static void parse_task(void *arg, int index) {
+    parse_chunk(&((TextChunk*)arg)[index]);
+}
+
+static void row_length_error(const char *caller, int line, int count, int expected) {
+    fprintf(stderr, "Runtime error: %s() line %d has %d value%s, expected %d\n",
+            caller, line, count, count == 1 ? "" : "s", expected);
+    runtime_abort();
+}
+
+Matrix* matrix_parse_text(const char *text, size_t len, const char *caller) {
+    /* Split at line starts so every chunk holds whole rows */
+    int count = len >= TEXT_PARALLEL_MIN ? thread_pool_size() : 1;
+    TextChunk *chunks = (TextChunk*)calloc(count, sizeof(TextChunk));
+    if (!chunks) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    const char *end = text + len;
+    const char *p = text;
+    for (int i = 0; i < count; i++) {
+        const char *cut = i == count - 1 ? end : text + len / count * (i + 1);
+        if (cut < p) cut = p;
+        const char *eol = cut < end ? memchr(cut, '\n', (size_t)(end - cut)) : NULL;
+        cut = eol ? eol + 1 : end;
+        chunks[i].begin = p;
+        chunks[i].end = cut;
+        p = cut;
+    }
+    if (count > 1) {
+        thread_pool_run(parse_task, chunks, count);
+    } else {
+        parse_chunk(&chunks[0]);
+    }
+
+    /* Report the first problem in file order */
+    int rows = 0, cols = 0, line_base = 0;
+    for (int i = 0; i < count; i++) {
+        TextChunk *chunk = &chunks[i];
+        if (chunk->rows > 0) {
+            if (rows == 0) {
+                cols = chunk->cols;
+            } else if (chunk->cols != cols) {
+                row_length_error(caller, line_base + chunk->first_row_line, chunk->cols, cols);
+            }
+        }
+        if (chunk->error_line) {
+            int line = line_base + chunk->error_line;
+            if (chunk->bad_token) {
+                fprintf(stderr, "Runtime error: %s() line %d: invalid number '%.*s'\n", caller, line,
+                        chunk->bad_len > 32 ? 32 : (int)chunk->bad_len, chunk->bad_token);
+                runtime_abort();
+            }
+            row_length_error(caller, line, chunk->bad_count, cols);
+        }
+        rows += chunk->rows;
+        line_base += chunk->lines;
+    }
+
+    Matrix *mat = create_matrix(rows, cols);
+    int row = 0;
+    for (int i = 0; i < count; i++) {
+        for (int r = 0; r < chunks[i].rows; r++, row++) {
+            memcpy(&MATRIX_AT(mat, row, 0), chunks[i].values + (size_t)r * cols, cols * sizeof(double));
+        }
+        free(chunks[i].values);
+    }
+    free(chunks);
+    return mat;
+}
+
+/* ---------- Binary files ---------- */
+
+/* The mapping becomes the matrix storage when its rows are laid out as
+ * create_matrix would lay them out */
+static Matrix* map_binary(InputBlock *block, const char *path) {
+    MatrixFileHeader header;
+    memcpy(&header, block->data, sizeof(header));
+    size_t available = (block->len - sizeof(header)) / sizeof(double);
+    if (header.rows < 0 || header.rows > INT_MAX || header.cols < 0 || header.cols > INT_MAX ||
+        header.stride < header.cols || header.stride > INT_MAX ||
+        (header.stride > 0 && (size_t)header.rows > available / (size_t)header.stride)) {
+        input_release(block);
+        fprintf(stderr, "Runtime error: loadm() '%s' is not a valid matrix file\n", path);
+        runtime_abort();
+    }
+    int rows = (int)header.rows, cols = (int)header.cols;
+    double *data = (double*)(block->data + sizeof(header));
+
+    if ((size_t)header.stride != matrix_stride(cols)) {
+        Matrix *mat = create_matrix(rows, cols);
+        for (int i = 0; i < rows; i++) {
+            memcpy(&MATRIX_AT(mat, i, 0), data + (size_t)i * header.stride, cols * sizeof(double));
+        }
+        input_release(block);
+        return mat;
+    }
+
+    /* Kernels rely on zero padding; the mapping is private, so fixing a
+     * foreign file's padding leaves the file alone */
+    for (int i = 0; i < rows && header.stride > cols; i++) {
+        double *pad = data + (size_t)i * header.stride + cols;
+        for (int j = 0; j < header.stride - cols; j++) {
+            if (pad[j] != 0.0) pad[j] = 0.0;
+        }
+    }
+
+    Matrix *mat = (Matrix*)malloc(sizeof(Matrix));
+    if (!mat) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    mat->rows = rows;
+    mat->cols = cols;
+    mat->stride = (int)header.stride;
+    mat->refcount = 1;
+    mat->data = data;
+    mat->mapping = block->data;
+    mat->mapped_bytes = block->len;
+    return mat;
+}
+
+Value matrix_load(const char *path) {
+    InputBlock block = input_map_file(path, "loadm");
+    Value result;
+    result.type = VAL_MATRIX;
+    if (block.len >= sizeof(MatrixFileHeader) && memcmp(block.data, MATRIX_FILE_MAGIC, 8) == 0) {
+        result.data.matrix_val = map_binary(&block, path);
+    } else {
+        result.data.matrix_val = matrix_parse_text(block.data, block.len, "loadm");
+        input_release(&block);
+    }
+    return result;
+}
+
+/* ---------- Saving ---------- */
+
+#define SAVE_BAND_ROWS 256
+#define MAX_FORMATTED 25     /* Longest format_float_exact text */
+
+/* Rows [begin, end) formatted into data, which holds them all */
+typedef struct {
+    Matrix *mat;
+    int begin;
+    int end;
+    char *data;
+    size_t len;
+} TextBand;
+
+static void format_band(void *arg, int index) {
+    TextBand *band = &((TextBand*)arg)[index];
+    char *p = band->data;
+    for (int i = band->begin; i < band->end; i++) {
+        for (int j = 0; j < band->mat->cols; j++) {
+            if (j > 0) *p++ = ',';
+            p += format_float_exact(MATRIX_AT(band->mat, i, j), p);
+        }
+        *p++ = '\n';
+    }
+    band->len = (size_t)(p - band->data);
+}
+
+/* Bands of rows are formatted on the thread pool and written in order */
+static void write_text(FILE *file, Matrix *mat) {
+    int count = thread_pool_size();
+    TextBand *bands = (TextBand*)calloc(count, sizeof(TextBand));
+    size_t band_bytes = (size_t)SAVE_BAND_ROWS * ((size_t)mat->cols * (MAX_FORMATTED + 1) + 1) + 32;
+    if (!bands) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        bands[i].mat = mat;
+        bands[i].data = (char*)grow(NULL, band_bytes);
+    }
+
+    for (int row = 0; row < mat->rows; ) {
+        int used = 0;
+        for (; used < count && row < mat->rows; used++) {
+            bands[used].begin = row;
+            row = row + SAVE_BAND_ROWS < mat->rows ? row + SAVE_BAND_ROWS : mat->rows;
+            bands[used].end = row;
+        }
+        if (used > 1) {
+            thread_pool_run(format_band, bands, used);
+        } else {
+            format_band(bands, 0);
+        }
+        for (int i = 0; i < used; i++) {
+            fwrite(bands[i].data, 1, bands[i].len, file);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(bands[i].data);
+    }
+    free(bands);
+}
+
+static void write_binary(FILE *file, Matrix *mat) {
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, 8);
+    header.rows = mat->rows;
+    header.cols = mat->cols;
+    header.stride = mat->stride;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(mat->data, sizeof(double), (size_t)mat->rows * mat->stride, file);
+}
+
+/* A new file next to path for matrix_save. The name holds the process id
+ * and a counter, so concurrent saves to the same path, from other threads
+ * or other processes, each write their own file. */
+static FILE* create_temp(const char *path, char **tmp_path) {
+    static unsigned int serial;
+    size_t size = strlen(path) + 48;
+    char *tmp = (char*)grow(NULL, size);
+    for (;;) {
+        unsigned int n = __atomic_fetch_add(&serial, 1, __ATOMIC_RELAXED);
+        snprintf(tmp, size, "%s.%ld.%u.tmp", path, (long)getpid(), n);
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            FILE *file = fdopen(fd, "wb");
+            if (file) {
+                *tmp_path = tmp;
+                return file;
+            }
+            int error = errno;
+            close(fd);
+            remove(tmp);
+            errno = error;
+            break;
+        }
+        if (errno != EEXIST) break;
+    }
+    int error = errno;      /* For the caller's message */
+    free(tmp);
+    errno = error;
+    return NULL;
+}
+
+/* Written to a temporary file and renamed into place, so a matrix still
+ * mapped from path keeps its contents */
+void matrix_save(const char *path, const Value *value) {
+    if (value->type != VAL_MATRIX) {
+        fprintf(stderr, "Runtime error: savem() expects a matrix\n");
+        runtime_abort();
+    }
+    size_t len = strlen(path);
+    int text = len >= 4 && strcasecmp(path + len - 4, ".csv") == 0;
+
+    char *tmp = NULL;
+    FILE *file = create_temp(path, &tmp);
+    if (!file) {
+        fprintf(stderr, "Runtime error: savem() cannot write '%s': %s\n", path, strerror(errno));
+        runtime_abort();
+    }
+    setvbuf(file, NULL, _IOFBF, SAVE_BUFFER_SIZE);
+    if (text) {
+        write_text(file, value->data.matrix_val);
+    } else {
+        write_binary(file, value->data.matrix_val);
+    }
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    if (failed || rename(tmp, path) != 0) {
+        fprintf(stderr, "Runtime error: savem() cannot write '%s': %s\n", path, strerror(errno));
+        remove(tmp);
+        free(tmp);
+        runtime_abort();
+    }
+    free(tmp);
+}
@@ -0,0 +1,351 @@
+#include "memo.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    Value args[MEMO_MAX_ARGS];
+    Value result;
+    int used;
+} MemoEntry;
+
+struct MemoCache {
+    int num_params;
+    MemoEntry *entries;     /* MEMO_CACHE_SIZE of them, allocated on first store */
+    int used;
+    long hits;
+    long misses;
+    long evictions;
+};
+
+typedef struct {
+    ASTNode *decl;
+    int pure;
+    char reason[128];       /* Why it is not memoized */
+    MemoCache *cache;
+} MemoFunction;
+
+/* Set once, before any program runs */
+static struct {
+    int enabled;
+    char *names;            /* Functions asked for by name; NULL for all */
+} options = { 0, NULL };
+
+/* Caches of the program the thread runs */
+static _Thread_local struct {
+    MemoFunction *fns;      /* One per function declaration */
+    int fn_count;
+} memo = { NULL, 0 };
+
+void memo_enable(const char *names) {
+    options.enabled = 1;
+    free(options.names);
+    options.names = names ? strdup(names) : NULL;
+}
+
+static int is_selected(Atom name) {
+    if (!options.names) return 1;
+    size_t len = strlen(name);
+    for (const char *p = options.names; *p; ) {
+        const char *end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == len && strncmp(p, name, n) == 0) return 1;
+        if (!end) break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+static int is_scalar(DataType type) {
+    return type == TYPE_INT || type == TYPE_FLOAT || type == TYPE_BOOL;
+}
+
+/* ---------- Purity analysis ---------- */
+
+static void set_impure(MemoFunction *fn, const char *fmt, ...) {
+    if (!fn->pure) return;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(fn->reason, sizeof(fn->reason), fmt, args);
+    va_end(args);
+    fn->pure = 0;
+}
+
+/* The function a call by this name always reaches, or NULL */
+static MemoFunction* find_function(Atom name) {
+    for (int i = 0; i < memo.fn_count; i++) {
+        ASTNode *decl = memo.fns[i].decl;
+        if (decl->data.func_decl.name == name) {
+            return decl->data.func_decl.fixed ? &memo.fns[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static int param_count(ASTNode *decl) {
+    ASTNode *params = decl->data.func_decl.params;
+    return params ? params->data.list.count : 0;
+}
+
+/* Clear fn->pure if anything in node reads global state or has effects.
+ * Stores inside a function always bind its own frame, so only reads and
+ * calls matter. */
+static void check_purity(ASTNode *node, void *ctx) {
+    MemoFunction *fn = (MemoFunction*)ctx;
+    if (!node || !fn->pure) return;
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            VarRef ref = node->data.identifier.ref;
+            Atom name = node->data.identifier.name;
+            if (ref.slot < 0) {
+                set_impure(fn, "reads global '%s'", name);
+            } else if (ref.slot >= param_count(fn->decl) && ref.global_slot >= 0) {
+                /* An unset local reads through to the global */
+                set_impure(fn, "may read global '%s' before assigning '%s'", name, name);
+            }
+            return;
+        }
+
+        case NODE_ASSIGN:
+            if (node->data.binary_op.left->type != NODE_IDENTIFIER) {
+                check_purity(node->data.binary_op.left, ctx);
+            }
+            check_purity(node->data.binary_op.right, ctx);
+            return;
+
+        case NODE_FUNC_CALL: {
+            ASTNode *func = node->data.func_call.func;
+            ASTNode *args = node->data.func_call.args;
+            if (func->type != NODE_IDENTIFIER) {
+                set_impure(fn, "calls a computed function");
+                return;
+            }
+            Atom name = func->data.identifier.name;
+            if (node->data.func_call.builtin) {
+                set_impure(fn, "calls %s", name);
+                return;
+            }
+            MemoFunction *callee = func->data.identifier.ref.slot < 0 ? find_function(name) : NULL;
+            if (!callee) {
+                set_impure(fn, "calls '%s', which is not a fixed function", name);
+                return;
+            }
+            /* Unbound parameters would read through to globals */
+            if ((args ? args->data.list.count : 0) != param_count(callee->decl)) {
+                set_impure(fn, "calls '%s' with the wrong number of arguments", name);
+                return;
+            }
+            if (!callee->pure) {
+                set_impure(fn, "calls '%s', which is not pure", name);
+                return;
+            }
+            check_purity(args, ctx);
+            return;
+        }
+
+        default:
+            ast_visit_children(node, check_purity, ctx);
+            return;
+    }
+}
+
+/* Why a pure function still cannot be cached, or NULL */
+static const char* uncacheable(ASTNode *decl) {
+    ASTNode *params = decl->data.func_decl.params;
+    if (param_count(decl) > MEMO_MAX_ARGS) return "has too many parameters";
+    for (int i = 0; i < param_count(decl); i++) {
+        if (!is_scalar(params->data.list.items[i]->data.param.type.base_type)) {
+            return "takes a parameter that is not int, float or bool";
+        }
+    }
+    if (!is_scalar(decl->data.func_decl.return_type.base_type)) {
+        return "does not return an int, float or bool";
+    }
+    return NULL;
+}
+
+static void drop_functions(void) {
+    for (int i = 0; i < memo.fn_count; i++) {
+        MemoFunction *fn = &memo.fns[i];
+        if (fn->cache) {
+            free(fn->cache->entries);
+            free(fn->cache);
+            fn->decl->data.func_decl.memo = NULL;
+        }
+    }
+    free(memo.fns);
+    memo.fns = NULL;
+    memo.fn_count = 0;
+}
+
+void memo_init(ASTNode *root) {
+    drop_functions();
+    if (!options.enabled || !root || root->type != NODE_DECL_LIST) return;
+
+    int count = 0;
+    for (int i = 0; i < root->data.list.count; i++) {
+        if (root->data.list.items[i]->type == NODE_FUNC_DECL) count++;
+    }
+    memo.fns = (MemoFunction*)calloc(count > 0 ? count : 1, sizeof(MemoFunction));
+    if (!memo.fns) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL) continue;
+        MemoFunction *fn = &memo.fns[memo.fn_count++];
+        fn->decl = decl;
+        fn->pure = 1;
+        if (decl->data.func_decl.name == atom_main) set_impure(fn, "runs in the global frame");
+    }
+
+    /* Assume every function pure until a body proves otherwise */
+    int changed;
+    do {
+        changed = 0;
+        for (int i = 0; i < memo.fn_count; i++) {
+            MemoFunction *fn = &memo.fns[i];
+            if (!fn->pure) continue;
+            check_purity(fn->decl->data.func_decl.body, fn);
+            if (!fn->pure) changed = 1;
+        }
+    } while (changed);
+
+    for (int i = 0; i < memo.fn_count; i++) {
+        MemoFunction *fn = &memo.fns[i];
+        if (!fn->pure || !is_selected(fn->decl->data.func_decl.name)) continue;
+        const char *reason = uncacheable(fn->decl);
+        if (reason) {
+            snprintf(fn->reason, sizeof(fn->reason), "%s", reason);
+            continue;
+        }
+        fn->cache = (MemoCache*)calloc(1, sizeof(MemoCache));
+        if (!fn->cache) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+        fn->cache->num_params = param_count(fn->decl);
+        fn->decl->data.func_decl.memo = fn->cache;
+    }
+}
+
+/* ---------- Caches ---------- */
+
+/* Arguments match when they are the same value of the same type; floats
+ * compare by representation, so -0.0 and NaNs key their own entries */
+static int same_args(const Value *a, const Value *b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i].type != b[i].type) return 0;
+        switch (a[i].type) {
+            case VAL_INT:
+                if (a[i].data.int_val != b[i].data.int_val) return 0;
+                break;
+            case VAL_BOOL:
+                if (a[i].data.bool_val != b[i].data.bool_val) return 0;
+                break;
+            default:
+                if (memcmp(&a[i].data.float_val, &b[i].data.float_val, sizeof(double)) != 0) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+int memo_lookup(MemoCache *cache, Value *args, int nargs, MemoKey *key, Value *result) {
+    key->usable = 0;
+    if (nargs != cache->num_params) return 0;
+
+    /* FNV-1a over each argument's type and bits, 32 at a time */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < nargs; i++) {
+        uint64_t bits;
+        switch (args[i].type) {
+            case VAL_INT:   bits = (uint32_t)args[i].data.int_val; break;
+            case VAL_BOOL:  bits = (uint32_t)args[i].data.bool_val; break;
+            case VAL_FLOAT: memcpy(&bits, &args[i].data.float_val, sizeof(bits)); break;
+            default:        return 0;
+        }
+        hash = (hash ^ (uint32_t)args[i].type) * 16777619u;
+        hash = (hash ^ (uint32_t)bits) * 16777619u;
+        hash = (hash ^ (uint32_t)(bits >> 32)) * 16777619u;
+        key->args[i] = args[i];
+    }
+    /* Fold the high bits (where doubles differ) into the low ones that
+     * pick the entry */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    key->hash = hash;
+    key->usable = 1;
+
+    if (cache->entries) {
+        MemoEntry *entry = &cache->entries[hash % MEMO_CACHE_SIZE];
+        if (entry->used && same_args(entry->args, key->args, nargs)) {
+            cache->hits++;
+            *result = entry->result;
+            return 1;
+        }
+    }
+    cache->misses++;
+    return 0;
+}
+
+void memo_store(MemoCache *cache, MemoKey *key, Value *result) {
+    if (!key->usable) return;
+    if (result->type != VAL_INT && result->type != VAL_FLOAT && result->type != VAL_BOOL) return;
+
+    if (!cache->entries) {
+        cache->entries = (MemoEntry*)calloc(MEMO_CACHE_SIZE, sizeof(MemoEntry));
+        if (!cache->entries) return;
+    }
+    MemoEntry *entry = &cache->entries[key->hash % MEMO_CACHE_SIZE];
+    if (!entry->used) {
+        cache->used++;
+    } else if (!same_args(entry->args, key->args, cache->num_params)) {
+        cache->evictions++;
+    }
+    memcpy(entry->args, key->args, cache->num_params * sizeof(Value));
+    entry->result = *result;
+    entry->used = 1;
+}
+
+void memo_print_stats(FILE *out) {
+    if (!options.enabled) {
+        fprintf(out, "Memo: disabled\n");
+        return;
+    }
+    int memoized = 0;
+    long hits = 0, misses = 0, evictions = 0;
+    for (int i = 0; i < memo.fn_count; i++) {
+        MemoCache *cache = memo.fns[i].cache;
+        if (!cache) continue;
+        memoized++;
+        hits += cache->hits;
+        misses += cache->misses;
+        evictions += cache->evictions;
+    }
+    fprintf(out, "Memo: %d function%s memoized, %ld hits, %ld misses, %ld evictions\n",
+            memoized, memoized == 1 ? "" : "s", hits, misses, evictions);
+
+    for (int i = 0; i < memo.fn_count; i++) {
+        MemoFunction *fn = &memo.fns[i];
+        Atom name = fn->decl->data.func_decl.name;
+        if (name == atom_main || !is_selected(name)) continue;
+        if (fn->cache) {
+            fprintf(out, "  %s: %ld hits, %ld misses, %ld evictions, %d of %d entries used\n",
+                    name, fn->cache->hits, fn->cache->misses, fn->cache->evictions,
+                    fn->cache->used, MEMO_CACHE_SIZE);
+        } else {
+            fprintf(out, "  %s: not memoized, %s\n", name, fn->reason);
+        }
+    }
+}
+
+void memo_free(void) {
+    drop_functions();
+    free(options.names);
+    options.names = NULL;
+}
@@ -0,0 +1,333 @@
+#include "optimizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* Replace node in place with a copy of another node, keeping its line */
+static void replace_node(ASTNode *node, ASTNode *with) {
+    int line = node->line_number;
+    *node = *with;
+    node->line_number = line;
+}
+
+/* Turn a statement into the empty statement `;` */
+static void make_empty(ASTNode *node) {
+    node->type = NODE_EXPR_STMT;
+    node->data.unary_op.operand = NULL;
+    node->data_type = create_type(TYPE_UNKNOWN);
+}
+
+static int is_literal(ASTNode *node) {
+    return node->type == NODE_INT_LITERAL || node->type == NODE_FLOAT_LITERAL ||
+           node->type == NODE_STRING_LITERAL || node->type == NODE_BOOL_LITERAL;
+}
+
+static int is_number(ASTNode *node) {
+    return node->type == NODE_INT_LITERAL || node->type == NODE_FLOAT_LITERAL;
+}
+
+static double number_value(ASTNode *node) {
+    return node->type == NODE_INT_LITERAL ? node->data.int_literal.value
+                                          : node->data.float_literal.value;
+}
+
+/* Truth value of a literal condition, as if/while compute it; -1 if unknown */
+static int literal_truth(ASTNode *node) {
+    if (node->type == NODE_BOOL_LITERAL) return node->data.bool_literal.value != 0;
+    if (node->type == NODE_INT_LITERAL) return node->data.int_literal.value != 0;
+    return -1;
+}
+
+/* Literal-only equality, with the interpreter's rules: ints, bools and
+ * strings compare within their own type, anything else is unequal */
+static int literals_equal(ASTNode *l, ASTNode *r, int with_strings) {
+    if (l->type == NODE_INT_LITERAL && r->type == NODE_INT_LITERAL) {
+        return l->data.int_literal.value == r->data.int_literal.value;
+    }
+    if (l->type == NODE_BOOL_LITERAL && r->type == NODE_BOOL_LITERAL) {
+        return l->data.bool_literal.value == r->data.bool_literal.value;
+    }
+    if (with_strings && l->type == NODE_STRING_LITERAL && r->type == NODE_STRING_LITERAL) {
+        return strcmp(l->data.string_literal.value, r->data.string_literal.value) == 0;
+    }
+    return 0;
+}
+
+static void fold_binary(ASTNode *node) {
+    ASTNode *left = node->data.binary_op.left;
+    ASTNode *right = node->data.binary_op.right;
+    int line = node->line_number;
+
+    switch (node->type) {
+        case NODE_ADD:
+        case NODE_SUB:
+        case NODE_MUL: {
+            if (!is_number(left) || !is_number(right)) return;
+            if (left->type == NODE_INT_LITERAL && right->type == NODE_INT_LITERAL) {
+                int l = left->data.int_literal.value;
+                int r = right->data.int_literal.value;
+                int v;
+                int overflow = node->type == NODE_ADD ? __builtin_add_overflow(l, r, &v) :
+                               node->type == NODE_SUB ? __builtin_sub_overflow(l, r, &v) :
+                                                        __builtin_mul_overflow(l, r, &v);
+                if (!overflow) replace_node(node, create_int_literal(v, line));
+                return;
+            }
+            double l = number_value(left);
+            double r = number_value(right);
+            double v = node->type == NODE_ADD ? l + r : node->type == NODE_SUB ? l - r : l * r;
+            replace_node(node, create_float_literal(v, line));
+            return;
+        }
+
+        case NODE_DIV:
+            if (is_number(left) && is_number(right) && number_value(right) != 0) {
+                replace_node(node, create_float_literal(number_value(left) / number_value(right), line));
+            }
+            return;
+
+        case NODE_MOD:
+            if (left->type == NODE_INT_LITERAL && right->type == NODE_INT_LITERAL &&
+                right->data.int_literal.value != 0 &&
+                !(left->data.int_literal.value == INT_MIN && right->data.int_literal.value == -1)) {
+                replace_node(node, create_int_literal(left->data.int_literal.value %
+                                                      right->data.int_literal.value, line));
+            }
+            return;
+
+        case NODE_LT:
+        case NODE_GT:
+        case NODE_LE:
+        case NODE_GE: {
+            if (!is_number(left) || !is_number(right)) return;
+            double l = number_value(left);
+            double r = number_value(right);
+            int v = node->type == NODE_LT ? l < r : node->type == NODE_GT ? l > r :
+                    node->type == NODE_LE ? l <= r : l >= r;
+            replace_node(node, create_bool_literal(v, line));
+            return;
+        }
+
+        case NODE_EQ:
+            if (is_literal(left) && is_literal(right)) {
+                replace_node(node, create_bool_literal(literals_equal(left, right, 1), line));
+            }
+            return;
+
+        case NODE_NE:
+            /* The interpreter's != does not compare strings */
+            if (is_literal(left) && is_literal(right)) {
+                replace_node(node, create_bool_literal(!literals_equal(left, right, 0), line));
+            }
+            return;
+
+        case NODE_AND:
+        case NODE_OR: {
+            if (left->type != NODE_BOOL_LITERAL) return;
+            int short_circuit = node->type == NODE_AND ? !left->data.bool_literal.value
+                                                       : left->data.bool_literal.value;
+            if (short_circuit) {
+                replace_node(node, create_bool_literal(node->type == NODE_OR, line));
+            } else if (right->type == NODE_BOOL_LITERAL) {
+                replace_node(node, create_bool_literal(right->data.bool_literal.value != 0, line));
+            }
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+
+/* Fold literal subtrees bottom-up and drop statements that cannot run */
+static void fold(ASTNode *node, void *ctx) {
+    if (!node) return;
+
+    ast_visit_children(node, fold, ctx);
+
+    switch (node->type) {
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV: case NODE_MOD:
+        case NODE_LT: case NODE_GT: case NODE_LE: case NODE_GE:
+        case NODE_EQ: case NODE_NE: case NODE_AND: case NODE_OR:
+            fold_binary(node);
+            break;
+
+        case NODE_NOT: {
+            ASTNode *operand = node->data.unary_op.operand;
+            if (operand->type == NODE_BOOL_LITERAL) {
+                replace_node(node, create_bool_literal(!operand->data.bool_literal.value, node->line_number));
+            }
+            break;
+        }
+
+        case NODE_UNARY_MINUS: {
+            ASTNode *operand = node->data.unary_op.operand;
+            if (operand->type == NODE_INT_LITERAL && operand->data.int_literal.value != INT_MIN) {
+                replace_node(node, create_int_literal(-operand->data.int_literal.value, node->line_number));
+            } else if (operand->type == NODE_FLOAT_LITERAL) {
+                replace_node(node, create_float_literal(-operand->data.float_literal.value, node->line_number));
+            }
+            break;
+        }
+
+        case NODE_IF:
+        case NODE_IF_ELSE: {
+            int truth = literal_truth(node->data.if_stmt.condition);
+            if (truth == 1) {
+                replace_node(node, node->data.if_stmt.then_stmt);
+            } else if (truth == 0 && node->data.if_stmt.else_stmt) {
+                replace_node(node, node->data.if_stmt.else_stmt);
+            } else if (truth == 0) {
+                make_empty(node);
+            }
+            break;
+        }
+
+        case NODE_WHILE:
+            if (literal_truth(node->data.while_stmt.condition) == 0) make_empty(node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/* Globals that hold the same literal for the whole run */
+typedef struct {
+    Atom name;
+    ASTNode *decl;     /* The one declaration allowed to store to it */
+    int constant;
+} ConstGlobal;
+
+typedef struct {
+    ConstGlobal *globals;
+    int count;
+} ConstTable;
+
+static ConstGlobal* find_const(ConstTable *table, Atom name) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->globals[i].name == name) return &table->globals[i];
+    }
+    return NULL;
+}
+
+/* Any store other than the defining declaration disqualifies a name,
+ * whatever frame it lands in */
+static void disqualify(ConstTable *table, Atom name, ASTNode *store) {
+    ConstGlobal *global = find_const(table, name);
+    if (global && global->decl != store) global->constant = 0;
+}
+
+static void find_stores(ASTNode *node, void *ctx) {
+    ConstTable *table = (ConstTable*)ctx;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_VAR_DECL:
+            disqualify(table, node->data.var_decl.name, node);
+            break;
+        case NODE_ARRAY_DECL:
+            disqualify(table, node->data.array_decl.name, node);
+            break;
+        case NODE_FUNC_DECL:
+            disqualify(table, node->data.func_decl.name, node);
+            break;
+        case NODE_PARAM:
+            disqualify(table, node->data.param.name, node);
+            break;
+        case NODE_FOR_RANGE:
+            disqualify(table, node->data.for_range.iterator, node);
+            break;
+        case NODE_ASSIGN: case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
+            if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
+                disqualify(table, node->data.binary_op.left->data.identifier.name, node);
+            }
+            break;
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC:
+            if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
+                disqualify(table, node->data.unary_op.operand->data.identifier.name, node);
+            }
+            break;
+        default:
+            break;
+    }
+    ast_visit_children(node, find_stores, ctx);
+}
+
+static void substitute(ASTNode *node, void *ctx) {
+    ConstTable *table = (ConstTable*)ctx;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            ConstGlobal *global = find_const(table, node->data.identifier.name);
+            if (global && global->constant) {
+                replace_node(node, global->decl->data.var_decl.initializer);
+            }
+            return;
+        }
+
+        /* Callee and indexed names stay identifiers */
+        case NODE_FUNC_CALL:
+            if (node->data.func_call.func->type != NODE_IDENTIFIER) {
+                substitute(node->data.func_call.func, ctx);
+            }
+            if (node->data.func_call.args) substitute(node->data.func_call.args, ctx);
+            return;
+
+        case NODE_ARRAY_INDEX:
+            if (node->data.array_index.array->type != NODE_IDENTIFIER) {
+                substitute(node->data.array_index.array, ctx);
+            }
+            substitute(node->data.array_index.index, ctx);
+            return;
+
+        default:
+            ast_visit_children(node, substitute, ctx);
+            return;
+    }
+}
+
+/* Substitute constant globals. Candidates come from the leading run of
+ * top-level literal declarations: nothing can read them before those run,
+ * since only function declarations may precede them. */
+static void propagate_constants(ASTNode *root) {
+    ConstTable table = { NULL, 0 };
+    table.globals = (ConstGlobal*)malloc((root->data.list.count + 1) * sizeof(ConstGlobal));
+    if (!table.globals) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type == NODE_FUNC_DECL) continue;
+        if (decl->type != NODE_VAR_DECL || !decl->data.var_decl.initializer ||
+            !is_literal(decl->data.var_decl.initializer)) {
+            break;
+        }
+        if (find_const(&table, decl->data.var_decl.name)) continue;  /* Redeclared: disqualified below */
+        ConstGlobal *global = &table.globals[table.count++];
+        global->name = decl->data.var_decl.name;
+        global->decl = decl;
+        global->constant = 1;
+    }
+
+    if (table.count > 0) {
+        find_stores(root, &table);
+        substitute(root, &table);
+    }
+    free(table.globals);
+}
+
+void optimize_program(ASTNode *root, int level) {
+    if (!root || level <= 0) return;
+
+    fold(root, NULL);
+    if (level >= 2 && root->type == NODE_DECL_LIST) {
+        propagate_constants(root);
+        fold(root, NULL);
+    }
+}
@@ -0,0 +1,431 @@
+#include "output.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Set once, before any program runs */
+static struct {
+    OutputFlush policy;
+    int policy_set;         /* Chosen on the command line */
+} options = { OUTPUT_FLUSH_BLOCK, 0 };
+static pthread_once_t options_once = PTHREAD_ONCE_INIT;
+
+/* Each thread buffers its own output */
+static _Thread_local struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+    OutputSink sink;        /* Receives flushed output instead of stdout */
+    void *sink_ctx;
+} out = { NULL, 0, 0, NULL, NULL };
+
+void output_set_flush(OutputFlush policy) {
+    options.policy = policy;
+    options.policy_set = 1;
+}
+
+/* Pick the default policy and flush the exiting thread's output at exit */
+static void options_init(void) {
+    if (!options.policy_set) {
+        options.policy = isatty(fileno(stdout)) ? OUTPUT_FLUSH_LINE : OUTPUT_FLUSH_BLOCK;
+        options.policy_set = 1;
+    }
+    atexit(output_flush);
+}
+
+static void output_init(void) {
+    pthread_once(&options_once, options_init);
+    out.capacity = OUTPUT_BUFFER_SIZE;
+    out.data = (char*)malloc(out.capacity);
+    if (!out.data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+void output_set_sink(OutputSink sink, void *ctx) {
+    output_flush();
+    out.sink = sink;
+    out.sink_ctx = ctx;
+}
+
+void output_flush(void) {
+    if (out.sink) {
+        if (out.len > 0) out.sink(out.data, out.len, out.sink_ctx);
+        out.len = 0;
+        return;
+    }
+    if (out.len > 0) {
+        fwrite(out.data, 1, out.len, stdout);
+        out.len = 0;
+    }
+    fflush(stdout);
+}
+
+/* Make room for len more bytes */
+static void reserve(size_t len) {
+    if (!out.data) output_init();
+    if (out.len + len <= out.capacity) return;
+    if (options.policy != OUTPUT_FLUSH_EXIT) {
+        output_flush();
+        if (len <= out.capacity) return;
+    }
+    while (out.len + len > out.capacity) out.capacity *= 2;
+    out.data = (char*)realloc(out.data, out.capacity);
+    if (!out.data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+}
+
+void output_write(const char *text, size_t len) {
+    reserve(len);
+    memcpy(out.data + out.len, text, len);
+    out.len += len;
+    if (options.policy == OUTPUT_FLUSH_LINE && memchr(text, '\n', len)) output_flush();
+}
+
+void output_str(const char *text) {
+    output_write(text, strlen(text));
+}
+
+void output_char(char c) {
+    reserve(1);
+    out.data[out.len++] = c;
+    if (c == '\n' && options.policy == OUTPUT_FLUSH_LINE) output_flush();
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void output_int(int value) {
+    char buf[12];
+    char *p = buf + sizeof(buf);
+    unsigned int n = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    while (n >= 100) {
+        p -= 2;
+        memcpy(p, &digit_pairs[(n % 100) * 2], 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[n * 2], 2);
+    } else {
+        *--p = (char)('0' + n);
+    }
+    if (value < 0) *--p = '-';
+    output_write(p, buf + sizeof(buf) - p);
+}
+
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* value * 10^k with a single rounding; |k| <= 22 */
+static double scale(double value, int k) {
+    return k >= 0 ? value * powers_of_ten[k] : value / powers_of_ten[-k];
+}
+
+/*
+ * "%g" keeps six significant digits: the value is scaled so they form
+ * the integer part, which is rounded. The scaled value carries at most
+ * a couple of ulps of error, so the rounding is exact unless the
+ * fraction lies right at one half; those values, and ones too large or
+ * small to scale exactly, go to snprintf. So do values whose scaled form
+ * lies at a decade boundary (999999.5 or 99999.5), where that error
+ * alone decides whether the exponent moves up: 99999.95 prints 99999.9,
+ * not 100000.
+ */
+int format_float(double value, char *buf) {
+    if (!isfinite(value)) return snprintf(buf, 32, "%g", value);
+
+    double original = value;
+    char *p = buf;
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        *p++ = '0';
+        *p = '\0';
+        return p - buf;
+    }
+
+    int exp10 = (int)floor(log10(value));
+    if (exp10 < -16 || exp10 > 26) return snprintf(buf, 32, "%g", original);
+    double scaled = scale(value, 5 - exp10);
+    if (fabs(scaled - 999999.5) < 1e-6 || fabs(scaled - 99999.5) < 1e-6) {
+        return snprintf(buf, 32, "%g", original);
+    }
+    if (scaled >= 999999.5) {
+        exp10++;
+        scaled = scale(value, 5 - exp10);
+    } else if (scaled < 99999.5) {
+        exp10--;
+        scaled = scale(value, 5 - exp10);
+    }
+    double fraction = scaled - floor(scaled);
+    if (fabs(fraction - 0.5) < 1e-6) return snprintf(buf, 32, "%g", original);
+
+    long mantissa = (long)(scaled + 0.5);
+    if (mantissa >= 1000000) {
+        mantissa /= 10;
+        exp10++;
+    }
+
+    char digits[6];
+    for (int i = 5; i >= 0; i--) {
+        digits[i] = (char)('0' + mantissa % 10);
+        mantissa /= 10;
+    }
+    int count = 6;
+    while (count > 1 && digits[count - 1] == '0') count--;
+
+    if (exp10 < -4 || exp10 >= 6) {
+        *p++ = digits[0];
+        if (count > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, count - 1);
+            p += count - 1;
+        }
+        *p++ = 'e';
+        *p++ = exp10 < 0 ? '-' : '+';
+        int e = exp10 < 0 ? -exp10 : exp10;
+        *p++ = (char)('0' + e / 10 % 10);
+        *p++ = (char)('0' + e % 10);
+    } else if (exp10 >= 0) {
+        memcpy(p, digits, exp10 + 1);
+        p += exp10 + 1;
+        if (count > exp10 + 1) {
+            *p++ = '.';
+            memcpy(p, digits + exp10 + 1, count - exp10 - 1);
+            p += count - exp10 - 1;
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exp10; i--) *p++ = '0';
+        memcpy(p, digits, count);
+        p += count;
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+/* ---------- Shortest round-trip floats ---------- */
+
+/*
+ * Grisu2 (Loitsch, "Printing floating-point numbers quickly and
+ * accurately with integers"): the value and the halfway points to its
+ * neighbours are scaled by a cached power of ten into 64-bit fixed
+ * point, and digits are generated until the result is inside the
+ * rounding interval. The text always reads back as the same double and
+ * is the shortest such text in all but rare cases, where it has one
+ * digit more.
+ */
+typedef struct {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+/* 10^k for k = -348, -340, ..., 340, normalized to 64 bits */
+static const DiyFp cached_powers[] = {
+    { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+    { 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+    { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+    { 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+    { 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+    { 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+    { 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+    { 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+    { 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+    { 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+    { 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+    { 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+    { 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+    { 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+    { 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+    { 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+    { 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+    { 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+    { 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+    { 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+    { 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+    { 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+    { 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+    { 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+    { 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+    { 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+    { 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+    { 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+    { 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 }
+};
+
+static DiyFp diy_multiply(DiyFp a, DiyFp b) {
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    DiyFp r;
+    r.f = (uint64_t)(product >> 64) + (((uint64_t)product >> 63) & 1);
+    r.e = a.e + b.e + 64;
+    return r;
+}
+
+static DiyFp diy_normalize(DiyFp v) {
+    int shift = __builtin_clzll(v.f);
+    v.f <<= shift;
+    v.e -= shift;
+    return v;
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static const uint64_t powers_of_ten_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* Digits of w into buf; the value is buf * 10^(*k) */
+static int grisu_digits(DiyFp w, DiyFp mp, uint64_t delta, char *buf, int *k) {
+    DiyFp one = { 1ULL << -mp.e, mp.e };
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = 1, len = 0;
+    while (kappa < 10 && p1 >= powers_of_ten_u64[kappa]) kappa++;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)powers_of_ten_u64[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d || len) buf[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buf, len, delta, rest, powers_of_ten_u64[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || len) buf[len++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(buf, len, delta, p2, one.f, -kappa < 20 ? wp_w * powers_of_ten_u64[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+int format_float_exact(double value, char *buf) {
+    if (!isfinite(value)) return snprintf(buf, 32, "%g", value);
+
+    char *p = buf;
+    if (signbit(value)) {
+        *p++ = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        *p++ = '0';
+        *p = '\0';
+        return p - buf;
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint64_t hidden = 1ULL << 52;
+    int biased = (int)(bits >> 52);
+    DiyFp v;
+    v.f = bits & (hidden - 1);
+    if (biased) {
+        v.f += hidden;
+        v.e = biased - 1075;
+    } else {
+        v.e = -1074;
+    }
+
+    /* Halfway points to the neighbouring doubles, on a common exponent */
+    DiyFp plus = diy_normalize((DiyFp){ (v.f << 1) + 1, v.e - 1 });
+    DiyFp minus = v.f == hidden ? (DiyFp){ (v.f << 2) - 1, v.e - 2 } : (DiyFp){ (v.f << 1) - 1, v.e - 1 };
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    /* A cached power that brings plus.e into [-60, -32] */
+    double dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0) k++;
+    int index = (k >> 3) + 1;
+    int exp10 = -(-348 + index * 8);
+    DiyFp c = cached_powers[index];
+
+    DiyFp w = diy_multiply(diy_normalize(v), c);
+    DiyFp wp = diy_multiply(plus, c);
+    DiyFp wm = diy_multiply(minus, c);
+    wm.f++;
+    wp.f--;
+
+    char digits[20];
+    int len = grisu_digits(w, wp, wp.f - wm.f, digits, &exp10);
+
+    /* Plain digits for moderate exponents, otherwise d.ddde[-]x */
+    int point = len + exp10;    /* Position of the decimal point */
+    if (point > 0 && point <= 21) {
+        if (exp10 >= 0) {
+            memcpy(p, digits, len);
+            p += len;
+            for (int i = 0; i < exp10; i++) *p++ = '0';
+        } else {
+            memcpy(p, digits, point);
+            p += point;
+            *p++ = '.';
+            memcpy(p, digits + point, len - point);
+            p += len - point;
+        }
+    } else if (point <= 0 && point > -6) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = point; i < 0; i++) *p++ = '0';
+        memcpy(p, digits, len);
+        p += len;
+    } else {
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        p += sprintf(p, "e%d", point - 1);
+    }
+    *p = '\0';
+    return p - buf;
+}
+
+void output_float(double value) {
+    char buf[32];
+    output_write(buf, format_float(value, buf));
+}
+
+void output_free(void) {
+    output_flush();
+    free(out.data);
+    out.data = NULL;
+    out.len = out.capacity = 0;
+}
@@ -1,23 +1,53 @@
+%code requires {
+/* The scanner handle of a reentrant flex scanner */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+typedef struct ParseState ParseState;
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "ast.h"
-#include "interpreter.h"
+#include "parse.h"
+%}
 
-extern int yylex();
-extern int yylineno;
-extern FILE *yyin;
-void yyerror(const char *s);
+%code {
+/* Everything one parse produces; the parser itself keeps no state */
+struct ParseState {
+    ASTNode *root;       /* Root of the AST */
+    char *error;         /* First syntax error, if the caller wants it */
+    size_t error_size;
+    int failed;
+};
+
+/* Scanner interface generated by flex */
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern int yylex(YYSTYPE *lval, YYLTYPE *lloc, yyscan_t scanner);
+extern int yylex_init(yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+extern void yyset_in(FILE *in, yyscan_t scanner);
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len, yyscan_t scanner);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer, yyscan_t scanner);
+void yyerror(YYLTYPE *lloc, yyscan_t scanner, ParseState *state, const char *s);
+}
 
-ASTNode *root = NULL;  /* Root of the AST */
-%}
+%define api.pure full
+%locations
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {ParseState *state}
 
 /* Union for semantic values */
 %union {
     int intval;
     double floatval;
     char *strval;
+    Atom atom;
     ASTNode *node;
     TypeInfo type;
 }
@@ -25,7 +55,8 @@ ASTNode *root = NULL;  /* Root of the AST */
 /* Token declarations */
 %token <intval> INT_LITERAL TRUE FALSE
 %token <floatval> FLOAT_LITERAL
-%token <strval> STRING_LITERAL IDENTIFIER
+%token <strval> STRING_LITERAL
+%token <atom> IDENTIFIER
 
 /* Keywords */
 %token IF ELSE WHILE FOR FN RETURN
@@ -80,16 +111,13 @@ ASTNode *root = NULL;  /* Root of the AST */
 /* Grammar Rules */
 
 program
-    : declaration_list                  { 
-        root = $1;
-        printf("Parse successful! AST created.\n");
-    }
-    | /* empty */                       { root = NULL; }
+    : declaration_list                  { state->root = $1; }
+    | /* empty */                       { state->root = NULL; }
     ;
 
 declaration_list
     : declaration                       { 
-        $$ = create_list(NODE_DECL_LIST, yylineno);
+        $$ = create_list(NODE_DECL_LIST, @$.first_line);
         list_append($$, $1);
     }
     | declaration_list declaration      { 
@@ -106,18 +134,16 @@ declaration
 
 function_decl
     : FN IDENTIFIER LPAREN parameter_list RPAREN type_specifier compound_stmt {
-        $$ = create_func_decl($6, $2, $4, $7, yylineno);
-        free($2);
+        $$ = create_func_decl($6, $2, $4, $7, @$.first_line);
     }
     | FN IDENTIFIER LPAREN RPAREN type_specifier compound_stmt {
-        $$ = create_func_decl($5, $2, NULL, $6, yylineno);
-        free($2);
+        $$ = create_func_decl($5, $2, NULL, $6, @$.first_line);
     }
     ;
 
 parameter_list
     : parameter                         { 
-        $$ = create_list(NODE_PARAM_LIST, yylineno);
+        $$ = create_list(NODE_PARAM_LIST, @$.first_line);
         list_append($$, $1);
     }
     | parameter_list COMMA parameter    { 
@@ -128,8 +154,7 @@ parameter_list
 
 parameter
     : type_specifier IDENTIFIER         { 
-        $$ = create_param($1, $2, yylineno);
-        free($2);
+        $$ = create_param($1, $2, @$.first_line);
     }
     ;
 
@@ -149,13 +174,13 @@ type_specifier
 compound_stmt
     : LBRACE statement_list RBRACE      { $$ = $2; }
     | LBRACE RBRACE                     { 
-        $$ = create_list(NODE_STMT_LIST, yylineno);
+        $$ = create_list(NODE_STMT_LIST, @$.first_line);
     }
     ;
 
 statement_list
     : statement                         { 
-        $$ = create_list(NODE_STMT_LIST, yylineno);
+        $$ = create_list(NODE_STMT_LIST, @$.first_line);
         list_append($$, $1);
     }
     | statement_list statement          { 
@@ -175,28 +200,24 @@ statement
 
 declaration_stmt
     : type_specifier IDENTIFIER SEMICOLON {
-        $$ = create_var_decl($1, $2, NULL, yylineno);
-        free($2);
+        $$ = create_var_decl($1, $2, NULL, @$.first_line);
     }
     | type_specifier IDENTIFIER ASSIGN expression SEMICOLON {
-        $$ = create_var_decl($1, $2, $4, yylineno);
-        free($2);
+        $$ = create_var_decl($1, $2, $4, @$.first_line);
     }
     | type_specifier IDENTIFIER LBRACKET INT_LITERAL RBRACKET SEMICOLON {
-        ASTNode *size = create_int_literal($4, yylineno);
-        $$ = create_array_decl($1, $2, size, NULL, yylineno);
-        free($2);
+        ASTNode *size = create_int_literal($4, @$.first_line);
+        $$ = create_array_decl($1, $2, size, NULL, @$.first_line);
     }
     | type_specifier IDENTIFIER LBRACKET INT_LITERAL RBRACKET ASSIGN LBRACE initializer_list RBRACE SEMICOLON {
-        ASTNode *size = create_int_literal($4, yylineno);
-        $$ = create_array_decl($1, $2, size, $8, yylineno);
-        free($2);
+        ASTNode *size = create_int_literal($4, @$.first_line);
+        $$ = create_array_decl($1, $2, size, $8, @$.first_line);
     }
     ;
 
 initializer_list
     : expression                        { 
-        $$ = create_list(NODE_INIT_LIST, yylineno);
+        $$ = create_list(NODE_INIT_LIST, @$.first_line);
         list_append($$, $1);
     }
     | initializer_list COMMA expression { 
@@ -206,58 +227,57 @@ initializer_list
     ;
 
 expression_stmt
-    : expression SEMICOLON              { $$ = create_expr_stmt($1, yylineno); }
-    | SEMICOLON                         { $$ = create_expr_stmt(NULL, yylineno); }
+    : expression SEMICOLON              { $$ = create_expr_stmt($1, @$.first_line); }
+    | SEMICOLON                         { $$ = create_expr_stmt(NULL, @$.first_line); }
     ;
 
 selection_stmt
     : IF LPAREN expression RPAREN statement {
-        $$ = create_if_stmt($3, $5, NULL, yylineno);
+        $$ = create_if_stmt($3, $5, NULL, @$.first_line);
     }
     | IF LPAREN expression RPAREN statement ELSE statement {
-        $$ = create_if_stmt($3, $5, $7, yylineno);
+        $$ = create_if_stmt($3, $5, $7, @$.first_line);
     }
     ;
 
 iteration_stmt
     : WHILE LPAREN expression RPAREN statement {
-        $$ = create_while_stmt($3, $5, yylineno);
+        $$ = create_while_stmt($3, $5, @$.first_line);
     }
     | FOR LPAREN expression_stmt expression_stmt RPAREN statement {
-        $$ = create_for_stmt($3, $4, NULL, $6, yylineno);
+        $$ = create_for_stmt($3, $4, NULL, $6, @$.first_line);
     }
     | FOR LPAREN expression_stmt expression_stmt expression RPAREN statement {
-        $$ = create_for_stmt($3, $4, $5, $7, yylineno);
+        $$ = create_for_stmt($3, $4, $5, $7, @$.first_line);
     }
     | FOR LPAREN IDENTIFIER COLON range_expr RPAREN statement {
-        $$ = create_for_range($3, $5, $7, yylineno);
-        free($3);
+        $$ = create_for_range($3, $5, $7, @$.first_line);
     }
     ;
 
 range_expr
     : expression RANGE_OP expression {
-        $$ = create_range(NODE_RANGE_INCL, $1, $3, NULL, yylineno);
+        $$ = create_range(NODE_RANGE_INCL, $1, $3, NULL, @$.first_line);
     }
     | expression RANGE_OP_EXCL expression {
-        $$ = create_range(NODE_RANGE_EXCL, $1, $3, NULL, yylineno);
+        $$ = create_range(NODE_RANGE_EXCL, $1, $3, NULL, @$.first_line);
     }
     | expression RANGE_OP expression COLON expression {
-        $$ = create_range(NODE_RANGE_STEP, $1, $3, $5, yylineno);
+        $$ = create_range(NODE_RANGE_STEP, $1, $3, $5, @$.first_line);
     }
     | RANGE LPAREN expression COMMA expression RPAREN {
-        $$ = create_range(NODE_RANGE_INCL, $3, $5, NULL, yylineno);
+        $$ = create_range(NODE_RANGE_INCL, $3, $5, NULL, @$.first_line);
     }
     | RANGE LPAREN expression COMMA expression COMMA expression RPAREN {
-        $$ = create_range(NODE_RANGE_STEP, $3, $5, $7, yylineno);
+        $$ = create_range(NODE_RANGE_STEP, $3, $5, $7, @$.first_line);
     }
     ;
 
 jump_stmt
-    : RETURN expression SEMICOLON       { $$ = create_return_stmt($2, yylineno); }
-    | RETURN SEMICOLON                  { $$ = create_return_stmt(NULL, yylineno); }
-    | BREAK SEMICOLON                   { $$ = create_break_stmt(yylineno); }
-    | CONTINUE SEMICOLON                { $$ = create_continue_stmt(yylineno); }
+    : RETURN expression SEMICOLON       { $$ = create_return_stmt($2, @$.first_line); }
+    | RETURN SEMICOLON                  { $$ = create_return_stmt(NULL, @$.first_line); }
+    | BREAK SEMICOLON                   { $$ = create_break_stmt(@$.first_line); }
+    | CONTINUE SEMICOLON                { $$ = create_continue_stmt(@$.first_line); }
     ;
 
 expression
@@ -267,122 +287,122 @@ expression
 assignment_expr
     : logical_or_expr                   { $$ = $1; }
     | unary_expr ASSIGN assignment_expr {
-        $$ = create_binary_op(NODE_ASSIGN, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_ASSIGN, $1, $3, @$.first_line);
     }
     | unary_expr PLUS_ASSIGN assignment_expr {
-        $$ = create_binary_op(NODE_PLUS_ASSIGN, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_PLUS_ASSIGN, $1, $3, @$.first_line);
     }
     | unary_expr MINUS_ASSIGN assignment_expr {
-        $$ = create_binary_op(NODE_MINUS_ASSIGN, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_MINUS_ASSIGN, $1, $3, @$.first_line);
     }
     | unary_expr MUL_ASSIGN assignment_expr {
-        $$ = create_binary_op(NODE_MUL_ASSIGN, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_MUL_ASSIGN, $1, $3, @$.first_line);
     }
     | unary_expr DIV_ASSIGN assignment_expr {
-        $$ = create_binary_op(NODE_DIV_ASSIGN, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_DIV_ASSIGN, $1, $3, @$.first_line);
     }
     ;
 
 logical_or_expr
     : logical_and_expr                  { $$ = $1; }
     | logical_or_expr OR logical_and_expr {
-        $$ = create_binary_op(NODE_OR, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_OR, $1, $3, @$.first_line);
     }
     ;
 
 logical_and_expr
     : equality_expr                     { $$ = $1; }
     | logical_and_expr AND equality_expr {
-        $$ = create_binary_op(NODE_AND, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_AND, $1, $3, @$.first_line);
     }
     ;
 
 equality_expr
     : relational_expr                   { $$ = $1; }
     | equality_expr EQ relational_expr {
-        $$ = create_binary_op(NODE_EQ, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_EQ, $1, $3, @$.first_line);
     }
     | equality_expr NE relational_expr {
-        $$ = create_binary_op(NODE_NE, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_NE, $1, $3, @$.first_line);
     }
     ;
 
 relational_expr
     : additive_expr                     { $$ = $1; }
     | relational_expr LT additive_expr {
-        $$ = create_binary_op(NODE_LT, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_LT, $1, $3, @$.first_line);
     }
     | relational_expr GT additive_expr {
-        $$ = create_binary_op(NODE_GT, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_GT, $1, $3, @$.first_line);
     }
     | relational_expr LE additive_expr {
-        $$ = create_binary_op(NODE_LE, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_LE, $1, $3, @$.first_line);
     }
     | relational_expr GE additive_expr {
-        $$ = create_binary_op(NODE_GE, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_GE, $1, $3, @$.first_line);
     }
     | relational_expr PATTERN_MATCH additive_expr {
-        $$ = create_binary_op(NODE_PATTERN_MATCH, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_PATTERN_MATCH, $1, $3, @$.first_line);
     }
     ;
 
 additive_expr
     : multiplicative_expr               { $$ = $1; }
     | additive_expr PLUS multiplicative_expr {
-        $$ = create_binary_op(NODE_ADD, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_ADD, $1, $3, @$.first_line);
     }
     | additive_expr MINUS multiplicative_expr {
-        $$ = create_binary_op(NODE_SUB, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_SUB, $1, $3, @$.first_line);
     }
     ;
 
 multiplicative_expr
     : matrix_expr                       { $$ = $1; }
     | multiplicative_expr MUL matrix_expr {
-        $$ = create_binary_op(NODE_MUL, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_MUL, $1, $3, @$.first_line);
     }
     | multiplicative_expr DIV matrix_expr {
-        $$ = create_binary_op(NODE_DIV, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_DIV, $1, $3, @$.first_line);
     }
     | multiplicative_expr MOD matrix_expr {
-        $$ = create_binary_op(NODE_MOD, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_MOD, $1, $3, @$.first_line);
     }
     ;
 
 matrix_expr
     : unary_expr                        { $$ = $1; }
     | matrix_expr MATRIX_MUL unary_expr {
-        $$ = create_binary_op(NODE_MATRIX_MUL, $1, $3, yylineno);
+        $$ = create_binary_op(NODE_MATRIX_MUL, $1, $3, @$.first_line);
     }
     ;
 
 unary_expr
     : postfix_expr                      { $$ = $1; }
-    | INC unary_expr                    { $$ = create_unary_op(NODE_PRE_INC, $2, yylineno); }
-    | DEC unary_expr                    { $$ = create_unary_op(NODE_PRE_DEC, $2, yylineno); }
+    | INC unary_expr                    { $$ = create_unary_op(NODE_PRE_INC, $2, @$.first_line); }
+    | DEC unary_expr                    { $$ = create_unary_op(NODE_PRE_DEC, $2, @$.first_line); }
     | PLUS unary_expr                   { $$ = $2; }
-    | MINUS unary_expr %prec UMINUS     { $$ = create_unary_op(NODE_UNARY_MINUS, $2, yylineno); }
-    | NOT unary_expr                    { $$ = create_unary_op(NODE_NOT, $2, yylineno); }
+    | MINUS unary_expr %prec UMINUS     { $$ = create_unary_op(NODE_UNARY_MINUS, $2, @$.first_line); }
+    | NOT unary_expr                    { $$ = create_unary_op(NODE_NOT, $2, @$.first_line); }
     ;
 
 postfix_expr
     : primary_expr                      { $$ = $1; }
     | postfix_expr LBRACKET expression RBRACKET {
-        $$ = create_array_index($1, $3, yylineno);
+        $$ = create_array_index($1, $3, @$.first_line);
     }
     | postfix_expr LPAREN argument_list RPAREN {
-        $$ = create_func_call($1, $3, yylineno);
+        $$ = create_func_call($1, $3, @$.first_line);
     }
     | postfix_expr LPAREN RPAREN {
-        $$ = create_func_call($1, NULL, yylineno);
+        $$ = create_func_call($1, NULL, @$.first_line);
     }
-    | postfix_expr INC                  { $$ = create_unary_op(NODE_POST_INC, $1, yylineno); }
-    | postfix_expr DEC                  { $$ = create_unary_op(NODE_POST_DEC, $1, yylineno); }
+    | postfix_expr INC                  { $$ = create_unary_op(NODE_POST_INC, $1, @$.first_line); }
+    | postfix_expr DEC                  { $$ = create_unary_op(NODE_POST_DEC, $1, @$.first_line); }
     ;
 
 argument_list
     : expression                        { 
-        $$ = create_list(NODE_ARG_LIST, yylineno);
+        $$ = create_list(NODE_ARG_LIST, @$.first_line);
         list_append($$, $1);
     }
     | argument_list COMMA expression    { 
@@ -393,17 +413,15 @@ argument_list
 
 primary_expr
     : IDENTIFIER                        { 
-        $$ = create_identifier($1, yylineno);
-        free($1);
+        $$ = create_identifier($1, @$.first_line);
     }
-    | INT_LITERAL                       { $$ = create_int_literal($1, yylineno); }
-    | FLOAT_LITERAL                     { $$ = create_float_literal($1, yylineno); }
+    | INT_LITERAL                       { $$ = create_int_literal($1, @$.first_line); }
+    | FLOAT_LITERAL                     { $$ = create_float_literal($1, @$.first_line); }
     | STRING_LITERAL                    { 
-        $$ = create_string_literal($1, yylineno);
-        free($1);
+        $$ = create_string_literal($1, @$.first_line);
     }
-    | TRUE                              { $$ = create_bool_literal(1, yylineno); }
-    | FALSE                             { $$ = create_bool_literal(0, yylineno); }
+    | TRUE                              { $$ = create_bool_literal(1, @$.first_line); }
+    | FALSE                             { $$ = create_bool_literal(0, @$.first_line); }
     | LPAREN expression RPAREN          { $$ = $2; }
     | LBRACKET initializer_list RBRACKET {
         $$ = $2;
@@ -414,34 +432,44 @@ primary_expr
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error at line %d: %s\n", yylineno, s);
+void yyerror(YYLTYPE *lloc, yyscan_t scanner, ParseState *state, const char *s) {
+    (void)lloc;
+    fprintf(stderr, "Error at line %d: %s\n", yyget_lineno(scanner), s);
+    if (!state->failed && state->error && state->error_size > 0) {
+        snprintf(state->error, state->error_size, "line %d: %s", yyget_lineno(scanner), s);
+    }
+    state->failed = 1;
+}
+
+static int parse(yyscan_t scanner, ASTNode **program, char *error, size_t error_size) {
+    ParseState state = { NULL, error, error_size, 0 };
+    if (error && error_size > 0) error[0] = '\0';
+    int result = yyparse(scanner, &state);
+    *program = result == 0 ? state.root : NULL;
+    return result;
+}
+
+int parse_file(FILE *in, ASTNode **program, char *error, size_t error_size) {
+    yyscan_t scanner;
+    if (yylex_init(&scanner) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    yyset_in(in, scanner);
+    int result = parse(scanner, program, error, error_size);
+    yylex_destroy(scanner);
+    return result;
 }
 
-int main(int argc, char **argv) {
-    if (argc > 1) {
-        yyin = fopen(argv[1], "r");
-        if (!yyin) {
-            perror("Error opening file");
-            return 1;
-        }
-    }
-    
-    int result = yyparse();
-    
-    if (result == 0 && root) {
-        printf("\n=== Abstract Syntax Tree ===\n");
-        print_ast(root, 0);
-        
-        printf("\n=== Program Execution ===\n");
-        execute_program(root);
-        
-        free_ast(root);
-    }
-    
-    if (yyin != stdin) {
-        fclose(yyin);
-    }
-    
+int parse_text(const char *text, size_t len, ASTNode **program, char *error, size_t error_size) {
+    yyscan_t scanner;
+    if (yylex_init(&scanner) != 0) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    YY_BUFFER_STATE buffer = yy_scan_bytes(text, (int)len, scanner);
+    int result = parse(scanner, program, error, error_size);
+    yy_delete_buffer(buffer, scanner);
+    yylex_destroy(scanner);
     return result;
-}
\ No newline at end of file
+}
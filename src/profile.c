@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include "profile.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PROFILE_TOP_LINES 20
+
+struct ProfileFunction {
+    Atom name;
+    long calls;
+    uint64_t inclusive_ns;
+    uint64_t exclusive_ns;
+    int active;                 /* Calls currently on the stack */
+    ProfileFunction *next;      /* All functions, in order of first call */
+};
+
+/* A node of the call tree: one distinct stack of functions */
+typedef struct ProfileNode {
+    ProfileFunction *fn;
+    struct ProfileNode *parent;
+    struct ProfileNode *children;
+    struct ProfileNode *sibling;
+    uint64_t self_ns;
+} ProfileNode;
+
+typedef struct {
+    ProfileNode *node;
+    uint64_t start_ns;
+    uint64_t child_ns;          /* Inclusive time of the calls it made */
+} ProfileCall;
+
+int profile_enabled = 0;
+
+static struct {
+    char *folded_path;
+    ProfileFunction root_fn;
+    ProfileFunction *fns;
+    ProfileFunction **fns_tail;
+    ProfileNode root;
+    ProfileCall *stack;
+    int depth;
+    int stack_capacity;
+    long *line_counts;          /* Indexed by line number */
+    int line_capacity;
+    uint64_t total_ns;
+} profile;
+
+static void* grow(void *data, size_t size) {
+    data = realloc(data, size);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    return data;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void profile_enable(const char *folded_path) {
+    profile_enabled = 1;
+    if (folded_path) {
+        free(profile.folded_path);
+        profile.folded_path = strdup(folded_path);
+    }
+}
+
+static void push_call(ProfileNode *node) {
+    if (profile.depth == profile.stack_capacity) {
+        profile.stack_capacity = profile.stack_capacity ? profile.stack_capacity * 2 : 64;
+        profile.stack = (ProfileCall*)grow(profile.stack, profile.stack_capacity * sizeof(ProfileCall));
+    }
+    ProfileCall *call = &profile.stack[profile.depth++];
+    call->node = node;
+    call->child_ns = 0;
+    node->fn->calls++;
+    node->fn->active++;
+    call->start_ns = now_ns();
+}
+
+void profile_start(ASTNode *root) {
+    if (!profile_enabled) return;
+    profile.root_fn.name = atom_main;
+    profile.fns = NULL;
+    profile.fns_tail = &profile.fns;
+    profile.root.fn = &profile.root_fn;
+
+    /* Explicit calls of main() share its entry with the root */
+    if (root && root->type == NODE_DECL_LIST) {
+        for (int i = 0; i < root->data.list.count; i++) {
+            ASTNode *decl = root->data.list.items[i];
+            if (decl->type == NODE_FUNC_DECL && decl->data.func_decl.name == atom_main) {
+                decl->data.func_decl.profile = &profile.root_fn;
+            }
+        }
+    }
+    *profile.fns_tail = &profile.root_fn;
+    profile.fns_tail = &profile.root_fn.next;
+    push_call(&profile.root);
+}
+
+void profile_stop(void) {
+    if (!profile_enabled || profile.depth != 1) return;
+    profile_exit();
+    profile.total_ns = profile.root_fn.inclusive_ns;
+}
+
+void profile_enter(ASTNode *decl) {
+    ProfileFunction *fn = decl->data.func_decl.profile;
+    if (!fn) {
+        fn = (ProfileFunction*)grow(NULL, sizeof(ProfileFunction));
+        memset(fn, 0, sizeof(ProfileFunction));
+        fn->name = decl->data.func_decl.name;
+        decl->data.func_decl.profile = fn;
+        *profile.fns_tail = fn;
+        profile.fns_tail = &fn->next;
+    }
+
+    ProfileNode *parent = profile.stack[profile.depth - 1].node;
+    ProfileNode *node = parent->children;
+    while (node && node->fn != fn) node = node->sibling;
+    if (!node) {
+        node = (ProfileNode*)grow(NULL, sizeof(ProfileNode));
+        memset(node, 0, sizeof(ProfileNode));
+        node->fn = fn;
+        node->parent = parent;
+        node->sibling = parent->children;
+        parent->children = node;
+    }
+    push_call(node);
+}
+
+void profile_exit(void) {
+    ProfileCall *call = &profile.stack[--profile.depth];
+    uint64_t elapsed = now_ns() - call->start_ns;
+    ProfileFunction *fn = call->node->fn;
+    uint64_t self = elapsed > call->child_ns ? elapsed - call->child_ns : 0;
+    call->node->self_ns += self;
+    fn->exclusive_ns += self;
+    if (--fn->active == 0) fn->inclusive_ns += elapsed;
+    if (profile.depth > 0) profile.stack[profile.depth - 1].child_ns += elapsed;
+}
+
+void profile_line(int line) {
+    if (line <= 0) return;
+    if (line >= profile.line_capacity) {
+        int capacity = profile.line_capacity ? profile.line_capacity : 256;
+        while (capacity <= line) capacity *= 2;
+        profile.line_counts = (long*)grow(profile.line_counts, capacity * sizeof(long));
+        memset(profile.line_counts + profile.line_capacity, 0,
+               (capacity - profile.line_capacity) * sizeof(long));
+        profile.line_capacity = capacity;
+    }
+    profile.line_counts[line]++;
+}
+
+/* ---------- Report ---------- */
+
+static int by_exclusive(const void *a, const void *b) {
+    const ProfileFunction *x = *(ProfileFunction * const *)a;
+    const ProfileFunction *y = *(ProfileFunction * const *)b;
+    if (x->exclusive_ns != y->exclusive_ns) return x->exclusive_ns < y->exclusive_ns ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+static int by_count(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    long cx = profile.line_counts[x], cy = profile.line_counts[y];
+    if (cx != cy) return cx < cy ? 1 : -1;
+    return x - y;
+}
+
+/* The text of each wanted line of path, or NULL where unknown */
+static char** read_lines(const char *path, const int *lines, int count) {
+    char **text = (char**)grow(NULL, (count > 0 ? count : 1) * sizeof(char*));
+    for (int i = 0; i < count; i++) text[i] = NULL;
+    FILE *f = path ? fopen(path, "r") : NULL;
+    if (!f) return text;
+    char *buf = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+    int line = 0;
+    while ((n = getline(&buf, &capacity, f)) >= 0) {
+        line++;
+        for (int i = 0; i < count; i++) {
+            if (lines[i] != line) continue;
+            while (n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == '\r')) buf[--n] = '\0';
+            char *start = buf;
+            while (*start == ' ' || *start == '\t') start++;
+            text[i] = strdup(start);
+        }
+    }
+    free(buf);
+    fclose(f);
+    return text;
+}
+
+static void write_folded(FILE *out, ProfileNode *node, char *stack, size_t len, size_t capacity) {
+    size_t name_len = strlen(node->fn->name);
+    if (len + name_len + 2 > capacity) return;      /* Deeper than anyone can read */
+    if (len > 0) stack[len++] = ';';
+    memcpy(stack + len, node->fn->name, name_len);
+    len += name_len;
+    stack[len] = '\0';
+    uint64_t us = node->self_ns / 1000;
+    if (us > 0) fprintf(out, "%s %llu\n", stack, (unsigned long long)us);
+    for (ProfileNode *child = node->children; child; child = child->sibling) {
+        write_folded(out, child, stack, len, capacity);
+    }
+}
+
+void profile_report(FILE *out, const char *source_path) {
+    if (!profile_enabled) return;
+    double total_ms = profile.total_ns / 1e6;
+
+    int fn_count = 0;
+    for (ProfileFunction *fn = profile.fns; fn; fn = fn->next) fn_count++;
+    ProfileFunction **fns = (ProfileFunction**)grow(NULL, (fn_count + 1) * sizeof(ProfileFunction*));
+    fn_count = 0;
+    for (ProfileFunction *fn = profile.fns; fn; fn = fn->next) fns[fn_count++] = fn;
+    qsort(fns, fn_count, sizeof(ProfileFunction*), by_exclusive);
+
+    fprintf(out, "\n=== Profile (%.3f ms) ===\n", total_ms);
+    fprintf(out, "%12s %14s %14s %7s  %s\n", "calls", "inclusive ms", "exclusive ms", "excl %", "function");
+    for (int i = 0; i < fn_count; i++) {
+        ProfileFunction *fn = fns[i];
+        fprintf(out, "%12ld %14.3f %14.3f %6.1f%%  %s\n", fn->calls,
+                fn->inclusive_ns / 1e6, fn->exclusive_ns / 1e6,
+                total_ms > 0 ? 100.0 * (fn->exclusive_ns / 1e6) / total_ms : 0.0, fn->name);
+    }
+    free(fns);
+
+    int line_count = 0;
+    for (int line = 1; line < profile.line_capacity; line++) {
+        if (profile.line_counts[line] > 0) line_count++;
+    }
+    int *lines = (int*)grow(NULL, (line_count + 1) * sizeof(int));
+    line_count = 0;
+    for (int line = 1; line < profile.line_capacity; line++) {
+        if (profile.line_counts[line] > 0) lines[line_count++] = line;
+    }
+    qsort(lines, line_count, sizeof(int), by_count);
+    if (line_count > PROFILE_TOP_LINES) line_count = PROFILE_TOP_LINES;
+    char **text = read_lines(source_path, lines, line_count);
+
+    fprintf(out, "\n%12s %6s  %s\n", "executions", "line", "statement");
+    for (int i = 0; i < line_count; i++) {
+        fprintf(out, "%12ld %6d  %.60s\n", profile.line_counts[lines[i]], lines[i], text[i] ? text[i] : "");
+        free(text[i]);
+    }
+    free(text);
+    free(lines);
+
+    if (profile.folded_path) {
+        FILE *folded = fopen(profile.folded_path, "w");
+        if (!folded) {
+            perror("Error writing folded stacks");
+            return;
+        }
+        char stack[4096];
+        write_folded(folded, &profile.root, stack, 0, sizeof(stack));
+        fclose(folded);
+    }
+}
+
+static void free_nodes(ProfileNode *node) {
+    while (node) {
+        ProfileNode *next = node->sibling;
+        free_nodes(node->children);
+        free(node);
+        node = next;
+    }
+}
+
+void profile_free(void) {
+    free_nodes(profile.root.children);
+    ProfileFunction *fn = profile.fns;
+    while (fn) {
+        ProfileFunction *next = fn->next;
+        if (fn != &profile.root_fn) free(fn);
+        fn = next;
+    }
+    free(profile.stack);
+    free(profile.line_counts);
+    free(profile.folded_path);
+    memset(&profile, 0, sizeof(profile));
+    profile_enabled = 0;
+}
@@ -0,0 +1,160 @@
+#include "regex_cache.h"
+#include <regex.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGEX_BUCKETS 128
+
+struct CompiledRegex {
+    char *pattern;
+    regex_t regex;
+    int status;                    /* regcomp result; nonzero if invalid */
+    int pinned;                    /* Never evicted */
+    struct CompiledRegex *prev;    /* LRU list of unpinned entries, or */
+    struct CompiledRegex *next;    /* the list of pinned ones */
+    struct CompiledRegex *chain;   /* Hash bucket chain */
+};
+
+typedef struct {
+    CompiledRegex *buckets[REGEX_BUCKETS];
+    CompiledRegex *lru_head;       /* Most recently used */
+    CompiledRegex *lru_tail;
+    CompiledRegex *pinned;
+    int lru_count;
+    long hits;
+    long misses;
+    long evictions;
+    long pinned_count;
+} RegexCache;
+
+/* Per thread: patterns pinned by a program belong to the thread running it */
+static _Thread_local RegexCache cache;
+
+static uint32_t hash_pattern(const char *str) {
+    uint32_t h = 2166136261u;
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void lru_unlink(CompiledRegex *re) {
+    if (re->prev) re->prev->next = re->next; else cache.lru_head = re->next;
+    if (re->next) re->next->prev = re->prev; else cache.lru_tail = re->prev;
+    re->prev = re->next = NULL;
+    cache.lru_count--;
+}
+
+static void lru_push_front(CompiledRegex *re) {
+    re->prev = NULL;
+    re->next = cache.lru_head;
+    if (cache.lru_head) cache.lru_head->prev = re;
+    cache.lru_head = re;
+    if (!cache.lru_tail) cache.lru_tail = re;
+    cache.lru_count++;
+}
+
+static void bucket_remove(CompiledRegex *re) {
+    CompiledRegex **link = &cache.buckets[hash_pattern(re->pattern) % REGEX_BUCKETS];
+    while (*link != re) link = &(*link)->chain;
+    *link = re->chain;
+}
+
+static void destroy_regex(CompiledRegex *re) {
+    if (re->status == 0) regfree(&re->regex);
+    free(re->pattern);
+    free(re);
+}
+
+static CompiledRegex* find(const char *pattern) {
+    CompiledRegex *re = cache.buckets[hash_pattern(pattern) % REGEX_BUCKETS];
+    while (re && strcmp(re->pattern, pattern) != 0) re = re->chain;
+    return re;
+}
+
+static CompiledRegex* compile(const char *pattern) {
+    CompiledRegex *re = (CompiledRegex*)calloc(1, sizeof(CompiledRegex));
+    if (!re) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    re->pattern = strdup(pattern);
+    re->status = regcomp(&re->regex, pattern, REG_EXTENDED | REG_NOSUB);
+
+    uint32_t bucket = hash_pattern(pattern) % REGEX_BUCKETS;
+    re->chain = cache.buckets[bucket];
+    cache.buckets[bucket] = re;
+    return re;
+}
+
+CompiledRegex* regex_pin(const char *pattern) {
+    CompiledRegex *re = find(pattern);
+    if (re && re->pinned) return re;
+    if (re) {
+        lru_unlink(re);
+    } else {
+        re = compile(pattern);
+    }
+    re->pinned = 1;
+    cache.pinned_count++;
+    re->next = cache.pinned;
+    cache.pinned = re;
+    return re;
+}
+
+CompiledRegex* regex_lookup(const char *pattern) {
+    CompiledRegex *re = find(pattern);
+    if (re) {
+        cache.hits++;
+        if (!re->pinned && re != cache.lru_head) {
+            lru_unlink(re);
+            lru_push_front(re);
+        }
+        return re;
+    }
+
+    cache.misses++;
+    if (cache.lru_count >= REGEX_CACHE_SIZE) {
+        CompiledRegex *victim = cache.lru_tail;
+        lru_unlink(victim);
+        bucket_remove(victim);
+        destroy_regex(victim);
+        cache.evictions++;
+    }
+    re = compile(pattern);
+    lru_push_front(re);
+    return re;
+}
+
+int regex_match(CompiledRegex *re, const char *text) {
+    if (re->status != 0) {
+        char error_buf[100];
+        regerror(re->status, &re->regex, error_buf, sizeof(error_buf));
+        fprintf(stderr, "Runtime error: Invalid regex pattern: %s\n", error_buf);
+        return 0;
+    }
+    return regexec(&re->regex, text, 0, NULL, 0) == 0;
+}
+
+void regex_print_stats(FILE *out) {
+    fprintf(out, "Regex cache: %ld hits, %ld misses, %ld evictions, %ld literal patterns precompiled\n",
+            cache.hits, cache.misses, cache.evictions, cache.pinned_count);
+}
+
+void regex_cache_free(void) {
+    CompiledRegex *re = cache.lru_head;
+    while (re) {
+        CompiledRegex *next = re->next;
+        destroy_regex(re);
+        re = next;
+    }
+    re = cache.pinned;
+    while (re) {
+        CompiledRegex *next = re->next;
+        destroy_regex(re);
+        re = next;
+    }
+    memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,207 @@
+#include "resolver.h"
+#include "builtins.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Names bound in one frame; a name's index is its slot */
+typedef struct {
+    Atom *names;
+    int count;
+    int capacity;
+} Scope;
+
+typedef struct {
+    Scope *locals;   /* NULL while resolving code that runs in the global frame */
+    Scope *globals;
+} Resolver;
+
+static int scope_index(Scope *scope, Atom name) {
+    for (int i = 0; i < scope->count; i++) {
+        if (scope->names[i] == name) return i;
+    }
+    return -1;
+}
+
+static int scope_push(Scope *scope, Atom name) {
+    if (scope->count >= scope->capacity) {
+        scope->capacity = scope->capacity == 0 ? 16 : scope->capacity * 2;
+        scope->names = (Atom*)realloc(scope->names, scope->capacity * sizeof(Atom));
+        if (!scope->names) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    scope->names[scope->count] = name;
+    return scope->count++;
+}
+
+static int scope_add(Scope *scope, Atom name) {
+    int idx = scope_index(scope, name);
+    return idx >= 0 ? idx : scope_push(scope, name);
+}
+
+/* Collect every name a statement can bind in its frame: declarations,
+ * assignment targets, ++/-- targets and range-for iterators */
+static void collect_names(ASTNode *node, void *ctx) {
+    Scope *scope = (Scope*)ctx;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_FUNC_DECL:
+        case NODE_ARRAY_DECL:
+            return;
+
+        case NODE_VAR_DECL:
+            scope_add(scope, node->data.var_decl.name);
+            break;
+
+        case NODE_FOR_RANGE:
+            scope_add(scope, node->data.for_range.iterator);
+            break;
+
+        case NODE_ASSIGN: case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
+            if (node->data.binary_op.left->type == NODE_IDENTIFIER) {
+                scope_add(scope, node->data.binary_op.left->data.identifier.name);
+            }
+            break;
+
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC:
+            if (node->data.unary_op.operand->type == NODE_IDENTIFIER) {
+                scope_add(scope, node->data.unary_op.operand->data.identifier.name);
+            }
+            break;
+
+        default:
+            break;
+    }
+    ast_visit_children(node, collect_names, ctx);
+}
+
+static VarRef lookup(Resolver *r, Atom name) {
+    VarRef ref;
+    ref.slot = r->locals ? scope_index(r->locals, name) : -1;
+    ref.global_slot = scope_index(r->globals, name);
+    return ref;
+}
+
+static void resolve_node(ASTNode *node, void *ctx) {
+    Resolver *r = (Resolver*)ctx;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_FUNC_DECL:
+            return;
+
+        case NODE_IDENTIFIER:
+            node->data.identifier.ref = lookup(r, node->data.identifier.name);
+            break;
+
+        case NODE_VAR_DECL:
+            node->data.var_decl.ref = lookup(r, node->data.var_decl.name);
+            break;
+
+        case NODE_PARAM:
+            node->data.param.ref = lookup(r, node->data.param.name);
+            break;
+
+        case NODE_FOR_RANGE:
+            node->data.for_range.ref = lookup(r, node->data.for_range.iterator);
+            break;
+
+        case NODE_FUNC_CALL:
+            if (node->data.func_call.func->type == NODE_IDENTIFIER) {
+                const Builtin *builtin = builtin_lookup(node->data.func_call.func->data.identifier.name);
+                node->data.func_call.builtin = builtin;
+                if (builtin) node->data_type = create_type(builtin_result_type(builtin));
+            }
+            break;
+
+        default:
+            break;
+    }
+    ast_visit_children(node, resolve_node, ctx);
+}
+
+static void resolve_function(ASTNode *decl, Scope *globals) {
+    Scope locals = {0};
+    ASTNode *params = decl->data.func_decl.params;
+
+    /* Parameters take the first slots, in order */
+    if (params) {
+        for (int i = 0; i < params->data.list.count; i++) {
+            scope_push(&locals, params->data.list.items[i]->data.param.name);
+        }
+    }
+    collect_names(decl->data.func_decl.body, &locals);
+    decl->data.func_decl.num_slots = locals.count;
+
+    Resolver r = { &locals, globals };
+    if (params) {
+        for (int i = 0; i < params->data.list.count; i++) {
+            ASTNode *param = params->data.list.items[i];
+            param->data.param.ref.slot = i;
+            param->data.param.ref.global_slot = scope_index(globals, param->data.param.name);
+        }
+    }
+    resolve_node(decl->data.func_decl.body, &r);
+
+    free(locals.names);
+}
+
+static int is_main(ASTNode *decl) {
+    return decl->data.func_decl.name == atom_main;
+}
+
+int resolve_program(ASTNode *root) {
+    if (!root || root->type != NODE_DECL_LIST) return 0;
+
+    Scope globals = {0};
+    Scope bound = {0};      /* Names stored to in the global frame */
+    Scope functions = {0};  /* Function names, once per declaration */
+
+    /* Global frame: function names, names bound by top-level statements
+     * and names bound in main (whose body runs in the global frame) */
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type == NODE_FUNC_DECL) {
+            scope_add(&globals, decl->data.func_decl.name);
+            scope_push(&functions, decl->data.func_decl.name);
+            if (is_main(decl)) {
+                collect_names(decl->data.func_decl.body, &globals);
+                collect_names(decl->data.func_decl.body, &bound);
+            }
+        } else {
+            collect_names(decl, &globals);
+            collect_names(decl, &bound);
+        }
+    }
+
+    Resolver top = { NULL, &globals };
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type == NODE_FUNC_DECL) {
+            Atom name = decl->data.func_decl.name;
+            int declarations = 0;
+            for (int j = 0; j < functions.count; j++) {
+                if (functions.names[j] == name) declarations++;
+            }
+            decl->data.func_decl.slot = scope_index(&globals, name);
+            decl->data.func_decl.fixed = declarations == 1 && scope_index(&bound, name) < 0;
+            if (is_main(decl)) {
+                decl->data.func_decl.num_slots = 0;
+                resolve_node(decl->data.func_decl.body, &top);
+            } else {
+                resolve_function(decl, &globals);
+            }
+        } else {
+            resolve_node(decl, &top);
+        }
+    }
+
+    int count = globals.count;
+    free(globals.names);
+    free(bound.names);
+    free(functions.names);
+    return count;
+}
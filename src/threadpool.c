@@ -0,0 +1,133 @@
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;      /* A new job was posted */
+    pthread_cond_t work_done;       /* The last worker left the job */
+    pthread_mutex_t submit_lock;    /* One job at a time */
+    pthread_t *threads;
+    int size;                       /* Including the calling thread */
+
+    /* Current job */
+    ThreadTask task;
+    void *arg;
+    int count;
+    int next;                       /* Next unclaimed index */
+    int busy;                       /* Workers still inside the job */
+    unsigned long generation;
+    int shutdown;
+} ThreadPool;
+
+static ThreadPool pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+    NULL, 0, NULL, NULL, 0, 0, 0, 0, 0
+};
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+/* Claim and run indices of the current job until none are left */
+static void run_tasks(ThreadTask task, void *arg, int count) {
+    for (;;) {
+        int index = __atomic_fetch_add(&pool.next, 1, __ATOMIC_RELAXED);
+        if (index >= count) break;
+        task(arg, index);
+    }
+}
+
+static void* worker_main(void *unused) {
+    (void)unused;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen && !pool.shutdown) {
+            pthread_cond_wait(&pool.work_ready, &pool.lock);
+        }
+        if (pool.shutdown) break;
+        seen = pool.generation;
+        ThreadTask task = pool.task;
+        void *arg = pool.arg;
+        int count = pool.count;
+        pthread_mutex_unlock(&pool.lock);
+
+        run_tasks(task, arg, count);
+
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0) pthread_cond_signal(&pool.work_done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+static void pool_shutdown(void) {
+    pthread_mutex_lock(&pool.lock);
+    pool.shutdown = 1;
+    pthread_cond_broadcast(&pool.work_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.size - 1; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    free(pool.threads);
+    pool.threads = NULL;
+    pool.size = 1;
+}
+
+static void pool_start(void) {
+    const char *env = getenv("YAPL_THREADS");
+    long size = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (size < 1) size = 1;
+    if (size > 1024) size = 1024;
+
+    pool.size = 1;
+    if (size == 1) return;
+
+    pool.threads = (pthread_t*)malloc((size - 1) * sizeof(pthread_t));
+    if (!pool.threads) return;
+    for (int i = 0; i < size - 1; i++) {
+        if (pthread_create(&pool.threads[i], NULL, worker_main, NULL) != 0) break;
+        pool.size++;
+    }
+    atexit(pool_shutdown);
+}
+
+int thread_pool_size(void) {
+    pthread_once(&pool_once, pool_start);
+    return pool.size;
+}
+
+void thread_pool_run(ThreadTask task, void *arg, int count) {
+    if (count <= 0) return;
+    if (count == 1 || thread_pool_size() == 1) {
+        for (int i = 0; i < count; i++) task(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.submit_lock);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.arg = arg;
+    pool.count = count;
+    pool.next = 0;
+    pool.busy = pool.size - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.work_ready);
+    pthread_mutex_unlock(&pool.lock);
+
+    /* The caller works too, then waits for every worker to leave the job
+     * so none of them can claim indices of the next one */
+    run_tasks(task, arg, count);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0) {
+        pthread_cond_wait(&pool.work_done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    pthread_mutex_unlock(&pool.submit_lock);
+}
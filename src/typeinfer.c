@@ -0,0 +1,192 @@
+#include "typeinfer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Int-ness of the variables of one frame, optimistic until disproven */
+typedef struct {
+    char *global_int;    /* Per global slot */
+    char *local_int;     /* Per slot of the function being analysed; NULL in the global frame */
+    int changed;
+} Inference;
+
+static int var_is_int(Inference *inf, VarRef ref) {
+    if (inf->local_int && ref.slot >= 0) {
+        /* An unset local reads through to the global of the same name */
+        return inf->local_int[ref.slot] &&
+               (ref.global_slot < 0 || inf->global_int[ref.global_slot]);
+    }
+    return ref.global_slot >= 0 && inf->global_int[ref.global_slot];
+}
+
+static int is_int_expr(Inference *inf, ASTNode *node) {
+    if (!node) return 0;
+
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            return 1;
+
+        case NODE_IDENTIFIER:
+            return var_is_int(inf, node->data.identifier.ref);
+
+        case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_MOD:
+        case NODE_INT_ADD: case NODE_INT_SUB: case NODE_INT_MUL: case NODE_INT_MOD:
+            return is_int_expr(inf, node->data.binary_op.left) &&
+                   is_int_expr(inf, node->data.binary_op.right);
+
+        case NODE_UNARY_MINUS:
+            return is_int_expr(inf, node->data.unary_op.operand);
+
+        case NODE_PRE_INC: case NODE_PRE_DEC: case NODE_POST_INC: case NODE_POST_DEC:
+            return node->data.unary_op.operand->type == NODE_IDENTIFIER &&
+                   is_int_expr(inf, node->data.unary_op.operand);
+
+        case NODE_ASSIGN:
+            return is_int_expr(inf, node->data.binary_op.right);
+
+        case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN: case NODE_MUL_ASSIGN:
+            return is_int_expr(inf, node->data.binary_op.left) &&
+                   is_int_expr(inf, node->data.binary_op.right);
+
+        default:
+            return 0;
+    }
+}
+
+/* Record that a variable of this frame may be assigned a non-int */
+static void demote(Inference *inf, VarRef ref) {
+    char *flag = NULL;
+    if (inf->local_int) {
+        if (ref.slot >= 0) flag = &inf->local_int[ref.slot];
+    } else if (ref.global_slot >= 0) {
+        flag = &inf->global_int[ref.global_slot];
+    }
+    if (flag && *flag) {
+        *flag = 0;
+        inf->changed = 1;
+    }
+}
+
+/* Check every store in a frame against the current assumptions */
+static void check_stores(ASTNode *node, void *ctx) {
+    Inference *inf = (Inference*)ctx;
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_FUNC_DECL:
+            return;
+
+        case NODE_VAR_DECL: {
+            ASTNode *init = node->data.var_decl.initializer;
+            int is_int = init ? is_int_expr(inf, init)
+                              : node->data.var_decl.type.base_type == TYPE_INT;
+            if (!is_int) demote(inf, node->data.var_decl.ref);
+            break;
+        }
+
+        case NODE_ASSIGN: case NODE_PLUS_ASSIGN: case NODE_MINUS_ASSIGN:
+        case NODE_MUL_ASSIGN: case NODE_DIV_ASSIGN:
+            if (node->data.binary_op.left->type == NODE_IDENTIFIER &&
+                (node->type == NODE_DIV_ASSIGN || !is_int_expr(inf, node))) {
+                demote(inf, node->data.binary_op.left->data.identifier.ref);
+            }
+            break;
+
+        default:
+            break;
+    }
+    ast_visit_children(node, check_stores, ctx);
+}
+
+/* Rewrite binary operations over proven ints into their NODE_INT_* forms */
+static void specialize(ASTNode *node, void *ctx) {
+    Inference *inf = (Inference*)ctx;
+    if (!node) return;
+    if (node->type == NODE_FUNC_DECL) return;
+
+    ast_visit_children(node, specialize, ctx);
+
+    NodeType specialized;
+    switch (node->type) {
+        case NODE_ADD: specialized = NODE_INT_ADD; break;
+        case NODE_SUB: specialized = NODE_INT_SUB; break;
+        case NODE_MUL: specialized = NODE_INT_MUL; break;
+        case NODE_MOD: specialized = NODE_INT_MOD; break;
+        case NODE_LT:  specialized = NODE_INT_LT; break;
+        case NODE_GT:  specialized = NODE_INT_GT; break;
+        case NODE_LE:  specialized = NODE_INT_LE; break;
+        case NODE_GE:  specialized = NODE_INT_GE; break;
+        case NODE_EQ:  specialized = NODE_INT_EQ; break;
+        case NODE_NE:  specialized = NODE_INT_NE; break;
+        default: return;
+    }
+    if (is_int_expr(inf, node->data.binary_op.left) &&
+        is_int_expr(inf, node->data.binary_op.right)) {
+        node->type = specialized;
+        node->data_type.base_type = specialized <= NODE_INT_MOD ? TYPE_INT : TYPE_BOOL;
+    }
+}
+
+static int is_main(ASTNode *decl) {
+    return decl->data.func_decl.name == atom_main;
+}
+
+void infer_types(ASTNode *root, int global_count) {
+    if (!root || root->type != NODE_DECL_LIST) return;
+
+    Inference inf = { NULL, NULL, 0 };
+    inf.global_int = (char*)malloc(global_count > 0 ? global_count : 1);
+    for (int i = 0; i < global_count; i++) inf.global_int[i] = 1;
+
+    /* Global frame: top-level statements and the body of main. Function
+     * names hold functions, not ints. */
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type == NODE_FUNC_DECL && decl->data.func_decl.slot >= 0) {
+            inf.global_int[decl->data.func_decl.slot] = 0;
+        }
+    }
+    do {
+        inf.changed = 0;
+        for (int i = 0; i < root->data.list.count; i++) {
+            ASTNode *decl = root->data.list.items[i];
+            if (decl->type != NODE_FUNC_DECL) {
+                check_stores(decl, &inf);
+            } else if (is_main(decl)) {
+                check_stores(decl->data.func_decl.body, &inf);
+            }
+        }
+    } while (inf.changed);
+
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL) {
+            specialize(decl, &inf);
+        } else if (is_main(decl)) {
+            specialize(decl->data.func_decl.body, &inf);
+        }
+    }
+
+    /* Each other function, against the now fixed globals */
+    for (int i = 0; i < root->data.list.count; i++) {
+        ASTNode *decl = root->data.list.items[i];
+        if (decl->type != NODE_FUNC_DECL || is_main(decl)) continue;
+
+        int num_slots = decl->data.func_decl.num_slots;
+        ASTNode *params = decl->data.func_decl.params;
+        int num_params = params ? params->data.list.count : 0;
+
+        inf.local_int = (char*)malloc(num_slots > 0 ? num_slots : 1);
+        for (int s = 0; s < num_slots; s++) inf.local_int[s] = s >= num_params;
+
+        do {
+            inf.changed = 0;
+            check_stores(decl->data.func_decl.body, &inf);
+        } while (inf.changed);
+        specialize(decl->data.func_decl.body, &inf);
+
+        free(inf.local_int);
+        inf.local_int = NULL;
+    }
+
+    free(inf.global_int);
+}
@@ -0,0 +1,459 @@
+#include "vm.h"
+#include "builtins.h"
+#include "output.h"
+#include "input.h"
+#include "matrix_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Use GCC/Clang labels-as-values for dispatch when available */
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+typedef struct {
+    BytecodeFunction *fn;
+    const Instr *ip;   /* Resume point while a callee runs */
+    int base;          /* First register of the frame's window */
+} CallFrame;
+
+typedef struct {
+    Value *stack;
+    int stack_size;
+    CallFrame *frames;
+    int frame_count;
+    int frame_capacity;
+} VM;
+
+/* Drop whatever a register owns */
+#define VM_RELEASE(v) do { \
+        if ((v)->type == VAL_STRING || (v)->type == VAL_MATRIX) free_value(v); \
+    } while (0)
+
+static int max_call_depth = VM_MAX_CALL_DEPTH;
+
+void vm_set_max_depth(int depth) {
+    max_call_depth = depth;
+}
+
+static void vm_clear(Value *regs, int count) {
+    for (int i = 0; i < count; i++) {
+        VM_RELEASE(&regs[i]);
+        regs[i].type = VAL_UNDEFINED;
+    }
+}
+
+static void vm_ensure_stack(VM *vm, int needed) {
+    if (needed <= vm->stack_size) return;
+
+    int new_size = vm->stack_size * 2;
+    if (new_size < needed) new_size = needed;
+    vm->stack = (Value*)realloc(vm->stack, new_size * sizeof(Value));
+    if (!vm->stack) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = vm->stack_size; i < new_size; i++) {
+        vm->stack[i].type = VAL_UNDEFINED;
+    }
+    vm->stack_size = new_size;
+}
+
+static CallFrame* vm_push_frame(VM *vm) {
+    if (vm->frame_count >= vm->frame_capacity) {
+        vm->frame_capacity = vm->frame_capacity == 0 ? 64 : vm->frame_capacity * 2;
+        vm->frames = (CallFrame*)realloc(vm->frames, vm->frame_capacity * sizeof(CallFrame));
+        if (!vm->frames) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    return &vm->frames[vm->frame_count++];
+}
+
+static void vm_undefined(Atom name) {
+    fprintf(stderr, "Runtime error: Undefined variable '%s'\n", name);
+    runtime_abort();
+}
+
+static int to_int(Value *v) {
+    return v->type == VAL_INT ? v->data.int_val : (int)v->data.float_val;
+}
+
+void vm_execute(BytecodeProgram *program) {
+    VM vm = {0};
+    vm_ensure_stack(&vm, program->script.num_regs + 256);
+
+    CallFrame *frame = vm_push_frame(&vm);
+    frame->fn = &program->script;
+    frame->base = 0;
+
+    BytecodeFunction *fn = frame->fn;
+    const Instr *ip = fn->code;
+    Value *K = fn->constants;
+    Value *R = vm.stack;
+    Instr ins;
+
+#define RK(x) (((x) & RK_CONST) ? &K[(x) & ~RK_CONST] : &R[(x)])
+#define JUMP(ins) (ip = fn->code + INSTR_TARGET(ins))
+#define SET_INT(dst, v) do { Value *d_ = (dst); VM_RELEASE(d_); d_->type = VAL_INT; d_->data.int_val = (v); } while (0)
+#define SET_BOOL(dst, v) do { Value *d_ = (dst); VM_RELEASE(d_); d_->type = VAL_BOOL; d_->data.bool_val = (v); } while (0)
+#define SET_VALUE(dst, v) do { Value v_ = (v); Value *d_ = (dst); VM_RELEASE(d_); *d_ = v_; } while (0)
+
+#if VM_COMPUTED_GOTO
+#define OPCODE_LABEL(name) &&L_##name,
+    static void *dispatch_table[] = { OPCODE_LIST(OPCODE_LABEL) };
+#undef OPCODE_LABEL
+#define VM_CASE(name) L_##name
+#define VM_DISPATCH() do { ins = *ip++; goto *dispatch_table[ins.op]; } while (0)
+    VM_DISPATCH();
+#else
+#define VM_CASE(name) case name
+#define VM_DISPATCH() continue
+    for (;;) {
+        ins = *ip++;
+        switch (ins.op) {
+#endif
+
+    VM_CASE(OP_LOADK):
+        SET_VALUE(&R[ins.a], copy_value(&K[ins.b]));
+        VM_DISPATCH();
+
+    VM_CASE(OP_LOADNIL):
+        VM_RELEASE(&R[ins.a]);
+        R[ins.a].type = VAL_VOID;
+        VM_DISPATCH();
+
+    VM_CASE(OP_MOVE):
+        if (ins.a != ins.b) {
+            SET_VALUE(&R[ins.a], copy_value(&R[ins.b]));
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_LOADG):
+        if (vm.stack[ins.b].type == VAL_UNDEFINED) {
+            vm_undefined(program->script.var_names[ins.b]);
+        }
+        SET_VALUE(&R[ins.a], copy_value(&vm.stack[ins.b]));
+        VM_DISPATCH();
+
+    VM_CASE(OP_LOADLG):
+        if (R[ins.b].type != VAL_UNDEFINED) {
+            if (ins.a != ins.b) SET_VALUE(&R[ins.a], copy_value(&R[ins.b]));
+        } else if (vm.stack[ins.c].type != VAL_UNDEFINED) {
+            SET_VALUE(&R[ins.a], copy_value(&vm.stack[ins.c]));
+        } else {
+            vm_undefined(fn->var_names[ins.b]);
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_CHECKDEF):
+        if (R[ins.a].type == VAL_UNDEFINED) vm_undefined(fn->var_names[ins.a]);
+        VM_DISPATCH();
+
+    VM_CASE(OP_ADD): {
+        Value *l = RK(ins.b), *r = RK(ins.c);
+        if (l->type == VAL_INT && r->type == VAL_INT) {
+            SET_INT(&R[ins.a], l->data.int_val + r->data.int_val);
+        } else {
+            SET_VALUE(&R[ins.a], eval_binary_op(NODE_ADD, l, r));
+        }
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_SUB): {
+        Value *l = RK(ins.b), *r = RK(ins.c);
+        if (l->type == VAL_INT && r->type == VAL_INT) {
+            SET_INT(&R[ins.a], l->data.int_val - r->data.int_val);
+        } else {
+            SET_VALUE(&R[ins.a], eval_binary_op(NODE_SUB, l, r));
+        }
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_MUL): {
+        Value *l = RK(ins.b), *r = RK(ins.c);
+        if (l->type == VAL_INT && r->type == VAL_INT) {
+            SET_INT(&R[ins.a], l->data.int_val * r->data.int_val);
+        } else {
+            SET_VALUE(&R[ins.a], eval_binary_op(NODE_MUL, l, r));
+        }
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_DIV):
+        SET_VALUE(&R[ins.a], eval_binary_op(NODE_DIV, RK(ins.b), RK(ins.c)));
+        VM_DISPATCH();
+
+    VM_CASE(OP_MOD): {
+        Value *l = RK(ins.b), *r = RK(ins.c);
+        if (l->type == VAL_INT && r->type == VAL_INT && r->data.int_val != 0) {
+            SET_INT(&R[ins.a], l->data.int_val % r->data.int_val);
+        } else {
+            SET_VALUE(&R[ins.a], eval_binary_op(NODE_MOD, l, r));
+        }
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_MATMUL):
+        SET_VALUE(&R[ins.a], eval_binary_op(NODE_MATRIX_MUL, RK(ins.b), RK(ins.c)));
+        VM_DISPATCH();
+
+#define VM_COMPARE(name, node_type, cmp) \
+    VM_CASE(name): { \
+        Value *l = RK(ins.b), *r = RK(ins.c); \
+        if (l->type == VAL_INT && r->type == VAL_INT) { \
+            SET_BOOL(&R[ins.a], l->data.int_val cmp r->data.int_val); \
+        } else { \
+            SET_VALUE(&R[ins.a], eval_binary_op(node_type, l, r)); \
+        } \
+        VM_DISPATCH(); \
+    }
+
+    VM_COMPARE(OP_LT, NODE_LT, <)
+    VM_COMPARE(OP_GT, NODE_GT, >)
+    VM_COMPARE(OP_LE, NODE_LE, <=)
+    VM_COMPARE(OP_GE, NODE_GE, >=)
+    VM_COMPARE(OP_EQ, NODE_EQ, ==)
+    VM_COMPARE(OP_NE, NODE_NE, !=)
+#undef VM_COMPARE
+
+    VM_CASE(OP_MATCH):
+        SET_VALUE(&R[ins.a], eval_binary_op(NODE_PATTERN_MATCH, RK(ins.b), RK(ins.c)));
+        VM_DISPATCH();
+
+    VM_CASE(OP_MATCHK):
+        SET_BOOL(&R[ins.a], R[ins.b].type == VAL_STRING &&
+                 regex_match(fn->patterns[ins.c], R[ins.b].data.string_val));
+        VM_DISPATCH();
+
+    VM_CASE(OP_NEG):
+        if (R[ins.b].type == VAL_INT) {
+            SET_INT(&R[ins.a], -R[ins.b].data.int_val);
+        } else {
+            SET_VALUE(&R[ins.a], create_float_value(-R[ins.b].data.float_val));
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_NOT):
+        SET_BOOL(&R[ins.a], !R[ins.b].data.bool_val);
+        VM_DISPATCH();
+
+    VM_CASE(OP_TOBOOL):
+        SET_BOOL(&R[ins.a], R[ins.b].data.bool_val != 0);
+        VM_DISPATCH();
+
+    VM_CASE(OP_INC):
+        if (R[ins.a].type == VAL_INT) {
+            R[ins.a].data.int_val++;
+        } else if (R[ins.a].type == VAL_FLOAT) {
+            R[ins.a].data.float_val += 1.0;
+        } else {
+            fprintf(stderr, "Runtime error: Cannot increment non-numeric type\n");
+            runtime_abort();
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_DEC):
+        if (R[ins.a].type == VAL_INT) {
+            R[ins.a].data.int_val--;
+        } else if (R[ins.a].type == VAL_FLOAT) {
+            R[ins.a].data.float_val -= 1.0;
+        } else {
+            fprintf(stderr, "Runtime error: Cannot decrement non-numeric type\n");
+            runtime_abort();
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_JMP):
+        JUMP(ins);
+        VM_DISPATCH();
+
+    VM_CASE(OP_JMPF):
+        if (!R[ins.a].data.bool_val) JUMP(ins);
+        VM_DISPATCH();
+
+    VM_CASE(OP_JMPT):
+        if (R[ins.a].data.bool_val) JUMP(ins);
+        VM_DISPATCH();
+
+    VM_CASE(OP_FORPREP): {
+        Value *loop = &R[ins.a];
+        int start = to_int(&loop[0]);
+        int end = to_int(&loop[1]);
+        int step = to_int(&loop[2]);
+        unsigned long long trips = range_trip_count(start, end, step, ins.x);
+        SET_INT(&loop[0], start);
+        SET_INT(&loop[1], 0);
+        loop[1].data.count = trips;
+        SET_INT(&loop[2], step);
+        if (trips == 0) JUMP(ins);
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_FORLOOP): {
+        /* Count down the trips, so the counter is only advanced to a
+         * value inside the range and never overflows */
+        Value *loop = &R[ins.a];
+        if (--loop[1].data.count > 0) {
+            loop[0].data.int_val += loop[2].data.int_val;
+            JUMP(ins);
+        }
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_NEWMAT): {
+        int rows = ins.b, cols = ins.c;
+        Value mat_val = create_matrix_value(rows, cols);
+        Matrix *mat = mat_val.data.matrix_val;
+        Value *elems = &R[ins.a];
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                Value *elem = &elems[i * cols + j];
+                if (elem->type == VAL_INT) {
+                    MATRIX_AT(mat, i, j) = elem->data.int_val;
+                } else if (elem->type == VAL_FLOAT) {
+                    MATRIX_AT(mat, i, j) = elem->data.float_val;
+                }
+            }
+        }
+        vm_clear(elems, rows * cols);
+        *elems = mat_val;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_CALL): {
+        BytecodeFunction *callee = &program->functions[ins.b];
+        if (vm.frame_count - 1 >= max_call_depth) {
+            fprintf(stderr, "Runtime error: Max recursion depth (%d) exceeded\n", max_call_depth);
+            runtime_abort();
+        }
+
+        int new_base = frame->base + ins.a;
+        vm_ensure_stack(&vm, new_base + callee->num_regs);
+        vm_clear(&vm.stack[new_base + ins.c], callee->num_regs - ins.c);
+
+        frame->ip = ip;
+        frame = vm_push_frame(&vm);
+        frame->fn = callee;
+        frame->base = new_base;
+
+        fn = callee;
+        ip = fn->code;
+        K = fn->constants;
+        R = vm.stack + new_base;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_TAILCALL): {
+        BytecodeFunction *callee = &program->functions[ins.b];
+        int window = fn->num_regs > callee->num_regs ? fn->num_regs : callee->num_regs;
+        vm_ensure_stack(&vm, frame->base + window);
+        R = vm.stack + frame->base;
+
+        /* The arguments become the callee's parameters at the bottom of
+         * this frame; everything else the caller held is dropped */
+        if (ins.a > 0) {
+            vm_clear(R, ins.a);
+            for (int i = 0; i < ins.c; i++) {
+                R[i] = R[ins.a + i];
+                R[ins.a + i].type = VAL_UNDEFINED;
+            }
+        }
+        vm_clear(&R[ins.c], window - ins.c);
+
+        frame->fn = callee;
+        fn = callee;
+        ip = fn->code;
+        K = fn->constants;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_RET):
+    VM_CASE(OP_RETV): {
+        Value result;
+        if (ins.op == OP_RET) {
+            result = R[ins.a];
+            R[ins.a].type = VAL_UNDEFINED;
+        } else {
+            result = create_void_value();
+        }
+        vm_clear(R, fn->num_regs);
+        *R = result;
+
+        frame = &vm.frames[--vm.frame_count - 1];
+        fn = frame->fn;
+        ip = frame->ip;
+        K = fn->constants;
+        R = vm.stack + frame->base;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(OP_HALT):
+        goto done;
+
+    VM_CASE(OP_PRINT):
+        print_value(R[ins.a]);
+        if (ins.x) output_char(' ');
+        VM_DISPATCH();
+
+    VM_CASE(OP_PRINTNL):
+        output_char('\n');
+        VM_DISPATCH();
+
+    VM_CASE(OP_PRINTM):
+        if (R[ins.a].type == VAL_MATRIX) {
+            print_matrix(R[ins.a].data.matrix_val);
+        } else {
+            fprintf(stderr, "Runtime error: printm() expects a matrix argument\n");
+        }
+        VM_DISPATCH();
+
+    VM_CASE(OP_READ):
+        SET_VALUE(&R[ins.a], read_input_value());
+        VM_DISPATCH();
+
+    VM_CASE(OP_READALL):
+        SET_VALUE(&R[ins.a], input_read_all(ins.x ? input_path("readall", &R[ins.b]) : NULL));
+        VM_DISPATCH();
+
+    VM_CASE(OP_READM):
+        SET_VALUE(&R[ins.a], input_read_matrix(ins.x ? input_path("readm", &R[ins.b]) : NULL));
+        VM_DISPATCH();
+
+    VM_CASE(OP_LOADM):
+        SET_VALUE(&R[ins.a], matrix_load(input_path("loadm", &R[ins.b])));
+        VM_DISPATCH();
+
+    VM_CASE(OP_SAVEM):
+        matrix_save(input_path("savem", &R[ins.a]), &R[ins.b]);
+        VM_DISPATCH();
+
+    VM_CASE(OP_NATIVE):
+        SET_VALUE(&R[ins.a], builtin_call_native(builtin_at(ins.b), &R[ins.a], ins.c));
+        VM_DISPATCH();
+
+#if !VM_COMPUTED_GOTO
+            default:
+                fprintf(stderr, "Runtime error: Bad opcode %d\n", ins.op);
+                runtime_abort();
+        }
+    }
+#endif
+
+done:
+    vm_clear(vm.stack, vm.stack_size);
+    free(vm.stack);
+    free(vm.frames);
+
+#undef RK
+#undef JUMP
+#undef SET_INT
+#undef SET_BOOL
+#undef SET_VALUE
+#undef VM_CASE
+#undef VM_DISPATCH
+}
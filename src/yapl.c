@@ -0,0 +1,85 @@
+#include "yapl.h"
+#include "parse.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "builtins.h"
+#include "output.h"
+#include "input.h"
+#include "jit.h"
+#include "memo.h"
+#include "regex_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+struct YaplProgram {
+    Arena arena;            /* Owns the tree */
+    ASTNode *root;          /* NULL for an empty program */
+    int global_count;
+};
+
+YaplProgram* yapl_compile(const char *source, size_t len, char *error, size_t error_size) {
+    YaplProgram *program = (YaplProgram*)calloc(1, sizeof(YaplProgram));
+    if (!program) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        exit(1);
+    }
+    arena_init(&program->arena, AST_ARENA_CHUNK);
+
+    Arena *previous = ast_use_arena(&program->arena);
+    int result = parse_text(source, len, &program->root, error, error_size);
+    if (result == 0 && program->root) {
+        optimize_program(program->root, OPT_LEVEL_DEFAULT);
+        builtins_warn_shadowed(program->root);
+        program->global_count = prepare_program(program->root);
+    }
+    ast_use_arena(previous);
+
+    if (result != 0) {
+        yapl_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+int yapl_run(YaplProgram *program) {
+    if (!program || !program->root) return 0;
+    Arena *previous = ast_use_arena(&program->arena);
+    int result = run_program(program->root, program->global_count, 1);
+    ast_use_arena(previous);
+    output_flush();
+    return result;
+}
+
+void yapl_free(YaplProgram *program) {
+    if (!program) return;
+    release_program(program->root);
+    Arena *previous = ast_use_arena(&program->arena);
+    free_ast();
+    ast_use_arena(previous);
+    free(program);
+}
+
+void yapl_set_output(YaplOutputFn fn, void *ctx) {
+    output_set_sink(fn, ctx);
+}
+
+int yapl_load_extension(const char *path) {
+    return builtins_load(path);
+}
+
+void yapl_release_thread(void) {
+    output_free();
+    output_set_sink(NULL, NULL);
+    input_free();
+    jit_free();
+    memo_init(NULL);
+    regex_cache_free();
+    free_ast();
+}
+
+void yapl_shutdown(void) {
+    yapl_release_thread();
+    memo_free();
+    builtins_free();
+    atom_table_free();
+}